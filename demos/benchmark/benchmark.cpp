@@ -0,0 +1,148 @@
+/*
+ * A console benchmark for the contact resolver.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * Times a grid of short box stacks resting on the ground, with the
+ * sequential resolver and with the block solver, and reports how far
+ * the boxes have drifted by the end. Stacks at rest are where the
+ * resolver's accumulated impulses matter most, so comparing the
+ * output of a normal build with one made with MIXED_PRECISION defined
+ * shows both the cost and the benefit of the mixed precision mode.
+ * The library must be built with the same precision as this file:
+ * run.sh in this directory builds and runs both.
+ */
+#include <cyclone/cyclone.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define GRID 8
+#define HEIGHT 2
+#define BOXES (GRID * GRID * HEIGHT)
+#define MAX_CONTACTS (BOXES * HEIGHT * 4)
+
+static const char* precisionName( void )
+{
+#if defined(MIXED_PRECISION)
+    return "mixed";
+#elif defined(SINGLE_PRECISION)
+    return "single";
+#else
+    return "double";
+#endif
+}
+
+static void runScene( bool blockSolver, unsigned steps )
+{
+    const cyclone::real duration = (cyclone::real)1.0 / 60;
+
+    cyclone::CollisionPlane ground;
+    ground.direction = cyclone::Vector3( 0, 1, 0 );
+    ground.offset = 0;
+
+    // Build the stacks, each box starting at rest on the one below.
+    static cyclone::RigidBody bodies[BOXES];
+    static cyclone::CollisionBox boxes[BOXES];
+    static cyclone::Vector3 start[BOXES];
+    cyclone::Vector3 halfSize( 0.5, 0.5, 0.5 );
+    cyclone::Matrix3 tensor;
+    tensor.setBlockInertiaTensor( halfSize, 1 );
+    for( unsigned i = 0 ; i < BOXES ; ++i )
+    {
+        unsigned stack = i / HEIGHT;
+        unsigned level = i % HEIGHT;
+
+        cyclone::RigidBody *body = &bodies[i];
+        body->setMass( 1 );
+        body->setInertiaTensor( tensor );
+        body->setDamping( 0.95, 0.8 );
+        body->setAcceleration( cyclone::Vector3::GRAVITY );
+        body->setCanSleep( false );
+        body->setPosition( (stack % GRID) * 3, 0.5 + level, (stack / GRID) * 3 );
+        body->setOrientation( cyclone::Quaternion( 1, 0, 0, 0 ) );
+        body->setVelocity( 0, 0, 0 );
+        body->setRotation( 0, 0, 0 );
+        body->calculateDerivedData();
+        start[i] = body->getPosition();
+
+        boxes[i].body = body;
+        boxes[i].halfSize = halfSize;
+        boxes[i].calculateInternals();
+    }
+
+    static cyclone::Contact contacts[MAX_CONTACTS];
+    cyclone::CollisionData data;
+    data.contactArray = contacts;
+    data.friction = (cyclone::real)0.6;
+    data.restitution = (cyclone::real)0.1;
+    data.tolerance = (cyclone::real)0.1;
+
+    cyclone::ContactResolver resolver( 1u );
+    resolver.setBlockSolver( blockSolver );
+
+    unsigned long totalContacts = 0;
+    clock_t began = clock();
+    for( unsigned step = 0 ; step < steps ; ++step )
+    {
+        for( unsigned i = 0 ; i < BOXES ; ++i )
+        {
+            bodies[i].integrate( duration );
+            boxes[i].calculateInternals();
+        }
+
+        // The stacks are far enough apart that each box can only touch
+        // the ground and the boxes in its own stack.
+        data.reset( MAX_CONTACTS );
+        for( unsigned i = 0 ; i < BOXES ; ++i )
+        {
+            cyclone::CollisionDetector::boxAndHalfSpace( boxes[i], ground, &data );
+            for( unsigned j = i + 1 ; j < BOXES && j / HEIGHT == i / HEIGHT ; ++j )
+            {
+                cyclone::CollisionDetector::boxAndBox( boxes[i], boxes[j], &data );
+            }
+        }
+        totalContacts += data.contactCount;
+
+        // Give the resolver as many iterations as the world would.
+        resolver.setIterations( data.contactCount * 4 + 1 );
+        resolver.resolveContacts( contacts, data.contactCount, duration );
+    }
+    double seconds = (double)( clock() - began ) / CLOCKS_PER_SEC;
+
+    // Measure how far the boxes have drifted from where they started.
+    double maxDrift = 0, meanDrift = 0;
+    for( unsigned i = 0 ; i < BOXES ; ++i )
+    {
+        cyclone::Vector3 offset = bodies[i].getPosition() - start[i];
+        double drift = offset.magnitude();
+        meanDrift += drift;
+        if( drift > maxDrift ) maxDrift = drift;
+    }
+    meanDrift /= BOXES;
+
+    printf( "  %s: %.1f contacts per step, %.3f ms per step, drift mean %.6f max %.6f\n",
+        blockSolver ? "block solver" : "sequential  ",
+        (double)totalContacts / steps, seconds * 1000 / steps,
+        meanDrift, maxDrift );
+}
+
+int main( int argc, char **argv )
+{
+    unsigned steps = (argc > 1) ? (unsigned)atoi( argv[1] ) : 600;
+
+    printf( "%s precision: %u boxes, %u steps\n",
+        precisionName(), BOXES, steps );
+    runScene( false, steps );
+    runScene( true, steps );
+    return 0;
+}
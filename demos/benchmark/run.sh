@@ -0,0 +1,22 @@
+#!/bin/sh
+# Builds the library and the benchmark in the default (double) and
+# mixed precision modes, and runs each. Any arguments are passed on to
+# the benchmark (the number of steps to run).
+#
+# Set CXX and CXXFLAGS to change the compiler and its options.
+
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2}
+OUT=${TMPDIR:-/tmp}/cyclone-benchmark
+mkdir -p "$OUT" || exit 1
+
+for MODE in double mixed
+do
+    DEFINES=
+    if [ "$MODE" = mixed ]; then DEFINES=-DMIXED_PRECISION; fi
+
+    $CXX $CXXFLAGS $DEFINES -I../../include -o "$OUT/benchmark-$MODE" \
+        benchmark.cpp ../../src/*.cpp || exit 1
+    "$OUT/benchmark-$MODE" "$@" || exit 1
+done
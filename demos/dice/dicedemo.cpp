@@ -95,7 +95,6 @@ public:
     virtual void render( void ) = 0;
 
     virtual void Update( cyclone::real duration ) = 0;
-    virtual void DoPlaneCollisionTest( cyclone::CollisionPlane plane, cyclone::CollisionData *collisionData ) = 0;
     virtual void DoDiceCollisionTest( Dice *d, cyclone::CollisionData *collisionData ) = 0;
     virtual void SetState( cyclone::real x, cyclone::real y, cyclone::real z ) = 0;
 };
@@ -153,13 +152,15 @@ public:
         this->RoundingSphere->body->setPosition( this->body->getPosition() );
     }
 
-    void DoPlaneCollisionTest( cyclone::CollisionPlane plane, cyclone::CollisionData *collisionData )
+    // Called by the broad phase for the ground
+    unsigned collideHalfSpace( const cyclone::CollisionPlane &plane, cyclone::CollisionData *collisionData ) const
     {
         if( cyclone::IntersectionTests::sphereAndHalfSpace( *this->RoundingSphere, plane ) )
         {
-			PyramidCollision( *this, plane, collisionData );
+			return PyramidCollision( *this, plane, collisionData );
             //cyclone::CollisionDetector::boxAndHalfSpace( *this, plane, collisionData );
         }
+        return 0;
     }
 
     void DoDiceCollisionTest( Dice *d, cyclone::CollisionData *collisionData )
@@ -202,7 +203,7 @@ public:
         }
     }
 
-	unsigned PyramidCollision( const cyclone::CollisionPrimitive &d, const cyclone::CollisionPlane &plane, cyclone::CollisionData *data )
+	unsigned PyramidCollision( const cyclone::CollisionPrimitive &d, const cyclone::CollisionPlane &plane, cyclone::CollisionData *data ) const
 	{
 		if( data->contactsLeft <= 0 ) 
         {
@@ -311,12 +312,14 @@ public:
         this->RoundingSphere->body->setPosition( this->body->getPosition() );
     }
 
-    void DoPlaneCollisionTest( cyclone::CollisionPlane plane, cyclone::CollisionData *collisionData )
+    // Called by the broad phase for the ground
+    unsigned collideHalfSpace( const cyclone::CollisionPlane &plane, cyclone::CollisionData *collisionData ) const
     {
-        if( cyclone::IntersectionTests::boxAndHalfSpace( *this, plane ) && cyclone::IntersectionTests::sphereAndHalfSpace( *this->RoundingSphere, plane ) )
+        if( cyclone::IntersectionTests::sphereAndHalfSpace( *this->RoundingSphere, plane ) )
         {
-            cyclone::CollisionDetector::boxAndHalfSpace( *this, plane, collisionData );
+            return cyclone::CollisionDetector::boxAndHalfSpace( *this, plane, collisionData );
         }
+        return 0;
     }
 
     void DoDiceCollisionTest( Dice *d, cyclone::CollisionData *collisionData )
@@ -373,6 +376,7 @@ private:
     cyclone::Vector3 m_DragPoint;
     Dice *m_DragDice;
 	cyclone::CollisionBox m_Walls[4];
+	cyclone::BroadPhase m_BroadPhase;
 	cyclone::real m_DragTime;
 
     unsigned int m_PickBuffer[PICK_BUFFER_SIZE];
@@ -419,11 +423,13 @@ DiceDemo::DiceDemo( void )
 	{
 		this->m_Dices.push_back( d = new SixSidedDice() );
 		d->SetState( i, i*2, i );
+		this->m_BroadPhase.add( d );
 	}
 	for( int j = 0; j < 2; ++j )
 	{
 		this->m_Dices.push_back( d = new EightSidedDice() );
 		d->SetState( j, j*2, j );
+		this->m_BroadPhase.add( d );
 	}
 
 	// Create a few boxes to create an inner box.
@@ -446,23 +452,20 @@ DiceDemo::DiceDemo( void )
 	m_Walls[2].body->setPosition( m_Walls[2].body->getPointInWorldSpace( cyclone::Vector3( 0, 1.5, 15) ) );
 	m_Walls[3].body->setPosition( m_Walls[3].body->getPointInWorldSpace( cyclone::Vector3( 0, 1.5, -15) ) );
 
+	// The walls are scenery: static bodies never move or wake, and
+	// contacts treat them as having infinite mass.
 	for( unsigned int i = 0 ; i < 4 ; ++i )
 	{
-		m_Walls[i].body->setMass( 100.0f );
-		
-		cyclone::Matrix3 tensor;
-        tensor.setBlockInertiaTensor( m_Walls[i].halfSize, 100.0f );
-        m_Walls[i].body->setInertiaTensor( tensor );
-
-        m_Walls[i].body->setDamping( 1.0, 1.0 );
-        m_Walls[i].body->clearAccumulators();
-     
-		m_Walls[i].body->setAcceleration( 0, 0, 0 );
-		m_Walls[i].body->setCanSleep( true );
-        m_Walls[i].body->setAwake();
-
+		m_Walls[i].body->setBodyType( cyclone::RigidBody::STATIC_BODY );
 		m_Walls[i].body->calculateDerivedData();
+		m_Walls[i].calculateInternals();
 	}
+
+	// Create the ground plane
+	cyclone::CollisionPlane plane;
+	plane.direction = cyclone::Vector3( 0, 1, 0 );
+	plane.offset = 0;
+	this->m_BroadPhase.addHalfSpace( plane );
 }
 
 static bool deleteElm( Dice *d )
@@ -671,11 +674,6 @@ void DiceDemo::MouseDrag( int x, int y )
 
 void DiceDemo::GenerateContacts( void )
 {
-    // Create a ground plane
-    cyclone::CollisionPlane plane;
-    plane.direction = cyclone::Vector3( 0, 1, 0 );
-    plane.offset = 0;
-	
     this->m_CollisionData.reset( RigidBodyApplication::s_MaxContacts );
     this->m_CollisionData.friction = (cyclone::real) 0.9;
     this->m_CollisionData.restitution = (cyclone::real) 0.1;
@@ -686,11 +684,13 @@ void DiceDemo::GenerateContacts( void )
         this->m_CollisionData.addContacts( this->m_DragJoint->addContact( this->m_CollisionData.contacts, this->m_CollisionData.contactsLeft ) );
     }
 
+    // The ground is a half-space in the broad phase, checked against
+    // all the dice at once
+    this->m_BroadPhase.findHalfSpaceContacts( &this->m_CollisionData );
+
     std::list<Dice*>::const_iterator it, ti;
     for( it = this->m_Dices.begin() ; it != this->m_Dices.end() ; ++it )
     {
-		(*it)->DoPlaneCollisionTest( plane, &this->m_CollisionData );
-
 		// Do collision detection for walls
 		for( unsigned int i = 0; i < 4; ++i )
 		{
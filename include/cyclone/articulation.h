@@ -0,0 +1,264 @@
+/*
+ * Interface file for articulated bodies.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains the definitions for articulated bodies: trees of
+ * rigid bodies connected by joints, simulated in terms of their joint
+ * angles rather than as independent bodies.
+ */
+#ifndef CYCLONE_ARTICULATION_H
+#define CYCLONE_ARTICULATION_H
+
+#include <vector>
+#include "body.h"
+
+namespace cyclone {
+
+    /**
+     * An articulation is a tree of rigid bodies (links), each joined
+     * to its parent by a joint with a single degree of freedom. The
+     * root links are joined to the world. Rather than constraining
+     * independent bodies, the articulation simulates the joint
+     * coordinates directly with Featherstone's articulated body
+     * algorithm, so joints can never come apart and the cost of each
+     * step grows linearly with the number of links.
+     *
+     * The link bodies are ordinary rigid bodies: forces can be added
+     * to them, and collision primitives and contacts can refer to
+     * them. They must not be integrated directly, as the articulation
+     * sets their position, orientation and velocity from the joints.
+     *
+     * Contacts are resolved as though each link were free. Calling
+     * absorbVelocityChanges after the contacts are resolved turns the
+     * changes the resolver made to the link velocities into impulses
+     * on the whole articulation, so the joints stay intact.
+     */
+    class Articulation
+    {
+    public:
+        /**
+         * The kinds of joint a link can have with its parent.
+         */
+        enum JointType
+        {
+            /** The link turns about the joint's axis. */
+            REVOLUTE,
+
+            /** The link slides along the joint's axis. */
+            PRISMATIC
+        };
+
+        /**
+         * Holds a single link of the articulation.
+         */
+        struct Link
+        {
+            /**
+             * Holds the rigid body of the link.
+             */
+            RigidBody *body;
+
+            /**
+             * Holds the index of the parent link, or -1 if the link
+             * is joined to the world.
+             */
+            int parent;
+
+            /**
+             * Holds the kind of joint to the parent.
+             */
+            JointType type;
+
+            /**
+             * Holds the joint axis in the parent's local coordinates.
+             */
+            Vector3 axis;
+
+            /**
+             * Holds the position of the joint in the parent's local
+             * coordinates.
+             */
+            Vector3 parentOffset;
+
+            /**
+             * Holds the position of the joint in the link's local
+             * coordinates.
+             */
+            Vector3 linkOffset;
+
+            /**
+             * Holds the orientation of the link relative to its parent
+             * when the joint coordinate is zero.
+             */
+            Quaternion restOrientation;
+
+            /**
+             * Holds the joint coordinate: an angle for revolute joints
+             * and a distance for prismatic joints.
+             */
+            real position;
+
+            /**
+             * Holds the rate of change of the joint coordinate.
+             */
+            real velocity;
+
+            /**
+             * Holds the torque (or force, for prismatic joints) to
+             * drive the joint with. This is not cleared between steps.
+             */
+            real drive;
+
+            /**
+             * Holds the amount of joint damping, as a torque (or force)
+             * per unit of joint velocity.
+             */
+            real damping;
+        };
+
+    protected:
+        /**
+         * Holds the working data for one link during the articulated
+         * body algorithm. Spatial vectors are stored angular part
+         * first, in world coordinates measured about the world origin.
+         */
+        struct LinkState
+        {
+            /** Holds the joint's spatial axis. */
+            real axis[6];
+
+            /** Holds the spatial velocity of the link. */
+            real velocity[6];
+
+            /** Holds the velocity product acceleration of the link. */
+            real bias[6];
+
+            /** Holds the articulated inertia of the link's subtree. */
+            real inertia[36];
+
+            /** Holds the articulated bias force of the subtree. */
+            real force[6];
+
+            /** Holds the articulated inertia times the joint axis. */
+            real inertiaAxis[6];
+
+            /** Holds the inertia of the subtree about the joint. */
+            real jointInertia;
+
+            /** Holds the joint force left after the bias forces. */
+            real jointForce;
+
+            /** Holds the spatial acceleration of the link. */
+            real acceleration[6];
+        };
+
+        /**
+         * Holds the links, with every parent before its children.
+         */
+        std::vector<Link> links;
+
+        /**
+         * Holds the working data for each link.
+         */
+        std::vector<LinkState> states;
+
+        /**
+         * Holds the joint acceleration of each link for the current
+         * step.
+         */
+        std::vector<real> jointAccelerations;
+
+        /**
+         * Holds the spatial force (or impulse) on each link, six
+         * reals per link, for the current step.
+         */
+        std::vector<real> linkForces;
+
+    public:
+        /**
+         * Adds a link to the articulation, returning its index. The
+         * link body should be positioned and oriented where it should
+         * be with a joint coordinate of zero, and its derived data
+         * should be up to date, as should the parent's. The parent
+         * must already be in the articulation (or be -1 to join the
+         * link to the world). The axis and joint position are given
+         * in world coordinates. The link must have finite mass.
+         */
+        unsigned addLink(RigidBody *body, int parent, JointType type,
+                         const Vector3 &axis, const Vector3 &jointPosition);
+
+        /**
+         * Returns the number of links.
+         */
+        unsigned getLinkCount() const
+        {
+            return (unsigned)links.size();
+        }
+
+        /**
+         * Gives access to the given link's joint.
+         */
+        Link& getLink(unsigned index)
+        {
+            return links[index];
+        }
+
+        /**
+         * Integrates the articulation forward in time by the given
+         * amount, using the forces applied to the link bodies (which
+         * are then cleared) and each joint's drive and damping. The
+         * link bodies are then moved to match the joints.
+         */
+        void integrate(real duration);
+
+        /**
+         * Turns any changes made to the link bodies' velocities since
+         * the last step (by contact resolution, for example) into
+         * impulses on the articulation, and updates the joint
+         * velocities and link bodies to suit.
+         */
+        void absorbVelocityChanges();
+
+    protected:
+        /**
+         * Runs the articulated body algorithm, filling in the joint
+         * accelerations for the given spatial forces on each link.
+         * If dynamics is false the velocity products are left out,
+         * which gives the response to a set of impulses instead.
+         */
+        void calculateJointAccelerations(const std::vector<real> &forces,
+                                         bool dynamics);
+
+        /**
+         * Sets the position and orientation of each link body from
+         * the joint coordinates.
+         */
+        void updateLinkPositions();
+
+        /**
+         * Fills in the spatial axis and velocity of each link from
+         * the joint velocities, without changing the link bodies.
+         */
+        void calculateLinkVelocities();
+
+        /**
+         * Sets the velocity and rotation of each link body from the
+         * joint velocities.
+         */
+        void updateLinkVelocities();
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_ARTICULATION_H
@@ -23,6 +23,11 @@
 
 namespace cyclone {
 
+    /*
+     * Forward declaration, see articulation.h.
+     */
+    class Articulation;
+
     /**
      * A rigid body is the basic simulation object in the physics
      * core.
@@ -33,22 +38,88 @@ namespace cyclone {
      * to it. The rigid body manages its state and allows access
      * through a set of methods.
      *
-     * A ridid body contains 64 words (the size of which is given
-     * by the precision: sizeof(real)). It contains no virtual
-     * functions, so should take up exactly 64 words in memory. Of
-     * this total 15 words are padding, distributed among the
-     * Vector3 data members.
+     * A rigid body contains no virtual functions. Its data is
+     * split into hot data, used every step, and a few cold members
+     * at the end: 332 bytes in all in single precision, 252 of them
+     * hot, and 648 in double precision, 488 of them hot.
      */
     class RigidBody
     {
+        /**
+         * Articulations integrate their link bodies themselves, so
+         * they need to read the forces applied to them.
+         */
+        friend class Articulation;
+
+        /**
+         * Gravity is applied to whole batches of bodies at once,
+         * directly on the body data.
+         */
+        friend class Gravity;
+
     public:
+        /**
+         * The shapes an inertia tensor can have in body space. Each
+         * has its own cheaper way to find the tensor in world space.
+         */
+        enum InertiaType
+        {
+            /**
+             * The tensor is a multiple of the identity (spheres and
+             * cubes), so it is the same in world space.
+             */
+            ISOTROPIC_INERTIA,
+
+            /**
+             * The tensor is diagonal (boxes and other shapes built on
+             * their principal axes).
+             */
+            DIAGONAL_INERTIA,
+
+            /** The tensor may be anything. */
+            FULL_INERTIA
+        };
+
+        /**
+         * The ways a body can take part in the simulation.
+         */
+        enum BodyType
+        {
+            /**
+             * The body never moves, and has infinite mass. It is never
+             * integrated, and is always asleep.
+             */
+            STATIC_BODY,
+
+            /**
+             * The body is moved by the application (see
+             * setKinematicTarget) rather than by forces or contacts,
+             * and has infinite mass. It is always awake, so the bodies
+             * it pushes see its velocity.
+             */
+            KINEMATIC_BODY,
+
+            /** The body is moved by forces and contacts. */
+            DYNAMIC_BODY
+        };
 
         // ... Other RigidBody code as before ...
 
 
     protected:
         /**
-         * @name Characteristic Data and State
+         * @name Hot Data
+         *
+         * The data members touched every step for every awake body,
+         * by the integrator, the force generators and the contact
+         * resolver, are held together at the start of the body, and
+         * the data that is only read when the body's setup changes or
+         * its derived data is recalculated follows them. The members
+         * a force generator touches (the flags, position, transform
+         * matrix and accumulators) come first, so applying a force
+         * reads 112 bytes of the body in single precision and 208 in
+         * double precision. The body is not padded out to a cache
+         * line: the padding cost more in memory traffic than it saved.
          *
          * This data holds the state of the rigid body. There are two
          * sets of data: characteristics and state.
@@ -80,45 +151,50 @@ namespace cyclone {
          * @see calculateInternals
          */
         /*@{*/
+
         /**
-         * Holds the inverse of the mass of the rigid body. It
-         * is more useful to hold the inverse mass because
-         * integration is simpler, and because in real time
-         * simulation it is more useful to have bodies with
-         * infinite mass (immovable) than zero mass
-         * (completely unstable in numerical simulation).
+         * Counts changes to the body's transform. This is bumped
+         * whenever the position or orientation is set directly, and
+         * whenever the derived data is recalculated, so anything that
+         * caches data computed from the transform (such as collision
+         * primitives) can tell if its cache is stale.
+         *
+         * @see getTransformVersion
          */
-        real inverseMass;
+        unsigned transformVersion;
 
         /**
-         * Holds the inverse of the body's inertia tensor. The
-         * intertia tensor provided must not be degenerate
-         * (that would mean the body had zero inertia for
-         * spinning along one axis). As long as the tensor is
-         * finite, it will be invertible. The inverse tensor
-         * is used for similar reasons to the use of inverse
-         * mass.
-         *
-         * The inertia tensor, unlike the other variables that
-         * define a rigid body, is given in body space.
-         *
-         * @see inverseMass
+         * Holds the shape of the body-space inverse inertia tensor,
+         * which picks the way the world space tensor is found.
          */
-        Matrix3 inverseInertiaTensor;
+        InertiaType inertiaType;
 
         /**
-         * Holds the amount of damping applied to linear
-         * motion.  Damping is required to remove energy added
-         * through numerical instability in the integrator.
+         * Holds the way the body takes part in the simulation.
          */
-        real linearDamping;
+        BodyType bodyType;
 
         /**
-         * Holds the amount of damping applied to angular
-         * motion.  Damping is required to remove energy added
-         * through numerical instability in the integrator.
+         * A body can be put to sleep to avoid it being updated
+         * by the integration functions or affected by collisions
+         * with the world.
          */
-        real angularDamping;
+        bool isAwake;
+
+        /**
+         * Some bodies may never be allowed to fall asleep.
+         * User controlled bodies, for example, should be
+         * always awake.
+         */
+        bool canSleep;
+
+        /**
+         * Set when the position, orientation or inertia tensor has
+         * changed since the derived data was last calculated.
+         *
+         * @see updateDerivedData
+         */
+        bool derivedDataDirty;
 
         /**
          * Holds the linear position of the rigid body in
@@ -126,6 +202,29 @@ namespace cyclone {
          */
         Vector3 position;
 
+        /**
+         * Holds a transform matrix for converting body space into
+         * world space and vice versa. This can be achieved by calling
+         * the getPointIn*Space functions.
+         *
+         * @see getPointInLocalSpace
+         * @see getPointInWorldSpace
+         * @see getTransform
+         */
+        Matrix4 transformMatrix;
+
+        /**
+         * Holds the accumulated force to be applied at the next
+         * integration step.
+         */
+        Vector3 forceAccum;
+
+        /**
+         * Holds the accumulated torque to be applied at the next
+         * integration step.
+         */
+        Vector3 torqueAccum;
+
         /**
          * Holds the angular orientation of the rigid body in
          * world space.
@@ -144,16 +243,18 @@ namespace cyclone {
          */
         Vector3 rotation;
 
-        /*@}*/
-
+        /**
+         * Holds the acceleration of the rigid body.  This value
+         * can be used to set acceleration due to gravity (its primary
+         * use), or any other constant acceleration.
+         */
+        Vector3 acceleration;
 
         /**
-         * @name Derived Data
-         *
-         * These data members hold information that is derived from
-         * the other data in the class.
+         * Holds the linear acceleration of the rigid body, for the
+         * previous frame.
          */
-        /*@{*/
+        Vector3 lastFrameAcceleration;
 
         /**
          * Holds the inverse inertia tensor of the body in world
@@ -165,75 +266,89 @@ namespace cyclone {
         Matrix3 inverseInertiaTensorWorld;
 
         /**
-         * Holds the amount of motion of the body. This is a recency
-         * weighted mean that can be used to put a body to sleap.
+         * Holds the inverse of the mass of the rigid body. It
+         * is more useful to hold the inverse mass because
+         * integration is simpler, and because in real time
+         * simulation it is more useful to have bodies with
+         * infinite mass (immovable) than zero mass
+         * (completely unstable in numerical simulation).
          */
-        real motion;
+        real inverseMass;
 
         /**
-         * A body can be put to sleep to avoid it being updated
-         * by the integration functions or affected by collisions
-         * with the world.
+         * Holds the proportions of velocity and rotation kept over
+         * dragDuration, and the weight the sleep test gives the
+         * previous motion over it. These are cached so the damping
+         * is only raised to a power when the time step or the
+         * damping changes.
          */
-        bool isAwake;
+        real linearDrag, angularDrag, motionBias;
 
         /**
-         * Some bodies may never be allowed to fall asleep.
-         * User controlled bodies, for example, should be
-         * always awake.
+         * Holds the duration the drag was calculated for, or zero if
+         * it needs calculating.
          */
-        bool canSleep;
+        real dragDuration;
 
         /**
-         * Holds a transform matrix for converting body space into
-         * world space and vice versa. This can be achieved by calling
-         * the getPointIn*Space functions.
-         *
-         * @see getPointInLocalSpace
-         * @see getPointInWorldSpace
-         * @see getTransform
+         * Holds the amount of motion of the body. This is a recency
+         * weighted mean that can be used to put a body to sleap.
          */
-        Matrix4 transformMatrix;
+        real motion;
 
         /*@}*/
 
 
         /**
-         * @name Force and Torque Accumulators
+         * @name Cold Data
          *
-         * These data members store the current force, torque and
-         * acceleration of the rigid body. Forces can be added to the
-         * rigid body in any order, and the class decomposes them into
-         * their constituents, accumulating them for the next
-         * simulation step. At the simulation step, the accelerations
-         * are calculated and stored to be applied to the rigid body.
+         * These data members hold characteristics of the rigid body
+         * that are only read when they are set, or when the derived
+         * data is recalculated.
          */
         /*@{*/
 
         /**
-         * Holds the accumulated force to be applied at the next
-         * integration step.
+         * Holds the inverse of the body's inertia tensor. The
+         * intertia tensor provided must not be degenerate
+         * (that would mean the body had zero inertia for
+         * spinning along one axis). As long as the tensor is
+         * finite, it will be invertible. The inverse tensor
+         * is used for similar reasons to the use of inverse
+         * mass.
+         *
+         * The inertia tensor, unlike the other variables that
+         * define a rigid body, is given in body space.
+         *
+         * @see inverseMass
          */
-        Vector3 forceAccum;
+        Matrix3 inverseInertiaTensor;
 
         /**
-         * Holds the accumulated torque to be applied at the next
-         * integration step.
+         * Holds the amount of damping applied to linear
+         * motion.  Damping is required to remove energy added
+         * through numerical instability in the integrator.
          */
-        Vector3 torqueAccum;
+        real linearDamping;
 
-       /**
-         * Holds the acceleration of the rigid body.  This value
-         * can be used to set acceleration due to gravity (its primary
-         * use), or any other constant acceleration.
+        /**
+         * Holds the amount of damping applied to angular
+         * motion.  Damping is required to remove energy added
+         * through numerical instability in the integrator.
          */
-        Vector3 acceleration;
+        real angularDamping;
 
         /**
-         * Holds the linear acceleration of the rigid body, for the
-         * previous frame.
+         * Holds the position and orientation a kinematic body should
+         * be moved to at its next integration step.
          */
-        Vector3 lastFrameAcceleration;
+        Vector3 targetPosition;
+        Quaternion targetOrientation;
+
+        /**
+         * Set when a kinematic body has a target to move to.
+         */
+        bool hasTarget;
 
         /*@}*/
 
@@ -247,6 +362,13 @@ namespace cyclone {
          */
         /*@{*/
 
+        /**
+         * Creates a new rigid body with infinite mass, at the origin
+         * and at rest. Mass, inertia and state should be set before
+         * the body is simulated.
+         */
+        RigidBody();
+
         /*@}*/
 
 
@@ -273,6 +395,16 @@ namespace cyclone {
          */
         void calculateDerivedData();
 
+        /**
+         * Calculates internal data from state data, but only if the
+         * position, orientation or inertia tensor has been set since
+         * it was last calculated. Returns true if it was calculated.
+         * This lets code that doesn't know which bodies have moved
+         * bring them all up to date without recalculating the ones
+         * that haven't.
+         */
+        bool updateDerivedData();
+
         /**
          * Integrates the rigid body forward in time by the given amount.
          * This function uses a Newton-Euler integration method, which is a
@@ -451,6 +583,25 @@ namespace cyclone {
          */
         Matrix3 getInverseInertiaTensorWorld() const;
 
+        /**
+         * Returns the shape of the body's inertia tensor. This is
+         * worked out whenever the tensor is set: a tensor counts as
+         * diagonal or isotropic only if its other elements are
+         * exactly zero, and its diagonal elements exactly equal.
+         */
+        InertiaType getInertiaType() const;
+
+        /**
+         * Returns the change in rotation the given impulsive torque
+         * would give the body: the torque transformed by the inverse
+         * inertia tensor in world space. This is cheaper than taking
+         * a copy of the tensor, especially for isotropic bodies.
+         *
+         * @param impulsiveTorque The impulsive torque, in world
+         * space.
+         */
+        Vector3 getRotationChange(const Vector3 &impulsiveTorque) const;
+
         /**
          * Sets both linear and angular damping in one function call.
          *
@@ -832,6 +983,49 @@ namespace cyclone {
          */
         void setCanSleep(const bool canSleep=true);
 
+        /**
+         * Returns the current transform version of the body. The
+         * value changes every time the position or orientation of the
+         * body is set, or its derived data is recalculated. Two equal
+         * values mean the transform has not changed in between.
+         */
+        unsigned getTransformVersion() const
+        {
+            return transformVersion;
+        }
+
+        /**
+         * Returns the way the body takes part in the simulation.
+         */
+        BodyType getBodyType() const
+        {
+            return bodyType;
+        }
+
+        /**
+         * Sets the way the body takes part in the simulation. Bodies
+         * are dynamic unless this is called.
+         *
+         * Static and kinematic bodies have infinite mass, so this
+         * clears any mass and inertia tensor they were given, and
+         * they should not be given any afterwards. Static bodies are
+         * put to sleep for good, and kinematic bodies are kept awake.
+         * A body made dynamic again needs its mass and inertia
+         * tensor setting.
+         */
+        void setBodyType(BodyType bodyType);
+
+        /**
+         * Sets the position and orientation a kinematic body should
+         * have after its next integration step. The step sets the
+         * body's velocity and rotation to those that would carry it
+         * there, so the bodies it touches respond to its motion.
+         * Without a target a kinematic body carries on at its current
+         * velocity and rotation. This has no effect on other bodies.
+         */
+        void setKinematicTarget(const Vector3 &position,
+                                const Quaternion &orientation);
+
         /*@}*/
 
 
@@ -971,6 +1165,12 @@ namespace cyclone {
 
         /*@}*/
 
+    protected:
+        /**
+         * Moves a kinematic body to its target, or on at its current
+         * velocity and rotation if it has none.
+         */
+        void integrateKinematic(real duration);
     };
 
 } // namespace cyclone
@@ -0,0 +1,334 @@
+/*
+ * Interface file for cloth and soft bodies.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains the definitions for cloth and soft bodies: sets
+ * of point masses joined by springs, integrated implicitly so that
+ * stiff springs can be used with long time steps.
+ */
+#ifndef CYCLONE_CLOTH_H
+#define CYCLONE_CLOTH_H
+
+#include <vector>
+#include "collide_fine.h"
+
+namespace cyclone {
+
+    /**
+     * A cloth is a set of point masses joined by damped springs. It
+     * can equally be used for soft bodies: any arrangement of masses
+     * and springs will do.
+     *
+     * Unlike particles joined by ParticleSpring force generators,
+     * the masses and springs are held in flat arrays and are
+     * integrated together with the backward (implicit) Euler method.
+     * Each step solves a linear system for the change in velocity
+     * with the conjugate gradient method, so stiff springs stay
+     * stable at normal frame rates rather than needing tiny time
+     * steps.
+     *
+     * The cloth collides against planes, spheres and boxes. It is
+     * pushed out of them but doesn't push back: the primitives are
+     * treated as having infinite mass.
+     */
+    class Cloth
+    {
+    protected:
+        /**
+         * Holds the position of each mass.
+         */
+        std::vector<Vector3> positions;
+
+        /**
+         * Holds the velocity of each mass.
+         */
+        std::vector<Vector3> velocities;
+
+        /**
+         * Holds the inverse mass of each mass. Masses with zero
+         * inverse mass are pinned in place.
+         */
+        std::vector<real> inverseMasses;
+
+        /**
+         * Holds the forces applied to each mass for the next step.
+         */
+        std::vector<Vector3> forceAccums;
+
+        /**
+         * Holds the masses joined by each spring, two per spring.
+         */
+        std::vector<unsigned> springEnds;
+
+        /**
+         * Holds the rest length of each spring.
+         */
+        std::vector<real> restLengths;
+
+        /**
+         * Holds the stiffness of each spring.
+         */
+        std::vector<real> stiffnesses;
+
+        /**
+         * Holds the damping of each spring, as a force per unit of
+         * closing speed.
+         */
+        std::vector<real> dampings;
+
+        /**
+         * Holds the acceleration applied to every mass (gravity).
+         */
+        Vector3 acceleration;
+
+        /**
+         * Holds the proportion of velocity kept each second, as for
+         * Particle::damping.
+         */
+        real damping;
+
+        /**
+         * Holds the most conjugate gradient iterations made each step.
+         */
+        unsigned maxIterations;
+
+        /**
+         * Holds the tolerance the conjugate gradient solve stops at,
+         * relative to the size of the right hand side.
+         */
+        real tolerance;
+
+        /**
+         * Holds the distance masses are kept from collision surfaces.
+         */
+        real thickness;
+
+        /**
+         * Holds the proportion of sliding velocity removed by a
+         * collision.
+         */
+        real friction;
+
+        /**
+         * Holds the planes the cloth collides against.
+         */
+        std::vector<const CollisionPlane*> planes;
+
+        /**
+         * Holds the spheres the cloth collides against.
+         */
+        std::vector<const CollisionSphere*> spheres;
+
+        /**
+         * Holds the boxes the cloth collides against.
+         */
+        std::vector<const CollisionBox*> boxes;
+
+        /**
+         * Holds the matrix each spring adds to the system for the
+         * current step.
+         */
+        std::vector<Matrix3> springMatrices;
+
+        /**
+         * Holds the change in velocity being solved for.
+         */
+        std::vector<Vector3> velocityChanges;
+
+        /**
+         * Holds the working vectors of the conjugate gradient solve.
+         */
+        std::vector<Vector3> residuals, directions, products;
+
+        /**
+         * Holds the diagonal preconditioner of the system for each
+         * mass.
+         */
+        std::vector<real> preconditioner;
+
+        /**
+         * Holds the number of iterations used in the last step.
+         */
+        unsigned iterationsUsed;
+
+        /**
+         * Multiplies the given vector of velocity changes by the
+         * system matrix. Pinned masses are left out.
+         */
+        void multiply(const std::vector<Vector3> &vector,
+                      std::vector<Vector3> &result) const;
+
+        /**
+         * Pushes the masses out of the collision primitives.
+         */
+        void collide();
+
+        /**
+         * Pushes the given mass out along the given normal by the
+         * given amount, removing its velocity into the surface and
+         * some of its sliding velocity. The surface velocity is that
+         * of the primitive where the mass touches it.
+         */
+        void resolveCollision(unsigned index, const Vector3 &normal,
+                              real penetration,
+                              const Vector3 &surfaceVelocity);
+
+    public:
+        /**
+         * Creates an empty cloth.
+         */
+        Cloth();
+
+        /**
+         * Adds a mass at the given position, returning its index.
+         * An inverse mass of zero pins the mass in place.
+         */
+        unsigned addMass(const Vector3 &position, real inverseMass);
+
+        /**
+         * Adds a spring between the given masses, returning its
+         * index. The rest length is the distance between them now.
+         */
+        unsigned addSpring(unsigned first, unsigned second,
+                           real stiffness, real damping);
+
+        /**
+         * Adds a rectangular sheet of cloth, with masses on a grid of
+         * the given number of columns and rows starting at the origin
+         * and stepping along the two edge vectors. Neighbouring masses
+         * are joined by stretch and shear springs, and masses two
+         * apart by weaker bending springs. Returns the index of the
+         * first mass added; the rest follow row by row.
+         */
+        unsigned addSheet(const Vector3 &origin, const Vector3 &columnStep,
+                          const Vector3 &rowStep, unsigned columns,
+                          unsigned rows, real totalMass, real stiffness,
+                          real damping, real bendStiffness);
+
+        /**
+         * Returns the number of masses.
+         */
+        unsigned getMassCount() const;
+
+        /**
+         * Returns the number of springs.
+         */
+        unsigned getSpringCount() const;
+
+        /**
+         * Returns the position of the given mass.
+         */
+        const Vector3& getPosition(unsigned index) const;
+
+        /**
+         * Moves the given mass.
+         */
+        void setPosition(unsigned index, const Vector3 &position);
+
+        /**
+         * Returns the velocity of the given mass.
+         */
+        const Vector3& getVelocity(unsigned index) const;
+
+        /**
+         * Sets the velocity of the given mass.
+         */
+        void setVelocity(unsigned index, const Vector3 &velocity);
+
+        /**
+         * Returns the inverse mass of the given mass.
+         */
+        real getInverseMass(unsigned index) const;
+
+        /**
+         * Sets the inverse mass of the given mass. Zero pins it.
+         */
+        void setInverseMass(unsigned index, real inverseMass);
+
+        /**
+         * Returns the masses joined by the given spring.
+         */
+        void getSpringEnds(unsigned spring, unsigned *first,
+                           unsigned *second) const;
+
+        /**
+         * Adds the given force to the given mass for the next step.
+         */
+        void addForce(unsigned index, const Vector3 &force);
+
+        /**
+         * Sets the acceleration applied to every mass.
+         */
+        void setAcceleration(const Vector3 &acceleration);
+
+        /**
+         * Sets the proportion of velocity kept each second.
+         */
+        void setDamping(real damping);
+
+        /**
+         * Sets the most conjugate gradient iterations to make each
+         * step, and the relative tolerance to stop at.
+         */
+        void setSolverIterations(unsigned maxIterations,
+                                 real tolerance = (real)0.0001);
+
+        /**
+         * Returns the number of conjugate gradient iterations used in
+         * the last step.
+         */
+        unsigned getIterationsUsed() const;
+
+        /**
+         * Sets the distance the masses are kept from collision
+         * surfaces, and the proportion of their sliding velocity
+         * removed when they touch.
+         */
+        void setCollisionResponse(real thickness, real friction);
+
+        /**
+         * Adds a plane for the cloth to collide against. The plane
+         * must outlive the cloth, or be removed with
+         * clearCollisionPrimitives.
+         */
+        void addCollisionPlane(const CollisionPlane *plane);
+
+        /**
+         * Adds a sphere for the cloth to collide against. Its
+         * internals must be kept up to date.
+         */
+        void addCollisionSphere(const CollisionSphere *sphere);
+
+        /**
+         * Adds a box for the cloth to collide against. Its internals
+         * must be kept up to date.
+         */
+        void addCollisionBox(const CollisionBox *box);
+
+        /**
+         * Removes all the collision primitives.
+         */
+        void clearCollisionPrimitives();
+
+        /**
+         * Integrates the cloth forward in time by the given amount,
+         * using the forces added since the last step (which are then
+         * cleared), and then resolves collisions.
+         */
+        void integrate(real duration);
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_CLOTH_H
@@ -25,6 +25,13 @@
 
 namespace cyclone {
 
+    /*
+     * Forward declarations, see collide_fine.h.
+     */
+    class CollisionPrimitive;
+    class CollisionPlane;
+    struct CollisionData;
+
     /**
      * Represents a bounding sphere that can be tested for overlap.
      */
@@ -72,6 +79,57 @@ namespace cyclone {
         }
     };
 
+    /**
+     * Represents an axis aligned bounding box that can be tested for
+     * overlap. The box is stored as a centre and a half-size along
+     * each world axis.
+     */
+    struct BoundingBox
+    {
+        Vector3 centre;
+        Vector3 halfSize;
+
+    public:
+        /**
+         * Creates an empty bounding box at the origin.
+         */
+        BoundingBox() {}
+
+        /**
+         * Creates a new bounding box at the given centre, with the
+         * given half-sizes.
+         */
+        BoundingBox(const Vector3 &centre, const Vector3 &halfSize);
+
+        /**
+         * Creates a bounding box to enclose the two given bounding
+         * boxes.
+         */
+        BoundingBox(const BoundingBox &one, const BoundingBox &two);
+
+        /**
+         * Checks if the bounding box overlaps with the other given
+         * bounding box.
+         */
+        bool overlaps(const BoundingBox *other) const;
+
+        /**
+         * Reports how much this bounding box would have to grow by
+         * to incorporate the given bounding box. As for the bounding
+         * sphere, the value is proportional to the growth in surface
+         * area.
+         */
+        real getGrowth(const BoundingBox &other) const;
+
+        /**
+         * Returns the volume of this bounding box.
+         */
+        real getSize() const
+        {
+            return ((real)8.0) * halfSize.x * halfSize.y * halfSize.z;
+        }
+    };
+
     /**
      * Stores a potential contact to check later.
      */
@@ -83,6 +141,263 @@ namespace cyclone {
         RigidBody* body[2];
     };
 
+    /**
+     * Stores a pair of collision primitives whose bounding boxes
+     * overlap, to check later with the fine grained collision tests.
+     */
+    struct PotentialCollision
+    {
+        /**
+         * Holds the primitives that might be in contact.
+         */
+        CollisionPrimitive* primitive[2];
+    };
+
+    /**
+     * Finds the pairs of collision primitives that might be in
+     * contact, from their bounding boxes.
+     *
+     * Primitives whose bodies are static when they are added are held
+     * apart from the others, in a bounding volume tree of their own.
+     * Static bodies never move, so the tree is built once (and again
+     * only when static primitives are added or removed) and never
+     * refit. The moving (kinematic and dynamic) primitives are sorted
+     * along the x axis and swept against each other, and each awake
+     * dynamic one is checked against the static tree.
+     *
+     * Pairs that can't lead to a response are never reported: static
+     * primitives are never checked against each other or against
+     * kinematic ones, and a pair needs at least one dynamic body and
+     * at least one awake body.
+     *
+     * The ground and other infinite planes are held as half-spaces
+     * rather than as primitives, so they never take part in the
+     * search for pairs. Each step the bounding boxes of the awake
+     * dynamic primitives are checked against every half-space in one
+     * pass over flat arrays, and only the primitives that reach a
+     * half-space have their contacts with it generated.
+     */
+    class BroadPhase
+    {
+    protected:
+        /**
+         * Holds a static primitive, with the bounding box it had
+         * when it was added.
+         */
+        struct StaticPrimitive
+        {
+            CollisionPrimitive *primitive;
+            BoundingBox volume;
+        };
+
+        /**
+         * Holds a node of the static tree. A branch's first child
+         * follows it directly, and its second child is at the index
+         * given by first. A leaf holds a run of static primitives.
+         */
+        struct StaticNode
+        {
+            /**
+             * Holds the bounding box of everything below the node.
+             */
+            BoundingBox volume;
+
+            /**
+             * Holds the first static primitive of a leaf, or the
+             * second child of a branch.
+             */
+            unsigned first;
+
+            /**
+             * Holds the number of static primitives in a leaf, or
+             * zero for a branch.
+             */
+            unsigned count;
+        };
+
+        /**
+         * Orders static primitives along an axis, to split them
+         * between the two children of a branch.
+         */
+        struct CentreOrder;
+
+        /**
+         * Holds the static primitives, in the order of the tree's
+         * leaves.
+         */
+        std::vector<StaticPrimitive> staticPrimitives;
+
+        /**
+         * Holds the nodes of the static tree, root first.
+         */
+        std::vector<StaticNode> staticTree;
+
+        /**
+         * Set when the static tree matches the static primitives.
+         */
+        bool staticTreeValid;
+
+        /**
+         * Holds the moving primitives, sorted by the low end of their
+         * bounding boxes along the x axis as of the last search.
+         */
+        std::vector<CollisionPrimitive*> movingPrimitives;
+
+        /**
+         * Holds the width along the x axis of the widest moving
+         * primitive, as of the last sort.
+         */
+        real movingMaxWidth;
+
+        /**
+         * Holds the normal of each half-space.
+         */
+        std::vector<Vector3> halfSpaceDirections;
+
+        /**
+         * Holds the offset of each half-space's plane from the origin.
+         */
+        std::vector<real> halfSpaceOffsets;
+
+        /**
+         * Holds the primitives being checked against the half-spaces.
+         */
+        std::vector<CollisionPrimitive*> candidates;
+
+        /**
+         * Holds the centres and half-sizes of the candidates'
+         * bounding boxes, one array for each axis, so each half-space
+         * is checked against them all in a single loop.
+         */
+        std::vector<real> candidateCentres[3];
+        std::vector<real> candidateHalfSizes[3];
+
+        /**
+         * Holds the distance of each candidate's bounding box below
+         * the half-space being checked, positive if it reaches it.
+         */
+        std::vector<real> candidateDepths;
+
+        /**
+         * Brings the moving primitives back into order along the x
+         * axis.
+         */
+        void sortMovingPrimitives();
+
+        /**
+         * Rebuilds the static tree from the static primitives.
+         */
+        void buildStaticTree();
+
+        /**
+         * Adds the node for the given run of static primitives, and
+         * the nodes below it, to the static tree.
+         */
+        void buildStaticNode(unsigned first, unsigned count);
+
+        /**
+         * Writes the pairs the given moving primitive makes with the
+         * static primitives into the given array, up to the given
+         * limit, returning the number written.
+         */
+        unsigned findStaticCollisions(CollisionPrimitive *primitive,
+                                      PotentialCollision *pairs,
+                                      unsigned limit) const;
+
+    public:
+        /**
+         * Holds the most static primitives a leaf of the static tree
+         * holds.
+         */
+        static const unsigned STATIC_LEAF_SIZE = 4;
+
+        /**
+         * Creates an empty broad phase.
+         */
+        BroadPhase();
+
+        /**
+         * Adds the given primitive. Whether it is static is decided
+         * by its body's type now: a body whose type changes must be
+         * removed and added again. The internals of static primitives
+         * are calculated here, and their bounding boxes are kept from
+         * then on.
+         */
+        void add(CollisionPrimitive *primitive);
+
+        /**
+         * Removes the given primitive, returning false if it wasn't
+         * added.
+         */
+        bool remove(CollisionPrimitive *primitive);
+
+        /**
+         * Returns the number of static primitives.
+         */
+        unsigned getStaticCount() const;
+
+        /**
+         * Returns the number of moving (kinematic and dynamic)
+         * primitives.
+         */
+        unsigned getMovingCount() const;
+
+        /**
+         * Writes the pairs of primitives whose bounding boxes overlap
+         * into the given array, up to the given limit, returning the
+         * number written. The internals of the moving primitives must
+         * be up to date.
+         */
+        unsigned findPotentialCollisions(PotentialCollision *pairs,
+                                         unsigned limit);
+
+        /**
+         * Writes the moving (kinematic and dynamic) primitives whose
+         * bounding boxes overlap the given box into the given array,
+         * up to the given limit, returning the number written. The
+         * internals of the moving primitives must be up to date.
+         */
+        unsigned findMovingPrimitives(const BoundingBox &volume,
+                                      CollisionPrimitive **found,
+                                      unsigned limit);
+
+        /**
+         * Adds a half-space, given by the plane at its surface, for
+         * the dynamic primitives to collide against. The plane is
+         * copied, so it should be added again (after calling
+         * clearHalfSpaces) if it moves.
+         */
+        void addHalfSpace(const CollisionPlane &plane);
+
+        /**
+         * Removes all the half-spaces.
+         */
+        void clearHalfSpaces();
+
+        /**
+         * Returns the number of half-spaces.
+         */
+        unsigned getHalfSpaceCount() const;
+
+        /**
+         * Moves the static primitives' bounding boxes, the static
+         * tree and the half-spaces by the opposite of the given
+         * offset, for use when the world's origin is moved by it (see
+         * World::shiftOrigin). The static bodies must have been moved
+         * first: the internals of their primitives are calculated
+         * again here.
+         */
+        void shiftOrigin(const Vector3 &offset);
+
+        /**
+         * Writes the contacts between the awake dynamic primitives
+         * and the half-spaces into the given collision data,
+         * returning the number written. The internals of the moving
+         * primitives must be up to date.
+         */
+        unsigned findHalfSpaceContacts(CollisionData *data);
+    };
+
     /**
      * A base class for nodes in a bounding volume hierarchy.
      *
@@ -26,12 +26,15 @@
 #define CYCLONE_COLLISION_FINE_H
 
 #include "contacts.h"
+#include "collide_coarse.h"
 
 namespace cyclone {
 
     // Forward declarations of primitive friends
     class IntersectionTests;
     class CollisionDetector;
+    class CollisionPlane;
+    struct CollisionData;
 
     /**
      * Represents a primitive to detect collisions against.
@@ -54,14 +57,38 @@ namespace cyclone {
 
         /**
          * The offset of this primitive from the given rigid body.
+         * If this is changed after the internals have been
+         * calculated, call invalidateInternals so the change is
+         * picked up.
          */
         Matrix4 offset;
 
         /**
-         * Calculates the internals for the primitive.
+         * Creates a new primitive with no body and no offset.
+         */
+        CollisionPrimitive() : body(NULL), cachedBody(NULL), cachedVersion(0) {}
+
+        virtual ~CollisionPrimitive() {}
+
+        /**
+         * Calculates the internals for the primitive. The world
+         * transform and bounding box are only recalculated if the
+         * body's transform has changed since the last call, so
+         * calling this for bodies that are asleep costs almost
+         * nothing.
          */
         void calculateInternals();
 
+        /**
+         * Forces the next call to calculateInternals to recalculate
+         * the primitive's transform and bounding box. Use this after
+         * changing the offset or the primitive's dimensions.
+         */
+        void invalidateInternals()
+        {
+            cachedBody = NULL;
+        }
+
         /**
          * This is a convenience function to allow access to the
          * axis vectors in the transform for this primitive.
@@ -82,6 +109,26 @@ namespace cyclone {
             return transform;
         }
 
+        /**
+         * Returns the world space axis aligned bounding box of the
+         * primitive, as of the last call to calculateInternals.
+         */
+        const BoundingBox& getBoundingBox() const
+        {
+            return boundingBox;
+        }
+
+        /**
+         * Writes the contacts between the primitive and the given
+         * half-space into the given collision data, returning the
+         * number written. This lets the broad phase collide the
+         * world's half-spaces with primitives whose shape it doesn't
+         * know. Primitives with an extent override this: the default
+         * is a point, which is never reported.
+         */
+        virtual unsigned collideHalfSpace(const CollisionPlane &plane,
+                                          CollisionData *data) const;
+
 
     protected:
         /**
@@ -90,6 +137,27 @@ namespace cyclone {
          * with the transform of the rigid body.
          */
         Matrix4 transform;
+
+        /**
+         * The world space bounding box of the primitive, updated
+         * along with the transform.
+         */
+        BoundingBox boundingBox;
+
+        /**
+         * Calculates the bounding box from the current transform.
+         * Primitives with an extent override this: the default is a
+         * point at the primitive's origin.
+         */
+        virtual void calculateBoundingBox();
+
+    private:
+        /**
+         * The body and its transform version the cached transform
+         * and bounding box were calculated from.
+         */
+        RigidBody *cachedBody;
+        unsigned cachedVersion;
     };
 
     /**
@@ -103,6 +171,12 @@ namespace cyclone {
          * The radius of the sphere.
          */
         real radius;
+
+        virtual unsigned collideHalfSpace(const CollisionPlane &plane,
+                                          CollisionData *data) const;
+
+    protected:
+        virtual void calculateBoundingBox();
     };
 
     /**
@@ -135,6 +209,12 @@ namespace cyclone {
          * Holds the half-sizes of the box along each of its local axes.
          */
         Vector3 halfSize;
+
+        virtual unsigned collideHalfSpace(const CollisionPlane &plane,
+                                          CollisionData *data) const;
+
+    protected:
+        virtual void calculateBoundingBox();
     };
 
     /**
@@ -26,6 +26,7 @@
 #ifndef CYCLONE_CONTACTS_H
 #define CYCLONE_CONTACTS_H
 
+#include <vector>
 #include "body.h"
 
 namespace cyclone {
@@ -35,6 +36,7 @@ namespace cyclone {
      * documentation.
      */
     class ContactResolver;
+    class Constraint;
 
     /**
      * A contact represents two bodies in contact. Resolving a
@@ -135,6 +137,57 @@ namespace cyclone {
          */
         Vector3 relativeContactPosition[2];
 
+        /**
+         * Holds the index of each body in the resolver's list of
+         * dynamic bodies, or ContactResolver::NO_BODY if the body is
+         * missing or immovable. This is set by the resolver when
+         * contacts are resolved in batches.
+         */
+        unsigned bodyIndex[2];
+
+        /**
+         * Holds the change in rotation of each body per unit of
+         * impulse along the contact normal. This is set before
+         * split impulse position resolution.
+         */
+        Vector3 angularPerUnitImpulse[2];
+
+        /**
+         * Holds the impulse needed to change the separating velocity
+         * of the contact by one unit.
+         */
+        real normalMass;
+
+        /**
+         * Holds the total normal impulse applied at this contact by
+         * the block solver.
+         */
+        real_accum normalImpulse;
+
+        /**
+         * Holds the total impulse applied along each of the contact's
+         * tangents by the block solver.
+         */
+        real_accum frictionImpulse[2];
+
+        /**
+         * Holds the separating velocity the block solver is aiming
+         * for at this contact.
+         */
+        real targetVelocity;
+
+        /**
+         * Holds the separating pseudo-velocity needed to remove the
+         * penetration over one frame.
+         */
+        real pseudoTarget;
+
+        /**
+         * Holds the total pseudo-impulse applied at this contact
+         * during split impulse position resolution.
+         */
+        real_accum pseudoImpulse;
+
     protected:
         /**
          * Calculates internal data from state data. This is called before
@@ -191,6 +244,66 @@ namespace cyclone {
         void applyVelocityChange(Vector3 velocityChange[2],
                                  Vector3 rotationChange[2]);
 
+        /**
+         * Recalculates the closing velocity from the current state of
+         * the bodies, and applies an impulse if the contact needs
+         * more than the given velocity epsilon to be resolved. Returns
+         * true if an impulse was applied.
+         */
+        bool resolveVelocity(real duration, real velocityEpsilon);
+
+        /**
+         * Recalculates the closing velocity at the contact from the
+         * current state of the bodies.
+         */
+        void updateContactVelocity(real duration);
+
+        /**
+         * Calculates the normal mass of the contact, and the change in
+         * rotation of each body per unit of normal impulse.
+         */
+        void calculateNormalMass();
+
+        /**
+         * Returns the change in separating velocity at this contact
+         * caused by a unit impulse along the normal of the given
+         * contact, which must be between the same bodies. Both
+         * contacts must have had calculateNormalMass called.
+         */
+        real calculateNormalResponse(const Contact &other) const;
+
+        /**
+         * Applies the given impulse (in world coordinates) to the
+         * first body at the contact point, and its opposite to the
+         * second body.
+         */
+        void applyWorldImpulse(const Vector3 &impulse);
+
+        /**
+         * Applies a friction impulse to remove the sliding velocity at
+         * the contact, limited by the normal impulse accumulated so far.
+         * Returns true if this changed the velocity by more than the
+         * given epsilon.
+         */
+        bool resolveFriction(real duration, real velocityEpsilon);
+
+        /**
+         * Calculates the normal mass of the contact and the
+         * separating pseudo-velocity it is aiming for, ready for
+         * split impulse position resolution.
+         */
+        void preparePseudoVelocity(real targetVelocity);
+
+        /**
+         * Applies a pseudo-impulse to the given per-body
+         * pseudo-velocities (indexed by bodyIndex) to bring the
+         * separating pseudo-velocity to its target. The total
+         * pseudo-impulse is never allowed to pull the bodies together.
+         * Returns the change in separating pseudo-velocity.
+         */
+        real applyPseudoImpulse(Vector3 *pseudoVelocities,
+                                Vector3 *pseudoRotations);
+
         /**
          * Performs an inertia weighted penetration resolution of this
          * contact alone.
@@ -201,12 +314,9 @@ namespace cyclone {
 
         /**
          * Calculates the impulse needed to resolve this contact,
-         * given that the contact has no friction. A pair of inertia
-         * tensors - one for each contact object - is specified to
-         * save calculation time: the calling function has access to
-         * these anyway.
+         * given that the contact has no friction.
          */
-        Vector3 calculateFrictionlessImpulse(Matrix3 *inverseInertiaTensor);
+        Vector3 calculateFrictionlessImpulse();
 
         /**
          * Calculates the impulse needed to resolve this contact,
@@ -265,9 +375,69 @@ namespace cyclone {
      * In general this resolver is not suitable for stacks of bodies,
      * but is perfect for handling impact, explosive, and flat resting
      * situations.
+     *
+     * @section batching Batched Resolution
+     *
+     * When batching is enabled (see setBatching) the resolver instead
+     * sweeps over every contact once per iteration. The contacts are
+     * first coloured so that no two contacts in the same batch share
+     * a body that can move, and the contacts in each batch are then
+     * resolved in parallel. Bodies with infinite mass (and the
+     * scenery) are never moved, so they may be shared by any number
+     * of contacts in a batch. The result does not depend on the number
+     * of threads used, and parallel resolution is only available when
+     * the library is compiled with OpenMP.
+     *
+     * @section splitimpulse Split Impulse
+     *
+     * Rather than moving bodies directly out of penetration, the
+     * resolver can be set (see setSplitImpulse) to solve for a
+     * pseudo-velocity at each contact, in sweeps of the same shape as
+     * the velocity solver. The pseudo-velocities are integrated once
+     * at the end and then thrown away, so position correction never
+     * adds to the real velocity of the bodies and each iteration costs
+     * the same amount.
+     *
+     * @section blocksolver Block Solver
+     *
+     * With the block solver enabled (see setBlockSolver) consecutive
+     * contacts between the same pair of bodies are treated as a
+     * manifold of up to MAX_MANIFOLD points. The normal impulses of a
+     * manifold are solved together, as a small linear complementarity
+     * problem, before friction is applied at each point. Stacks
+     * resolved this way settle in far fewer iterations. Contact
+     * generators already write the points of a manifold next to one
+     * another.
+     *
+     * @section constraints Constraints
+     *
+     * Joints derived from Constraint (see joints.h) can be given to
+     * the resolver with setConstraints. Their impulses are solved in
+     * the same velocity sweeps as the contacts, ahead of them in each
+     * sweep, so joints and contacts settle together.
      */
     class ContactResolver
     {
+    public:
+        /**
+         * The body index given to contact bodies that the resolver
+         * will not move.
+         */
+        static const unsigned NO_BODY = 0xffffffff;
+
+        /**
+         * The number of batches contacts are coloured into. Any
+         * contact that doesn't fit in one of these is placed in a
+         * final batch that is resolved on a single thread.
+         */
+        static const unsigned MAX_BATCHES = 32;
+
+        /**
+         * The largest number of contacts the block solver treats as a
+         * single manifold.
+         */
+        static const unsigned MAX_MANIFOLD = 4;
+
     protected:
         /**
          * Holds the number of iterations to perform when resolving
@@ -299,6 +469,110 @@ namespace cyclone {
          */
         real positionEpsilon;
 
+        /**
+         * Holds true if contacts are resolved in coloured batches
+         * rather than in order of severity.
+         */
+        bool batched;
+
+        /**
+         * Holds true if penetration is resolved with pseudo-velocities
+         * rather than by moving the bodies directly.
+         */
+        bool splitImpulse;
+
+        /**
+         * Holds the proportion of the penetration that split impulse
+         * resolution removes each frame.
+         */
+        real splitImpulseBias;
+
+        /**
+         * Holds true if the normal impulses of each manifold are
+         * solved together.
+         */
+        bool blockSolver;
+
+        /**
+         * Holds the constraints resolved along with the contacts.
+         */
+        Constraint **constraints;
+
+        /**
+         * Holds the number of constraints.
+         */
+        unsigned numConstraints;
+
+        /**
+         * Holds the number of threads each batch may be resolved on.
+         */
+        unsigned threads;
+
+        /**
+         * Holds each distinct dynamic body in the contacts being
+         * resolved, in address order.
+         */
+        std::vector<RigidBody*> bodies;
+
+        /**
+         * Holds the set of batches each body already has a contact in,
+         * as a bit mask.
+         */
+        std::vector<unsigned> bodyBatches;
+
+        /**
+         * Holds the first contact in each group of contacts that are
+         * resolved together, with one extra entry marking the end of
+         * the last group. Without the block solver every contact is a
+         * group of its own.
+         */
+        std::vector<unsigned> groupStarts;
+
+        /**
+         * Holds the batch each group was placed in.
+         */
+        std::vector<unsigned> groupBatches;
+
+        /**
+         * Holds the index of each group, sorted by batch.
+         */
+        std::vector<unsigned> batchGroups;
+
+        /**
+         * Holds the offset of each batch into batchGroups, with
+         * one extra entry marking the end of the last batch.
+         */
+        std::vector<unsigned> batchOffsets;
+
+        /**
+         * Holds the dynamic body indices of each group being coloured,
+         * two per group.
+         */
+        std::vector<unsigned> groupBodies;
+
+        /**
+         * Holds the index of each constraint, sorted by batch.
+         */
+        std::vector<unsigned> batchConstraints;
+
+        /**
+         * Holds the offset of each batch into batchConstraints, with
+         * one extra entry marking the end of the last batch.
+         */
+        std::vector<unsigned> constraintOffsets;
+
+        /**
+         * Holds the linear and angular movement given to each body
+         * so far during batched position resolution.
+         */
+        std::vector<Vector3> linearChanges, angularChanges;
+
+        /**
+         * Holds the pseudo-velocity and pseudo-rotation of each body
+         * during split impulse position resolution.
+         */
+        std::vector<Vector3> pseudoVelocities, pseudoRotations;
+
     public:
         /**
          * Stores the number of velocity iterations used in the
@@ -364,6 +638,53 @@ namespace cyclone {
         void setEpsilon(real velocityEpsilon,
                         real positionEpsilon);
 
+        /**
+         * Sets whether contacts are resolved in coloured batches, and
+         * the number of threads to use for each batch. In batched
+         * mode the iteration counts are the number of sweeps over the
+         * whole set of contacts.
+         */
+        void setBatching(bool batched, unsigned threads=1);
+
+        /**
+         * Returns true if contacts are resolved in coloured batches.
+         */
+        bool isBatched() const
+        {
+            return batched;
+        }
+
+        /**
+         * Sets whether penetration is resolved with pseudo-velocities
+         * instead of by moving the bodies directly, and the proportion
+         * of the penetration to remove each frame.
+         */
+        void setSplitImpulse(bool splitImpulse, real bias=(real)0.8);
+
+        /**
+         * Sets whether the normal impulses of each manifold are
+         * solved together. The block solver resolves velocity in
+         * sweeps, as batched resolution does, whether or not batching
+         * is enabled.
+         */
+        void setBlockSolver(bool blockSolver);
+
+        /**
+         * Sets the constraints to resolve along with the contacts
+         * each time resolveContacts is called. The array is not
+         * copied, so it must remain valid until it is replaced. Having
+         * any constraints makes velocity resolution run in sweeps.
+         */
+        void setConstraints(Constraint **constraints,
+                            unsigned numConstraints);
+
+        /**
+         * Returns the number of rows the constraints were solved as
+         * in the last frame. Constraints that haven't been solved yet
+         * are counted as having the most rows a constraint can have.
+         */
+        unsigned getConstraintRowCount() const;
+
         /**
          * Resolves a set of contacts for both penetration and velocity.
          *
@@ -418,6 +739,69 @@ namespace cyclone {
         void adjustPositions(Contact *contacts,
             unsigned numContacts,
             real duration);
+
+        /**
+         * Groups the contacts and gives each group a batch, so that no
+         * two groups in the same batch can move the same body. Groups
+         * are coloured in the order given, so the batches are
+         * repeatable.
+         */
+        void colourContacts(Contact *contacts, unsigned numContacts);
+
+        /**
+         * Gives each group a batch, given the two body indices of each
+         * group in groupBodies, and fills in the groups sorted by
+         * batch and the offset of each batch.
+         */
+        void colourGroups(std::vector<unsigned> &order,
+                          std::vector<unsigned> &offsets);
+
+        /**
+         * Calculates the effective mass of each constraint and applies
+         * its impulses from last frame.
+         */
+        void prepareConstraints(real duration);
+
+        /**
+         * Resolves the velocity issues with the given array of
+         * constraints, one coloured batch at a time.
+         */
+        void adjustVelocitiesBatched(Contact *contacts,
+            unsigned numContacts,
+            real duration);
+
+        /**
+         * Resolves the positional issues with the given array of
+         * constraints, one coloured batch at a time.
+         */
+        void adjustPositionsBatched(Contact *contacts,
+            unsigned numContacts,
+            real duration);
+
+        /**
+         * Resolves the positional issues with the given array of
+         * constraints by solving for pseudo-velocities, then moving
+         * the bodies by them.
+         */
+        void adjustPseudoVelocities(Contact *contacts,
+            unsigned numContacts,
+            real duration);
+
+        /**
+         * Recalculates the derived data of the sleeping bodies in the
+         * given contacts that have been moved. Awake bodies are left
+         * for the next integration step.
+         */
+        void updateSleepingBodies(Contact *contacts, unsigned numContacts);
+
+        /**
+         * Solves the normal impulses of the given manifold together,
+         * then applies friction at each point. Returns true if the
+         * velocities changed by more than the velocity epsilon.
+         */
+        bool resolveManifold(Contact *contacts,
+            unsigned numContacts,
+            real duration);
     };
 
     /**
@@ -455,12 +455,12 @@ namespace cyclone {
 
         const static Vector3 Zero;
 
-        static Vector3 &Min( Vector3 &a, Vector3 &b )
+        static Vector3 Min( const Vector3 &a, const Vector3 &b )
         {
             return Vector3( a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z );
         }
 
-        static Vector3 &Max( Vector3 &a, Vector3 &b )
+        static Vector3 Max( const Vector3 &a, const Vector3 &b )
         {
             return Vector3( a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z );
         }
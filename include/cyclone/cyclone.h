@@ -12,11 +12,17 @@
 #include "precision.h"
 #include "core.h"
 #include "random.h"
+#include "slotmap.h"
 #include "particle.h"
+#include "integrators.h"
 #include "body.h"
 #include "pcontacts.h"
 #include "pworld.h"
 #include "collide_fine.h"
 #include "contacts.h"
 #include "fgen.h"
-#include "joints.h"
\ No newline at end of file
+#include "fields.h"
+#include "waves.h"
+#include "joints.h"
+#include "articulation.h"
+#include "cloth.h"
\ No newline at end of file
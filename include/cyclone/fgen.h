@@ -20,7 +20,10 @@
 
 #include "body.h"
 #include "pfgen.h"
+#include "collide_coarse.h"
 #include <vector>
+#include <map>
+#include "slotmap.h"
 
 namespace cyclone {
 
@@ -37,6 +40,16 @@ namespace cyclone {
          * and update the force applied to the given rigid body.
          */
         virtual void updateForce(RigidBody *body, real duration) = 0;
+
+        /**
+         * Updates the forces applied to each of the given bodies.
+         * The registry calls this once per frame with every body the
+         * generator is registered with. By default it calls
+         * updateForce for each; generators that apply the same force
+         * law to many bodies can overload it with a tighter loop.
+         */
+        virtual void updateForces(RigidBody **bodies, unsigned count,
+                                  real duration);
     };
 
     /**
@@ -55,6 +68,10 @@ namespace cyclone {
 
         /** Applies the gravitational force to the given rigid body. */
         virtual void updateForce(RigidBody *body, real duration);
+
+        /** Applies the gravitational force to the given rigid bodies. */
+        virtual void updateForces(RigidBody **bodies, unsigned count,
+                                  real duration);
     };
 
     /**
@@ -101,6 +118,24 @@ namespace cyclone {
      * This force generator is intended to represent a single
      * explosion effect for multiple rigid bodies. The force generator
      * can also act as a particle force generator.
+     *
+     * The explosion runs in three phases, timed from detonation. At
+     * first objects around it are sucked in (the implosion). Then a
+     * shock wave travels outwards, pushing objects it passes (the
+     * concussion). Meanwhile a chimney of hot air rises above the
+     * detonation, lifting objects inside it (the convection).
+     *
+     * Rather than being registered with every body, an explosion can
+     * be given the broad phase holding the bodies' collision
+     * primitives, and added to the World. Each frame it then asks the
+     * broad phase for just the bodies near the regions currently
+     * active, and it is removed from the world once all three phases
+     * are over.
+     *
+     * It can also be registered with bodies or particles in force
+     * registries as normal. Applying the force never moves the
+     * explosion on in time, however many registries it is in, so the
+     * application must then call advance once per frame.
      */
     class Explosion : public ForceGenerator,
                       public ParticleForceGenerator
@@ -207,24 +242,99 @@ namespace cyclone {
           */
          real convectionDuration;
 
+    protected:
+        /**
+         * Holds the broad phase holding the bodies the explosion can
+         * affect.
+         */
+        BroadPhase *broadPhase;
+
+        /**
+         * Holds the primitives the broad phase finds near the active
+         * regions this step.
+         */
+        std::vector<CollisionPrimitive*> nearbyPrimitives;
+
+        /**
+         * Holds the bodies found to be in the active regions this
+         * step.
+         */
+        std::vector<RigidBody*> affectedBodies;
+
+        /**
+         * Returns the distance from the detonation that the active
+         * regions reach to at the current time.
+         */
+        real getActiveRadius() const;
+
+        /**
+         * Checks if a sphere with the given distance from the
+         * detonation and radius reaches into the active regions.
+         */
+        bool reachesActiveRegion(real distance, real radius) const;
+
     public:
         /**
          * Creates a new explosion with sensible default values.
          */
         Explosion();
 
+        /**
+         * Returns the force the explosion has at the current time on
+         * an object at the given position, moving with the given
+         * velocity.
+         */
+        Vector3 getForce(const Vector3 &position,
+                         const Vector3 &velocity) const;
+
         /**
          * Calculates and applies the force that the explosion
-         * has on the given rigid body.
+         * has on the given rigid body, at the current time.
          */
         virtual void updateForce(RigidBody * body, real duration);
 
         /**
          * Calculates and applies the force that the explosion has
-         * on the given particle.
+         * on the given particle, at the current time.
+         */
+        virtual void updateForce(Particle *particle, real duration);
+
+        /**
+         * Sets the broad phase holding the bodies the explosion can
+         * affect. Only its kinematic and dynamic primitives are
+         * looked at, and their internals must be up to date.
          */
-        virtual void updateForce(Particle *particle, real duration) = 0;
+        void setBroadPhase(BroadPhase *broadPhase);
 
+        /**
+         * Applies the force to the dynamic bodies in the broad phase
+         * that are in one of the regions currently active, then moves
+         * the explosion on in time by the given duration.
+         */
+        void apply(real duration);
+
+        /**
+         * Moves the explosion on in time by the given duration. Call
+         * this once per frame when the explosion is registered with
+         * force registries rather than applied with apply.
+         */
+        void advance(real duration);
+
+        /**
+         * Returns the time since detonation.
+         */
+        real getTimePassed() const;
+
+        /**
+         * Sets the time back to the moment of detonation, so the
+         * explosion can be used again.
+         */
+        void reset();
+
+        /**
+         * Checks if all the phases of the explosion are over.
+         */
+        bool isFinished() const;
     };
 
     /**
@@ -370,6 +480,132 @@ namespace cyclone {
         virtual void updateForce(RigidBody *body, real duration);
     };
 
+    /**
+     * A force generator holding all the aerodynamic surfaces of one
+     * body, such as the wings, tail and control surfaces of an
+     * aircraft. It does the work of an Aero, AeroControl or AngledAero
+     * for each, but as a single registration.
+     *
+     * The force from each surface is its tensor times the air
+     * velocity in body space, so the assembly sums its surfaces'
+     * tensors, and their tensors for torque about the centre of mass,
+     * whenever a control or surface orientation changes. Each update
+     * then transforms the air velocity into body space once, and
+     * applies one summed force and torque, however many surfaces
+     * there are.
+     */
+    class AeroAssembly : public ForceGenerator
+    {
+    protected:
+        /**
+         * Holds the tensor of each surface with its control at rest.
+         */
+        std::vector<Matrix3> tensors;
+
+        /**
+         * Holds the tensor of each surface with its control at its
+         * minimum and maximum. These are the same as the resting
+         * tensor for fixed surfaces.
+         */
+        std::vector<Matrix3> minTensors, maxTensors;
+
+        /**
+         * Holds the orientation of each surface relative to the body.
+         */
+        std::vector<Quaternion> orientations;
+
+        /**
+         * Holds the position of each surface in body coordinates.
+         */
+        std::vector<Vector3> positions;
+
+        /**
+         * Holds the control setting of each surface, from -1 to +1.
+         */
+        std::vector<real> controls;
+
+        /**
+         * Holds a pointer to the windspeed of the environment, as for
+         * Aero.
+         */
+        const Vector3 *windspeed;
+
+        /**
+         * Holds the sum of the surface tensors, giving the force in
+         * body space.
+         */
+        Matrix3 forceTensor;
+
+        /**
+         * Holds the sum of the tensors giving each surface's torque
+         * about the centre of mass in body space.
+         */
+        Matrix3 torqueTensor;
+
+        /**
+         * True if the summed tensors are up to date.
+         */
+        bool summed;
+
+        /**
+         * Works out the summed tensors from the surfaces.
+         */
+        void sumTensors();
+
+    public:
+        /**
+         * Creates an assembly with no surfaces, in the given wind.
+         * The wind can be NULL for still air.
+         */
+        AeroAssembly(const Vector3 *windspeed);
+
+        /**
+         * Adds a fixed surface with the given tensor at the given
+         * position in body coordinates, returning its index.
+         */
+        unsigned addSurface(const Matrix3 &tensor, const Vector3 &position);
+
+        /**
+         * Adds a control surface, returning its index. The tensors are
+         * as for AeroControl.
+         */
+        unsigned addControlSurface(const Matrix3 &base, const Matrix3 &min,
+                                   const Matrix3 &max,
+                                   const Vector3 &position);
+
+        /**
+         * Returns the number of surfaces.
+         */
+        unsigned getSurfaceCount() const;
+
+        /**
+         * Sets the control setting of the given surface, as for
+         * AeroControl::setControl. This has no effect on fixed
+         * surfaces.
+         */
+        void setControl(unsigned surface, real value);
+
+        /**
+         * Sets the orientation of the given surface relative to the
+         * body, as for AngledAero::setOrientation.
+         */
+        void setOrientation(unsigned surface, const Quaternion &quat);
+
+        /**
+         * Calculates the total force and torque (about the centre of
+         * mass) of all the surfaces on the given body, in world
+         * coordinates.
+         */
+        void getForceAndTorque(const RigidBody *body, Vector3 *force,
+                               Vector3 *torque);
+
+        /**
+         * Applies the force and torque of all the surfaces to the
+         * given rigid body.
+         */
+        virtual void updateForce(RigidBody *body, real duration);
+    };
+
     /**
      * A force generator to apply a buoyant force to a rigid body.
      */
@@ -414,6 +650,84 @@ namespace cyclone {
          * Applies the force to the given rigid body.
          */
         virtual void updateForce(RigidBody *body, real duration);
+
+        /**
+         * Applies the force to the given rigid bodies.
+         */
+        virtual void updateForces(RigidBody **bodies, unsigned count,
+                                  real duration);
+    };
+
+    /**
+     * A set of springs, each joining points on two rigid bodies. Each
+     * spring's force is worked out once and applied to both bodies,
+     * equal and opposite, where a Spring needs registering with each
+     * body and works the force out twice. The springs are held in
+     * flat arrays, so large spring networks are walked in a single
+     * pass.
+     *
+     * The springs follow Hooke's law in both directions: a compressed
+     * spring pushes its ends apart. They can also be damped, resisting
+     * their ends moving together or apart.
+     *
+     * A set is added to a ForceRegistry to be applied with the force
+     * generators.
+     */
+    class SpringSet
+    {
+    protected:
+        /**
+         * Holds the bodies joined by each spring, two per spring.
+         */
+        std::vector<RigidBody*> ends;
+
+        /**
+         * Holds the point each spring is connected to on each body,
+         * in that body's local coordinates, two per spring.
+         */
+        std::vector<Vector3> connectionPoints;
+
+        /**
+         * Holds the rest length of each spring.
+         */
+        std::vector<real> restLengths;
+
+        /**
+         * Holds the spring constant of each spring.
+         */
+        std::vector<real> springConstants;
+
+        /**
+         * Holds the damping of each spring, as a force per unit of
+         * closing speed.
+         */
+        std::vector<real> dampings;
+
+    public:
+        /**
+         * Adds a spring between the given points on the given bodies,
+         * returning its index. The points are in each body's local
+         * coordinates.
+         */
+        unsigned addSpring(RigidBody *first, const Vector3 &firstPoint,
+                           RigidBody *second, const Vector3 &secondPoint,
+                           real springConstant, real restLength,
+                           real damping = 0);
+
+        /**
+         * Returns the number of springs.
+         */
+        unsigned getSpringCount() const;
+
+        /**
+         * Removes all the springs.
+         */
+        void clear();
+
+        /**
+         * Applies the force of every spring to both its bodies.
+         */
+        void updateForces(real duration);
     };
 
     /**
@@ -424,27 +738,70 @@ namespace cyclone {
     protected:
 
         /**
-        * Keeps track of one force generator and the body it
-        * applies to.
+        * Holds a group of registrations that share a force generator,
+        * with their bodies packed together.
         */
-        struct ForceRegistration
+        struct ForceBatch
         {
-            RigidBody *body;
             ForceGenerator *fg;
+
+            /** Holds the bodies the generator applies to. */
+            std::vector<RigidBody*> bodies;
+
+            /** Holds the handle of each registration. */
+            std::vector<Handle> handles;
+        };
+
+        /**
+        * Holds the registrations grouped by force generator, in the
+        * order each generator was first registered.
+        */
+        std::vector<ForceBatch> batches;
+
+        /**
+        * Holds the index of each force generator's batch.
+        */
+        std::map<ForceGenerator*, unsigned> batchIndices;
+
+        /**
+        * Keeps track of where one registration's body is held.
+        */
+        struct ForceRegistration
+        {
+            unsigned batch;
+            unsigned position;
         };
 
         /**
-        * Holds the list of registrations.
+        * Holds the registrations.
         */
-        typedef std::vector<ForceRegistration> Registry;
-        Registry registrations;
+        SlotMap<ForceRegistration> registrations;
+
+        /**
+        * Holds the spring sets.
+        */
+        std::vector<SpringSet*> springSets;
 
     public:
         /**
         * Registers the given force generator to apply to the
-        * given body.
+        * given body, returning a handle for the registration.
         */
-        void add(RigidBody* body, ForceGenerator *fg);
+        Handle add(RigidBody* body, ForceGenerator *fg);
+
+        /**
+        * Registers the given force generator to apply to each of the
+        * given bodies. If handles is not NULL, it is filled in
+        * with the handles of the registrations.
+        */
+        void add(RigidBody **bodies, unsigned count, ForceGenerator *fg,
+                 Handle *handles = NULL);
+
+        /**
+        * Removes the registration with the given handle, returning
+        * false if the handle is stale. This takes constant time.
+        */
+        bool remove(const Handle &handle);
 
         /**
         * Removes the given registered pair from the registry.
@@ -454,15 +811,29 @@ namespace cyclone {
         void remove(RigidBody* body, ForceGenerator *fg);
 
         /**
-        * Clears all registrations from the registry. This will
-        * not delete the bodies or the force generators
-        * themselves, just the records of their connection.
+        * Registers the given spring set, to be applied along with
+        * the force generators.
+        */
+        void add(SpringSet *springs);
+
+        /**
+        * Removes the given spring set from the registry, if it is
+        * registered.
+        */
+        void remove(SpringSet *springs);
+
+        /**
+        * Clears all registrations from the registry, including the
+        * spring sets. This will not delete the bodies or the force
+        * generators themselves, just the records of their connection.
         */
         void clear();
 
         /**
         * Calls all the force generators to update the forces of
-        * their corresponding bodies.
+        * their corresponding bodies. Each generator is called
+        * once, with all its bodies together. The spring sets are
+        * then applied.
         */
         void updateForces(real duration);
     };
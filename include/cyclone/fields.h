@@ -0,0 +1,252 @@
+/*
+ * Interface file for world force fields.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains the definitions for force fields: forces such as
+ * gravity and wind that act on everything in a world, rather than
+ * being registered with each body in turn.
+ */
+#ifndef CYCLONE_FIELDS_H
+#define CYCLONE_FIELDS_H
+
+#include <vector>
+#include "body.h"
+#include "particle.h"
+
+namespace cyclone {
+
+    /**
+     * Holds a set of force fields that act on every body (or
+     * particle) in a world. The worlds apply their fields as they
+     * integrate each body, so gravity, wind and the like need no
+     * force generator registrations at all, however many bodies there
+     * are.
+     *
+     * The fields are held as plain data and evaluated together, and
+     * act through the centre of mass, so they never apply torque.
+     * Bodies with infinite mass are left alone. Positions are given
+     * in the same coordinates as the bodies' positions.
+     */
+    class ForceFields
+    {
+    public:
+        /**
+         * The kinds of force field.
+         */
+        enum FieldType
+        {
+            /** A constant acceleration, such as gravity. */
+            UNIFORM,
+
+            /**
+             * Moving air, which pulls bodies towards its velocity
+             * with a force proportional to their velocity relative to
+             * it. Still air gives global drag.
+             */
+            WIND,
+
+            /**
+             * An acceleration away from a point, falling off linearly
+             * to nothing at the field's radius. A negative strength
+             * pulls towards the point.
+             */
+            RADIAL,
+
+            /**
+             * An acceleration around an axis through a point, falling
+             * off linearly with distance from the axis to nothing at
+             * the field's radius.
+             */
+            VORTEX,
+
+            /**
+             * Wind whose velocity is sampled from a regular grid,
+             * interpolated between the grid points. Bodies outside
+             * the grid are unaffected.
+             */
+            WIND_GRID
+        };
+
+    protected:
+        /**
+         * Holds the data for one field. Only the members used by its
+         * type are meaningful.
+         */
+        struct Field
+        {
+            FieldType type;
+
+            /**
+             * Holds the acceleration (UNIFORM), the wind velocity
+             * (WIND) or the axis (VORTEX).
+             */
+            Vector3 vector;
+
+            /**
+             * Holds the centre (RADIAL and VORTEX) or the corner with
+             * the lowest coordinates (WIND_GRID).
+             */
+            Vector3 centre;
+
+            /**
+             * Holds the acceleration at the centre (RADIAL and
+             * VORTEX) or the force per unit of relative velocity
+             * (WIND and WIND_GRID).
+             */
+            real strength;
+
+            /**
+             * Holds the radius (RADIAL and VORTEX) or the spacing of
+             * the grid points (WIND_GRID).
+             */
+            real radius;
+
+            /**
+             * Holds the number of grid points along each axis, and
+             * the index of the first in gridVelocities (WIND_GRID).
+             */
+            unsigned gridSize[3];
+            unsigned gridStart;
+        };
+
+        /**
+         * Holds the fields.
+         */
+        std::vector<Field> fields;
+
+        /**
+         * Holds the wind velocity at the grid points of every grid
+         * field, x varying fastest.
+         */
+        std::vector<Vector3> gridVelocities;
+
+        /**
+         * Adds a field of the given type with the given data,
+         * returning its index.
+         */
+        unsigned addField(FieldType type, const Vector3 &vector,
+                          const Vector3 &centre, real strength,
+                          real radius);
+
+        /**
+         * Returns the wind velocity of the given grid field at the
+         * given position, interpolated between the grid points. Returns
+         * false if the position is outside the grid.
+         */
+        bool sampleGrid(const Field &field, const Vector3 &position,
+                        Vector3 *velocity) const;
+
+    public:
+        /**
+         * Adds a uniform acceleration, such as gravity, returning the
+         * field's index.
+         */
+        unsigned addUniform(const Vector3 &acceleration);
+
+        /**
+         * Adds wind with the given velocity, returning the field's
+         * index. Each body feels a force of the given coefficient
+         * times its velocity relative to the wind. Wind with zero
+         * velocity is global linear drag.
+         */
+        unsigned addWind(const Vector3 &windVelocity, real coefficient);
+
+        /**
+         * Adds an acceleration away from the given point, returning
+         * the field's index. The acceleration is the given strength at
+         * the point, falling off linearly to zero at the given radius.
+         * A negative strength pulls towards the point.
+         */
+        unsigned addRadial(const Vector3 &centre, real strength,
+                           real radius);
+
+        /**
+         * Adds an acceleration around the given axis through the given
+         * point, returning the field's index. The acceleration is
+         * anticlockwise looking down the axis, and is the given
+         * strength at the axis, falling off linearly to zero at the
+         * given distance from it.
+         */
+        unsigned addVortex(const Vector3 &centre, const Vector3 &axis,
+                           real strength, real radius);
+
+        /**
+         * Adds wind sampled from a grid, returning the field's index.
+         * The grid has the given number of points along each axis,
+         * spaced the given distance apart, starting from the given
+         * corner. The wind velocities start at zero, and are set with
+         * setGridVelocity. The coefficient is as for addWind.
+         */
+        unsigned addWindGrid(const Vector3 &corner, real spacing,
+                             unsigned xPoints, unsigned yPoints,
+                             unsigned zPoints, real coefficient);
+
+        /**
+         * Sets the wind velocity at the given point of the given grid
+         * field.
+         */
+        void setGridVelocity(unsigned field, unsigned x, unsigned y,
+                             unsigned z, const Vector3 &velocity);
+
+        /**
+         * Sets the acceleration of a uniform field, the velocity of a
+         * wind field or the axis of a vortex.
+         */
+        void setVector(unsigned field, const Vector3 &vector);
+
+        /**
+         * Sets the strength of the given field, or its coefficient for
+         * wind.
+         */
+        void setStrength(unsigned field, real strength);
+
+        /**
+         * Returns the number of fields.
+         */
+        unsigned getFieldCount() const;
+
+        /**
+         * Removes all the fields.
+         */
+        void clear();
+
+        /**
+         * Moves every field by the opposite of the given offset, for
+         * use when the world's origin is moved by it.
+         */
+        void shiftOrigin(const Vector3 &offset);
+
+        /**
+         * Returns the acceleration the fields give an object with the
+         * given position, velocity and inverse mass.
+         */
+        Vector3 getAcceleration(const Vector3 &position,
+                                const Vector3 &velocity,
+                                real inverseMass) const;
+
+        /**
+         * Adds the force of the fields to the given particle.
+         */
+        void applyTo(Particle *particle) const;
+
+        /**
+         * Adds the force of the fields to the given rigid body, at its
+         * centre of mass.
+         */
+        void applyTo(RigidBody *body) const;
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_FIELDS_H
@@ -0,0 +1,139 @@
+/*
+ * Interface file for the particle integrators.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains the integration schemes a particle world can be
+ * built with. Each is a policy class with an integrate method that
+ * moves a set of particles forward in time, evaluating the force
+ * generators in the registry as often as the scheme needs.
+ */
+#ifndef CYCLONE_INTEGRATORS_H
+#define CYCLONE_INTEGRATORS_H
+
+#include <vector>
+#include "pfgen.h"
+
+namespace cyclone {
+
+    /**
+     * Integrates particles with the symplectic (semi-implicit) Euler
+     * method: the velocity is updated from the forces, and the
+     * position from the new velocity. This evaluates the forces once
+     * per step, like Particle::integrate (which moves the particle
+     * with its old velocity), but oscillations keep their energy
+     * rather than growing. It is the cheapest scheme, but it needs
+     * the smallest time steps for stiff springs.
+     */
+    class SymplecticEuler
+    {
+    public:
+        /**
+         * Applies the force generators and integrates the given
+         * particles forward in time by the given duration.
+         */
+        void integrate(std::vector<Particle*> &particles,
+                       ParticleForceRegistry &registry, real duration);
+    };
+
+    /**
+     * Integrates particles with the velocity Verlet method. The
+     * particles are moved with their velocity and half their
+     * acceleration, then the forces are evaluated again at the new
+     * positions and the velocity is updated with the average of the
+     * two accelerations. This costs two force evaluations per step
+     * and is second order accurate, so orbits and oscillations keep
+     * their energy much better than with Euler.
+     *
+     * Forces added to the particles before the step are taken to be
+     * constant over it, and are applied at both evaluations.
+     */
+    class VelocityVerlet
+    {
+    protected:
+        /**
+         * Holds the force added to each particle before the step.
+         */
+        std::vector<Vector3> appliedForces;
+
+        /**
+         * Holds the acceleration of each particle at the start of
+         * the step.
+         */
+        std::vector<Vector3> startAccelerations;
+
+    public:
+        /**
+         * Applies the force generators and integrates the given
+         * particles forward in time by the given duration.
+         */
+        void integrate(std::vector<Particle*> &particles,
+                       ParticleForceRegistry &registry, real duration);
+    };
+
+    /**
+     * Integrates particles with the classical fourth order Runge-Kutta
+     * method. The forces are evaluated four times per step, at the
+     * start, twice at the midpoint and at the end, and the results
+     * are blended. This is the most accurate and the most expensive
+     * scheme, and suits stiff or fast moving systems that would
+     * otherwise need a much shorter time step.
+     *
+     * Forces added to the particles before the step are taken to be
+     * constant over it, and are applied at every evaluation.
+     */
+    class RungeKutta4
+    {
+    protected:
+        /**
+         * Holds the force added to each particle before the step.
+         */
+        std::vector<Vector3> appliedForces;
+
+        /**
+         * Holds the position and velocity of each particle at the
+         * start of the step.
+         */
+        std::vector<Vector3> startPositions, startVelocities;
+
+        /**
+         * Holds the weighted sums of the velocities and accelerations
+         * found at each evaluation.
+         */
+        std::vector<Vector3> velocitySums, accelerationSums;
+
+        /**
+         * Holds the velocity and acceleration of each particle found
+         * at the last evaluation.
+         */
+        std::vector<Vector3> velocities, accelerations;
+
+        /**
+         * Applies the forces to the particles in their current state,
+         * and fills in their velocities and accelerations.
+         */
+        void evaluate(std::vector<Particle*> &particles,
+                      ParticleForceRegistry &registry, real duration);
+
+    public:
+        /**
+         * Applies the force generators and integrates the given
+         * particles forward in time by the given duration.
+         */
+        void integrate(std::vector<Particle*> &particles,
+                       ParticleForceRegistry &registry, real duration);
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_INTEGRATORS_H
@@ -91,6 +91,380 @@ namespace cyclone {
         unsigned addContact( Contact *contact, unsigned limit ) const;
     };
 
+    /**
+     * Holds a single row of a constraint: one direction in which the
+     * constraint controls the relative velocity of its two bodies.
+     * Rows can combine linear and angular velocity, so the same row
+     * can keep two points together or two axes lined up.
+     */
+    struct ConstraintRow
+    {
+        /**
+         * Holds the linear part of the row, in world coordinates.
+         */
+        Vector3 linear;
+
+        /**
+         * Holds the angular part of the row for each body, in world
+         * coordinates.
+         */
+        Vector3 angular[2];
+
+        /**
+         * Holds the change in rotation of each body per unit of
+         * impulse along the row.
+         */
+        Vector3 angularPerUnitImpulse[2];
+
+        /**
+         * Holds the impulse needed to change the relative velocity
+         * along the row by one unit.
+         */
+        real effectiveMass;
+
+        /**
+         * Holds the relative velocity along the row that the solver
+         * is aiming for. This includes the correction of any error
+         * in position.
+         */
+        real targetVelocity;
+
+        /**
+         * Holds the smallest total impulse the row may apply.
+         */
+        real lowerLimit;
+
+        /**
+         * Holds the largest total impulse the row may apply.
+         */
+        real upperLimit;
+
+        /**
+         * Holds the total impulse applied along the row. This is kept
+         * from one frame to the next, and used to warm start the
+         * solver.
+         */
+        real_accum impulse;
+    };
+
+    /**
+     * A constraint is a joint solved as part of the velocity
+     * resolution of the contact resolver, rather than by generating
+     * contacts. Each type of constraint describes itself as a set of
+     * rows, whose impulses are solved together with the contacts
+     * each iteration. Because impulses are remembered from one frame
+     * to the next, chains of constraints settle in a few iterations.
+     *
+     * The second body may be NULL, in which case its connection
+     * point (and any axes) are given in world coordinates.
+     *
+     * Constraints are passed to the contact resolver with
+     * ContactResolver::setConstraints.
+     */
+    class Constraint
+    {
+        /**
+         * The contact resolver solves the constraint's rows.
+         */
+        friend class ContactResolver;
+
+    public:
+        /**
+         * Holds the two rigid bodies that are connected by this
+         * constraint.
+         */
+        RigidBody* body[2];
+
+        /**
+         * Holds the relative location of the connection for each
+         * body, given in local coordinates.
+         */
+        Vector3 position[2];
+
+        /**
+         * Holds the proportion of the constraint's positional error
+         * that is corrected each frame. Defaults to 0.2.
+         */
+        real errorReduction;
+
+        /**
+         * Holds the proportion of last frame's impulses that are
+         * applied again before the solver starts. Defaults to 1.
+         */
+        real warmStarting;
+
+        Constraint();
+
+        virtual ~Constraint();
+
+        /**
+         * Sets the bodies and connection points of the constraint.
+         */
+        void set(
+            RigidBody *a, const Vector3& a_pos,
+            RigidBody *b, const Vector3& b_pos
+            );
+
+    protected:
+        /**
+         * The most rows any constraint can have.
+         */
+        static const unsigned MAX_ROWS = 6;
+
+        /**
+         * Holds the rows of the constraint.
+         */
+        ConstraintRow rows[MAX_ROWS];
+
+        /**
+         * Holds the number of rows in use this frame.
+         */
+        unsigned rowCount;
+
+        /**
+         * Holds the index of each body in the resolver's list of
+         * dynamic bodies, or ContactResolver::NO_BODY.
+         */
+        unsigned bodyIndex[2];
+
+        /**
+         * Fills in the rows for the current state of the bodies.
+         * Rows should keep their meaning from frame to frame, so that
+         * their impulses can be reused; a row that has changed
+         * meaning should have its impulse reset to zero.
+         */
+        virtual void calculateRows(real duration) = 0;
+
+        /**
+         * Returns the world position of the given body's connection
+         * point.
+         */
+        Vector3 getWorldAnchor(unsigned i) const;
+
+        /**
+         * Converts a direction on the given body into world
+         * coordinates.
+         */
+        Vector3 getWorldDirection(unsigned i, const Vector3 &direction) const;
+
+        /**
+         * Returns the orientation of the second body relative to the
+         * first. Constraints that lock the bodies' orientation store
+         * this when they are set.
+         */
+        Matrix3 calculateRelativeOrientation() const;
+
+        /**
+         * Returns the rotation (as a small angle vector, in world
+         * coordinates) that the first body has turned away from the
+         * given relative orientation.
+         */
+        Vector3 calculateOrientationError(const Matrix3 &reference) const;
+
+        /**
+         * Sets the given row to stop the connection points moving
+         * apart along the given direction. The error is the current
+         * separation along that direction.
+         */
+        void setLinearRow(unsigned row, const Vector3 &direction,
+                          real error, real duration);
+
+        /**
+         * Sets the given row to stop the bodies turning relative to
+         * one another about the given axis. The error is the angle
+         * they have already turned.
+         */
+        void setAngularRow(unsigned row, const Vector3 &axis,
+                           real error, real duration);
+
+        /**
+         * Sets the rows that lock the bodies' relative orientation,
+         * starting at the given row.
+         */
+        void setOrientationRows(unsigned row, const Matrix3 &reference,
+                                real duration);
+
+        /**
+         * Calculates the effective mass of each row and applies the
+         * impulses remembered from last frame.
+         */
+        void prepare(real duration);
+
+        /**
+         * Applies the impulse along each row needed to reach its
+         * target velocity. Returns true if any velocity changed by
+         * more than the given epsilon.
+         */
+        bool solve(real velocityEpsilon);
+
+        /**
+         * Applies the given impulse along the given row.
+         */
+        void applyImpulse(const ConstraintRow &row, real impulse);
+    };
+
+    /**
+     * A ball and socket joint keeps a point on each body together,
+     * leaving the bodies free to turn.
+     */
+    class BallJoint : public Constraint
+    {
+    protected:
+        virtual void calculateRows(real duration);
+    };
+
+    /**
+     * A hinge joint keeps a point on each body together, and an axis
+     * on each body lined up, so the bodies can only turn about that
+     * axis. The angle of the hinge can optionally be limited.
+     */
+    class HingeJoint : public Constraint
+    {
+    public:
+        /**
+         * Holds the axis of the hinge on each body, in local
+         * coordinates.
+         */
+        Vector3 axis[2];
+
+        HingeJoint();
+
+        /**
+         * Configures the joint in one go.
+         */
+        void set(
+            RigidBody *a, const Vector3& a_pos, const Vector3& a_axis,
+            RigidBody *b, const Vector3& b_pos, const Vector3& b_axis
+            );
+
+        /**
+         * Limits the angle of the hinge to the given range, in
+         * radians. The angle is measured from the bodies' orientation
+         * at the time the limits are set.
+         */
+        void setLimits(real lower, real upper);
+
+        /**
+         * Removes the limits on the hinge's angle.
+         */
+        void clearLimits();
+
+    protected:
+        /**
+         * Holds true if the angle of the hinge is limited.
+         */
+        bool limited;
+
+        /**
+         * Holds the range the hinge's angle is limited to.
+         */
+        real lowerAngle, upperAngle;
+
+        /**
+         * Holds a direction at right angles to the hinge on each
+         * body, used to measure the angle of the hinge.
+         */
+        Vector3 reference[2];
+
+        /**
+         * Holds -1 or 1 if the lower or upper limit was being enforced
+         * last frame, and 0 otherwise.
+         */
+        int limitState;
+
+        virtual void calculateRows(real duration);
+    };
+
+    /**
+     * A slider joint stops the bodies turning relative to one
+     * another, and only lets them move along a single axis. The
+     * distance they can slide can optionally be limited.
+     */
+    class SliderJoint : public Constraint
+    {
+    public:
+        /**
+         * Holds the direction of the slide in the first body's local
+         * coordinates.
+         */
+        Vector3 axis;
+
+        SliderJoint();
+
+        /**
+         * Configures the joint in one go. The bodies' current relative
+         * orientation is kept.
+         */
+        void set(
+            RigidBody *a, const Vector3& a_pos,
+            RigidBody *b, const Vector3& b_pos,
+            const Vector3& axis
+            );
+
+        /**
+         * Limits the distance the first body's connection point can
+         * slide from the second's along the axis.
+         */
+        void setLimits(real lower, real upper);
+
+        /**
+         * Removes the limits on the slide.
+         */
+        void clearLimits();
+
+    protected:
+        /**
+         * Holds the relative orientation of the bodies when the joint
+         * was set.
+         */
+        Matrix3 referenceOrientation;
+
+        /**
+         * Holds true if the slide is limited.
+         */
+        bool limited;
+
+        /**
+         * Holds the range of the slide.
+         */
+        real lowerDistance, upperDistance;
+
+        /**
+         * Holds -1 or 1 if the lower or upper limit was being enforced
+         * last frame, and 0 otherwise.
+         */
+        int limitState;
+
+        virtual void calculateRows(real duration);
+    };
+
+    /**
+     * A fixed joint welds two bodies together, keeping their
+     * connection points together and their relative orientation as
+     * it was when the joint was set.
+     */
+    class FixedJoint : public Constraint
+    {
+    public:
+        /**
+         * Configures the joint in one go. The bodies' current relative
+         * orientation is kept.
+         */
+        void set(
+            RigidBody *a, const Vector3& a_pos,
+            RigidBody *b, const Vector3& b_pos
+            );
+
+    protected:
+        /**
+         * Holds the relative orientation of the bodies when the joint
+         * was set.
+         */
+        Matrix3 referenceOrientation;
+
+        virtual void calculateRows(real duration);
+    };
+
 } // namespace cyclone
 
 #endif // CYCLONE_JOINTS_H
\ No newline at end of file
@@ -35,6 +35,15 @@ namespace cyclone {
      */
     class Particle
     {
+        /**
+         * The built in force generators apply their forces to whole
+         * batches of particles, directly on the particle data.
+         */
+        friend class ParticleGravity;
+        friend class ParticleDrag;
+        friend class ParticleBuoyancy;
+        friend class ParticleSpringSet;
+
     public:
 
         // ... Other Particle code as before ...
@@ -92,6 +101,19 @@ namespace cyclone {
          */
         real damping;
 
+        /**
+         * Holds the proportion of velocity kept over dragDuration,
+         * so the damping only needs to be raised to a power when the
+         * time step or the damping changes.
+         */
+        real drag;
+
+        /**
+         * Holds the duration drag was calculated for, or zero if it
+         * needs calculating.
+         */
+        real dragDuration;
+
         /**
          * Holds the linear position of the particle in
          * world space.
@@ -140,6 +162,13 @@ namespace cyclone {
          * automatically.
          */
         /*@{*/
+
+        /**
+         * Creates a new particle. Its mass, damping and state should
+         * be set before it is simulated.
+         */
+        Particle();
+
         /*@}*/
 
         /**
@@ -164,6 +193,15 @@ namespace cyclone {
          */
         void integrate(real duration);
 
+        /**
+         * Moves the particle forward in time by the given amount for
+         * position based simulation: the velocity is updated first
+         * and then used to move the particle. Unlike integrate, the
+         * force accumulator is left alone, so the same forces can be
+         * used for several substeps.
+         */
+        void predictPosition(real duration);
+
         /*@}*/
 
 
@@ -232,6 +270,13 @@ namespace cyclone {
          */
         real getDamping() const;
 
+        /**
+         * Returns the proportion of velocity the damping keeps over
+         * the given duration. This is cached, so it is only worked
+         * out again when the duration or the damping changes.
+         */
+        real getDrag(real duration);
+
         /**
          * Sets the position of the particle.
          *
@@ -366,6 +411,11 @@ namespace cyclone {
          */
         void addForce(const Vector3 &force);
 
+        /**
+         * Returns the force accumulated for the next iteration.
+         */
+        Vector3 getAccumulatedForce() const;
+
 
     };
 }
@@ -24,6 +24,7 @@
 #ifndef CYCLONE_PCONTACTS_H
 #define CYCLONE_PCONTACTS_H
 
+#include <vector>
 #include "particle.h"
 
 namespace cyclone {
@@ -55,6 +56,12 @@ namespace cyclone {
          */
         friend class ParticleContactResolver;
 
+        /**
+         * The particle world projects contacts directly when it is
+         * running position based simulation.
+         */
+        friend class ParticleWorld;
+
 
     public:
         /**
@@ -85,6 +92,14 @@ namespace cyclone {
         Vector3 particleMovement[2];
 
     protected:
+        /**
+         * Holds the index of each particle in the resolver's list of
+         * particles, or ParticleContactResolver::NO_PARTICLE if there
+         * is no second particle. This is only filled in by the Jacobi
+         * resolver.
+         */
+        unsigned particleIndex[2];
+
         /**
          * Resolves this contact, for both velocity and interpenetration.
          */
@@ -101,6 +116,13 @@ namespace cyclone {
          */
         void resolveVelocity(real duration);
 
+        /**
+         * Calculates the separating velocity the contact should have
+         * once resolved, given its current separating velocity.
+         */
+        real calculateTargetVelocity(real separatingVelocity,
+                                     real duration) const;
+
         /**
          * Handles the interpenetration resolution for this contact.
          */
@@ -114,6 +136,13 @@ namespace cyclone {
      */
     class ParticleContactResolver
     {
+    public:
+        /**
+         * Marks a missing second particle in a contact's particle
+         * indices.
+         */
+        static const unsigned NO_PARTICLE = 0xffffffff;
+
     protected:
         /**
          * Holds the number of iterations allowed.
@@ -126,6 +155,66 @@ namespace cyclone {
          */
         unsigned iterationsUsed;
 
+        /**
+         * True if contacts are resolved all at once (Jacobi style)
+         * rather than one at a time.
+         */
+        bool jacobi;
+
+        /**
+         * Holds the number of sweeps over all the contacts made in
+         * Jacobi mode, for each of velocity and interpenetration.
+         */
+        unsigned sweeps;
+
+        /**
+         * Holds the number of threads to use in Jacobi mode.
+         */
+        unsigned threads;
+
+        /**
+         * Holds the particles involved in the current contacts,
+         * sorted by address.
+         */
+        std::vector<Particle*> particles;
+
+        /**
+         * Holds where each particle's entries start in the adjacency
+         * list, with one extra entry marking the end of the last.
+         */
+        std::vector<unsigned> adjacencyStarts;
+
+        /**
+         * Holds the contacts touching each particle. Each entry is
+         * twice the contact index, plus one if the particle is the
+         * second in the contact.
+         */
+        std::vector<unsigned> adjacency;
+
+        /**
+         * Holds the change each contact wants to make to each of its
+         * particles in the current sweep, indexed as the adjacency
+         * entries are.
+         */
+        std::vector<Vector3> contactChanges;
+
+        /**
+         * Holds whether each contact wants a change in the current
+         * sweep.
+         */
+        std::vector<unsigned char> contactActive;
+
+        /**
+         * Holds the target separating velocity of each contact.
+         */
+        std::vector<real> targetVelocities;
+
+        /**
+         * Holds the total movement of each particle during
+         * interpenetration resolution.
+         */
+        std::vector<Vector3> particleMovements;
+
     public:
         /**
          * Creates a new contact resolver.
@@ -137,6 +226,27 @@ namespace cyclone {
          */
         void setIterations(unsigned iterations);
 
+        /**
+         * Sets whether contacts are resolved Jacobi style. In this
+         * mode every contact works out its correction from the same
+         * state, the corrections to each particle are averaged, and
+         * all particles are updated at once. This is repeated for
+         * the given number of sweeps (the iteration count isn't
+         * used), first for velocity then for interpenetration. Each
+         * sweep costs time in proportion to the number of contacts,
+         * and is split over the given number of threads.
+         */
+        void setJacobi(bool jacobi, unsigned sweeps = 16,
+                       unsigned threads = 1);
+
+        /**
+         * Returns true if contacts are resolved Jacobi style.
+         */
+        bool isJacobi() const
+        {
+            return jacobi;
+        }
+
         /**
          * Resolves a set of particle contacts for both penetration
          * and velocity.
@@ -169,6 +279,28 @@ namespace cyclone {
         void resolveContacts(ParticleContact *contactArray,
             unsigned numContacts,
             real duration);
+
+    protected:
+        /**
+         * Resolves a set of contacts Jacobi style.
+         */
+        void resolveContactsJacobi(ParticleContact *contactArray,
+            unsigned numContacts,
+            real duration);
+
+        /**
+         * Fills in the particle list, the contacts' particle indices
+         * and the adjacency list for the given contacts.
+         */
+        void indexParticles(ParticleContact *contactArray,
+            unsigned numContacts);
+
+        /**
+         * Averages the changes from the active contacts on each
+         * particle, adding the result to each particle's velocity if
+         * velocity is true, or to its total movement otherwise.
+         */
+        void applyChanges(bool velocity);
     };
 
     /**
@@ -188,6 +320,27 @@ namespace cyclone {
          */
         virtual unsigned addContact(ParticleContact *contact,
                                     unsigned limit) const = 0;
+
+        /**
+         * Moves the particles directly to satisfy this generator's
+         * constraint, for position based simulation (see
+         * ParticleWorld::setPositionBased), and returns true. The
+         * duration is the length of the substep. Generators that
+         * return false (the default) are handled by projecting the
+         * contacts they generate instead.
+         */
+        virtual bool projectPositions(real /*duration*/)
+        {
+            return false;
+        }
+
+        /**
+         * Clears anything projectPositions has accumulated. This is
+         * called at the start of each substep.
+         */
+        virtual void resetProjection()
+        {
+        }
     };
 
 
@@ -21,6 +21,8 @@
 #include "core.h"
 #include "particle.h"
 #include <vector>
+#include <map>
+#include "slotmap.h"
 
 namespace cyclone {
 
@@ -37,6 +39,16 @@ namespace cyclone {
          * and update the force applied to the given particle.
          */
         virtual void updateForce(Particle *particle, real duration) = 0;
+
+        /**
+         * Updates the forces applied to each of the given particles.
+         * The registry calls this once per frame with every particle
+         * the generator is registered with. By default it calls
+         * updateForce for each; generators that apply the same force
+         * law to many particles can overload it with a tighter loop.
+         */
+        virtual void updateForces(Particle **particles, unsigned count,
+                                  real duration);
     };
 
     /**
@@ -55,6 +67,10 @@ namespace cyclone {
 
         /** Applies the gravitational force to the given particle. */
         virtual void updateForce(Particle *particle, real duration);
+
+        /** Applies the gravitational force to the given particles. */
+        virtual void updateForces(Particle **particles, unsigned count,
+                                  real duration);
     };
 
     /**
@@ -76,6 +92,10 @@ namespace cyclone {
 
         /** Applies the drag force to the given particle. */
         virtual void updateForce(Particle *particle, real duration);
+
+        /** Applies the drag force to the given particles. */
+        virtual void updateForces(Particle **particles, unsigned count,
+                                  real duration);
     };
 
     /**
@@ -239,6 +259,100 @@ namespace cyclone {
 
         /** Applies the buoyancy force to the given particle. */
         virtual void updateForce(Particle *particle, real duration);
+
+        /** Applies the buoyancy force to the given particles. */
+        virtual void updateForces(Particle **particles, unsigned count,
+                                  real duration);
+    };
+
+    /**
+     * A set of springs and bungees, each joining two particles. Each
+     * spring's force is worked out once and applied to both its ends,
+     * equal and opposite, where a ParticleSpring needs registering
+     * with each end and works the force out twice. The springs are
+     * held in flat arrays, so large spring networks are walked in a
+     * single pass.
+     *
+     * The springs follow Hooke's law in both directions: a compressed
+     * spring pushes its ends apart. Bungees only pull. Both can also
+     * be damped, resisting their ends moving together or apart.
+     *
+     * A set is added to a ParticleForceRegistry to be applied with
+     * the force generators.
+     */
+    class ParticleSpringSet
+    {
+    protected:
+        /**
+         * Holds the particles joined by each spring, two per spring.
+         */
+        std::vector<Particle*> ends;
+
+        /**
+         * Holds the rest length of each spring.
+         */
+        std::vector<real> restLengths;
+
+        /**
+         * Holds the spring constant of each spring.
+         */
+        std::vector<real> springConstants;
+
+        /**
+         * Holds the damping of each spring, as a force per unit of
+         * closing speed.
+         */
+        std::vector<real> dampings;
+
+        /**
+         * Holds whether each spring is a bungee.
+         */
+        std::vector<unsigned char> bungees;
+
+        /**
+         * Adds a spring of either kind.
+         */
+        unsigned add(Particle *first, Particle *second,
+                     real springConstant, real restLength,
+                     real damping, bool bungee);
+
+    public:
+        /**
+         * Adds a spring between the given particles, returning its
+         * index.
+         */
+        unsigned addSpring(Particle *first, Particle *second,
+                           real springConstant, real restLength,
+                           real damping = 0);
+
+        /**
+         * Adds a bungee between the given particles, returning its
+         * index. A bungee only pulls its ends together when it is
+         * longer than its rest length.
+         */
+        unsigned addBungee(Particle *first, Particle *second,
+                           real springConstant, real restLength,
+                           real damping = 0);
+
+        /**
+         * Returns the number of springs.
+         */
+        unsigned getSpringCount() const;
+
+        /**
+         * Returns the given end (0 or 1) of the given spring.
+         */
+        Particle* getSpringEnd(unsigned spring, unsigned end) const;
+
+        /**
+         * Removes all the springs.
+         */
+        void clear();
+
+        /**
+         * Applies the force of every spring to both its ends.
+         */
+        void updateForces(real duration);
     };
 
     /**
@@ -249,27 +363,70 @@ namespace cyclone {
     protected:
 
         /**
-         * Keeps track of one force generator and the particle it
-         * applies to.
+         * Holds a group of registrations that share a force generator,
+         * with their particles packed together.
          */
-        struct ParticleForceRegistration
+        struct ParticleForceBatch
         {
-            Particle *particle;
             ParticleForceGenerator *fg;
+
+            /** Holds the particles the generator applies to. */
+            std::vector<Particle*> particles;
+
+            /** Holds the handle of each registration. */
+            std::vector<Handle> handles;
+        };
+
+        /**
+         * Holds the registrations grouped by force generator, in the
+         * order each generator was first registered.
+         */
+        std::vector<ParticleForceBatch> batches;
+
+        /**
+         * Holds the index of each force generator's batch.
+         */
+        std::map<ParticleForceGenerator*, unsigned> batchIndices;
+
+        /**
+         * Keeps track of where one registration's particle is held.
+         */
+        struct ParticleForceRegistration
+        {
+            unsigned batch;
+            unsigned position;
         };
 
         /**
-         * Holds the list of registrations.
+         * Holds the registrations.
          */
-        typedef std::vector<ParticleForceRegistration> Registry;
-        Registry registrations;
+        SlotMap<ParticleForceRegistration> registrations;
+
+        /**
+         * Holds the spring sets.
+         */
+        std::vector<ParticleSpringSet*> springSets;
 
     public:
         /**
          * Registers the given force generator to apply to the
-         * given particle.
+         * given particle, returning a handle for the registration.
+         */
+        Handle add(Particle* particle, ParticleForceGenerator *fg);
+
+        /**
+         * Registers the given force generator to apply to each of the
+         * given particles. If handles is not NULL, it is filled in
+         * with the handles of the registrations.
          */
-        void add(Particle* particle, ParticleForceGenerator *fg);
+        void add(Particle **particles, unsigned count,
+                 ParticleForceGenerator *fg, Handle *handles = NULL);
+
+        /**
+         * Removes the registration with the given handle, returning
+         * false if the handle is stale. This takes constant time.
+         */
+        bool remove(const Handle &handle);
 
         /**
          * Removes the given registered pair from the registry.
@@ -279,15 +436,29 @@ namespace cyclone {
         void remove(Particle* particle, ParticleForceGenerator *fg);
 
         /**
-         * Clears all registrations from the registry. This will
-         * not delete the particles or the force generators
-         * themselves, just the records of their connection.
+         * Registers the given spring set, to be applied along with
+         * the force generators.
+         */
+        void add(ParticleSpringSet *springs);
+
+        /**
+         * Removes the given spring set from the registry, if it is
+         * registered.
+         */
+        void remove(ParticleSpringSet *springs);
+
+        /**
+         * Clears all registrations from the registry, including the
+         * spring sets. This will not delete the particles or the force
+         * generators themselves, just the records of their connection.
          */
         void clear();
 
         /**
          * Calls all the force generators to update the forces of
-         * their corresponding particles.
+         * their corresponding particles. Each generator is called
+         * once, with all its particles together. The spring sets are
+         * then applied.
          */
         void updateForces(real duration);
     };
@@ -19,6 +19,7 @@
 #ifndef CYCLONE_PLINKS_H
 #define CYCLONE_PLINKS_H
 
+#include <vector>
 #include "pcontacts.h"
 
 namespace cyclone {
@@ -37,13 +38,38 @@ namespace cyclone {
          */
         Particle* particle[2];
 
+        /**
+         * Holds the compliance (the inverse of the stiffness) of the
+         * link for position based simulation. Zero gives a rigid
+         * link; a rod with a compliance of one over a spring
+         * constant acts as that spring. The contact resolver always
+         * treats links as rigid.
+         */
+        real compliance;
+
     protected:
+        /**
+         * Holds the total correction applied by position based
+         * simulation during the current substep.
+         */
+        real lambda;
+
         /**
          * Returns the current length of the link.
          */
         real currentLength() const;
 
     public:
+        /**
+         * Creates a new rigid link.
+         */
+        ParticleLink();
+
+        /**
+         * Clears the correction accumulated during a substep.
+         */
+        virtual void resetProjection();
+
         /**
          * Geneates the contacts to keep this link from being
          * violated. This class can only ever generate a single
@@ -84,6 +110,11 @@ namespace cyclone {
          */
         virtual unsigned addContact(ParticleContact *contact,
                                     unsigned limit) const;
+
+        /**
+         * Moves the particles to keep the cable from over-extending.
+         */
+        virtual bool projectPositions(real duration);
     };
 
     /**
@@ -105,6 +136,11 @@ namespace cyclone {
          */
         virtual unsigned addContact(ParticleContact *contact,
                                      unsigned limit) const;
+
+        /**
+         * Moves the particles to keep the rod at its length.
+         */
+        virtual bool projectPositions(real duration);
     };
 
     /**
@@ -124,13 +160,35 @@ namespace cyclone {
          */
         Vector3 anchor;
 
+        /**
+         * Holds the compliance of the constraint for position based
+         * simulation, as for ParticleLink.
+         */
+        real compliance;
+
     protected:
+        /**
+         * Holds the total correction applied by position based
+         * simulation during the current substep.
+         */
+        real lambda;
+
         /**
         * Returns the current length of the link.
         */
         real currentLength() const;
 
     public:
+        /**
+         * Creates a new rigid constraint.
+         */
+        ParticleConstraint();
+
+        /**
+         * Clears the correction accumulated during a substep.
+         */
+        virtual void resetProjection();
+
         /**
         * Geneates the contacts to keep this link from being
         * violated. This class can only ever generate a single
@@ -171,6 +229,11 @@ namespace cyclone {
         */
         virtual unsigned addContact(ParticleContact *contact,
             unsigned limit) const;
+
+        /**
+         * Moves the particle to keep the cable from over-extending.
+         */
+        virtual bool projectPositions(real duration);
     };
 
     /**
@@ -192,6 +255,259 @@ namespace cyclone {
         */
         virtual unsigned addContact(ParticleContact *contact,
             unsigned limit) const;
+
+        /**
+         * Moves the particle to keep the rod at its length.
+         */
+        virtual bool projectPositions(real duration);
+    };
+
+    /**
+     * A link set holds any number of rods and cables, joining pairs
+     * of particles or particles and anchor points, as a single
+     * contact generator. The links are held in flat arrays of
+     * particle indices, lengths and types, and are all processed in
+     * one loop, so a large fixed structure costs a single virtual
+     * call per frame rather than one per link.
+     *
+     * Links are added and then compiled. Compiling orders the
+     * particles so that connected particles are near each other, and
+     * the links so that neighbouring links share particles, which
+     * keeps the loops over the links cache friendly. The set must be
+     * compiled again after adding more links.
+     *
+     * For position based simulation the rods can be solved directly
+     * (see setDirect): all the rods are treated as one system of
+     * equations, which is factorised and solved exactly, rather than
+     * each rod being projected in turn. The ordering from compile
+     * keeps the system banded, so a chain costs time in proportion
+     * to its length however long it is.
+     */
+    class ParticleLinkSet : public ParticleContactGenerator
+    {
+    public:
+        /**
+         * The kinds of link in a set.
+         */
+        enum LinkType
+        {
+            /** The link keeps its length, as a ParticleRod does. */
+            ROD,
+
+            /** The link can't stretch, as a ParticleCable can't. */
+            CABLE
+        };
+
+        /**
+         * Marks a link with no second particle, which is anchored.
+         */
+        static const unsigned NO_PARTICLE = 0xffffffff;
+
+    protected:
+        /**
+         * Holds the particles used by the links, in compiled order.
+         */
+        std::vector<Particle*> particles;
+
+        /**
+         * Holds the index of each link's particles in the particle
+         * list, two per link. The second is NO_PARTICLE for anchored
+         * links.
+         */
+        std::vector<unsigned> endpoints;
+
+        /**
+         * Holds each link's particles, two per link, as given when
+         * the link was added.
+         */
+        std::vector<Particle*> linkParticles;
+
+        /**
+         * Holds the anchor point of each link (only used for
+         * anchored links).
+         */
+        std::vector<Vector3> anchors;
+
+        /**
+         * Holds the length of each link (the maximum length for
+         * cables).
+         */
+        std::vector<real> lengths;
+
+        /**
+         * Holds the kind of each link.
+         */
+        std::vector<unsigned char> types;
+
+        /**
+         * Holds the restitution of each link.
+         */
+        std::vector<real> restitutions;
+
+        /**
+         * Holds the compliance of each link, as for ParticleLink.
+         */
+        std::vector<real> compliances;
+
+        /**
+         * Holds the correction accumulated by each link in the current
+         * substep of position based simulation.
+         */
+        std::vector<real> lambdas;
+
+        /**
+         * True if the links have been compiled since the last was
+         * added.
+         */
+        bool compiled;
+
+        /**
+         * True if the rods are solved directly in position based
+         * simulation.
+         */
+        bool direct;
+
+        /**
+         * Holds the index of each rod in the list of links. The rods
+         * are numbered in this order in the direct solver.
+         */
+        std::vector<unsigned> rods;
+
+        /**
+         * Holds the first column of each row of the rod system that
+         * can be non-zero.
+         */
+        std::vector<unsigned> rowFirst;
+
+        /**
+         * Holds where each row of the rod system starts in the
+         * envelope, with one extra entry marking the end of the last.
+         */
+        std::vector<unsigned> rowStart;
+
+        /**
+         * Holds the pairs of rods that share a particle, as three
+         * entries each: the later rod, the earlier rod, and the
+         * particle.
+         */
+        std::vector<unsigned> couplings;
+
+        /**
+         * Holds the rod system, and then its factorisation, from
+         * each row's first column to the diagonal.
+         */
+        std::vector<real> envelope;
+
+        /**
+         * Holds the right hand side, and then the solution, of the
+         * rod system.
+         */
+        std::vector<real> rodSolution;
+
+        /**
+         * Holds the direction of each rod, from its second end to its
+         * first.
+         */
+        std::vector<Vector3> rodDirections;
+
+        /**
+         * Adds a link of any kind.
+         */
+        void addLink(Particle *first, Particle *second,
+                     const Vector3 &anchor, LinkType type, real length,
+                     real restitution, real compliance);
+
+        /**
+         * Works out which entries of the rod system can be non-zero.
+         * This is called by compile.
+         */
+        void compileRodSystem();
+
+        /**
+         * Solves the rods directly, moving the particles to make
+         * every rod the right length at once (to first order).
+         */
+        void projectRodsDirect(real duration);
+
+    public:
+        /**
+         * Creates an empty link set.
+         */
+        ParticleLinkSet();
+
+        /**
+         * Adds a rod between the given particles.
+         */
+        void addRod(Particle *first, Particle *second, real length,
+                    real compliance = 0);
+
+        /**
+         * Adds a cable between the given particles.
+         */
+        void addCable(Particle *first, Particle *second, real maxLength,
+                      real restitution, real compliance = 0);
+
+        /**
+         * Adds a rod between the given particle and anchor point.
+         */
+        void addAnchoredRod(Particle *particle, const Vector3 &anchor,
+                            real length, real compliance = 0);
+
+        /**
+         * Adds a cable between the given particle and anchor point.
+         */
+        void addAnchoredCable(Particle *particle, const Vector3 &anchor,
+                              real maxLength, real restitution,
+                              real compliance = 0);
+
+        /**
+         * Orders the particles and links for processing. This must be
+         * called after adding links, before the set is used.
+         */
+        void compile();
+
+        /**
+         * Sets whether the rods are solved directly in position based
+         * simulation. Each projection then makes one exact solve of
+         * the rod system, linearised about the current positions.
+         * Cables can go slack, so they are still projected one at a
+         * time after the rods. The contact resolver is unaffected.
+         */
+        void setDirect(bool direct);
+
+        /**
+         * Returns the number of links.
+         */
+        unsigned getLinkCount() const;
+
+        /**
+         * Returns the given end of the given link, or NULL for the
+         * second end of an anchored link. Links are renumbered when
+         * the set is compiled.
+         */
+        Particle* getLinkParticle(unsigned link, unsigned end) const;
+
+        /**
+         * Returns the anchor point of the given link.
+         */
+        const Vector3& getLinkAnchor(unsigned link) const;
+
+        /**
+         * Fills the given contact array with the contacts needed to
+         * keep all the links intact, up to the given limit.
+         */
+        virtual unsigned addContact(ParticleContact *contact,
+                                    unsigned limit) const;
+
+        /**
+         * Moves the particles to keep all the links intact.
+         */
+        virtual bool projectPositions(real duration);
+
+        /**
+         * Clears the correction accumulated during a substep.
+         */
+        virtual void resetProjection();
     };
 } // namespace cyclone
 
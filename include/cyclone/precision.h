@@ -21,6 +21,11 @@
  *
  * @note All the contents of this file need to be changed to compile
  * Cyclone at a different precision.
+ *
+ * Defining MIXED_PRECISION when building selects a third mode: bulk
+ * data is stored in single precision, but sums that build up over
+ * many steps (and positions in large worlds) use the double precision
+ * real_accum type.
  */
 #ifndef CYCLONE_PRECISION_H
 #define CYCLONE_PRECISION_H
@@ -29,7 +34,7 @@
 
 namespace cyclone {
 
-#if 0
+#if 0 || defined(MIXED_PRECISION)
     /**
      * Defines we're in single precision mode, for any code
      * that needs to be conditionally compiled.
@@ -64,18 +69,39 @@ namespace cyclone {
     /** Defines the precision of the floating point modulo operator. */
     #define real_fmod fmodf
 
+    /** Defines the precision of the floor operator. */
+    #define real_floor floorf
+
     #define R_PI 3.14159f
+
+#ifdef MIXED_PRECISION
+    /**
+     * Defines the number type used to accumulate values where the
+     * error of many small additions matters, such as the impulses
+     * built up by the contact resolver, and the world origin.
+     */
+    typedef double real_accum;
+
+    /** Defines the precision of the square root of an accumulator. */
+    #define real_accum_sqrt sqrt
+#else
+    typedef float real_accum;
+    #define real_accum_sqrt sqrtf
+#endif
 #else
     #define DOUBLE_PRECISION
     typedef double real;
+    typedef double real_accum;
     #define REAL_MAX DBL_MAX
     #define real_sqrt sqrt
+    #define real_accum_sqrt sqrt
     #define real_abs fabs
     #define real_sin sin
     #define real_cos cos
     #define real_exp exp
     #define real_pow pow
     #define real_fmod fmod
+    #define real_floor floor
     #define R_PI 3.14159265358979
 #endif
 }
@@ -21,6 +21,8 @@
 
 #include "pfgen.h"
 #include "plinks.h"
+#include "integrators.h"
+#include "fields.h"
 
 namespace cyclone {
 
@@ -51,6 +53,11 @@ namespace cyclone {
          */
         ParticleForceRegistry registry;
 
+        /**
+         * Holds the force fields that act on every particle.
+         */
+        ForceFields fields;
+
         /**
          * Holds the resolver for contacts.
          */
@@ -72,6 +79,46 @@ namespace cyclone {
          */
         unsigned maxContacts;
 
+        /**
+         * True if the world should use position based simulation
+         * rather than the contact resolver.
+         */
+        bool positionBased;
+
+        /**
+         * Holds the number of substeps each frame is split into for
+         * position based simulation.
+         */
+        unsigned substeps;
+
+        /**
+         * Holds the number of times the constraints are projected in
+         * each substep.
+         */
+        unsigned positionIterations;
+
+        /**
+         * Holds the position of each particle at the start of the
+         * current substep.
+         */
+        std::vector<Vector3> previousPositions;
+
+        /**
+         * Processes the physics for the frame with position based
+         * simulation.
+         */
+        void runPositionBased(real duration);
+
+        /**
+         * Generates the contacts for the frame and resolves them.
+         */
+        void resolveContacts(real duration);
+
+        /**
+         * Adds the force of the force fields to every particle.
+         */
+        void applyForceFields();
+
     public:
 
         /**
@@ -86,7 +133,7 @@ namespace cyclone {
         /**
          * Deletes the simulator.
          */
-        ~ParticleWorld();
+        virtual ~ParticleWorld();
 
         /**
          * Calls each of the registered contact generators to report
@@ -95,16 +142,36 @@ namespace cyclone {
         unsigned generateContacts();
 
         /**
-         * Integrates all the particles in this world forward in time
-         * by the given duration.
+         * Applies the force generators and force fields, and
+         * integrates all the particles in this world forward in time
+         * by the given duration. This is called by runPhysics, and is
+         * overridden to change the integration scheme.
+         *
+         * @see IntegratedParticleWorld
          */
-        void integrate(real duration);
+        virtual void integrate(real duration);
 
         /**
          * Processes all the physics for the particle world.
          */
         void runPhysics(real duration);
 
+        /**
+         * Switches between the contact resolver and position based
+         * simulation (extended position based dynamics). In position
+         * based mode the frame is split into the given number of
+         * substeps. In each, the particles are moved with their
+         * velocity and forces, every contact generator's constraint is
+         * projected directly the given number of times, and the
+         * particles' velocities are taken from how far they moved.
+         * Links and anchored constraints project themselves, with
+         * their compliance; other generators have their contacts
+         * projected. Restitution is not used, and the force
+         * generators are only run once per frame.
+         */
+        void setPositionBased(bool positionBased, unsigned substeps = 8,
+                              unsigned iterations = 1);
+
         /**
          * Initializes the world for a simulation frame. This clears
          * the force accumulators for particles in the world. After
@@ -127,6 +194,62 @@ namespace cyclone {
          * Returns the force registry.
          */
         ParticleForceRegistry& getForceRegistry();
+
+        /**
+         * Returns the force fields that act on every particle in the
+         * world. They are evaluated once per frame, with the force
+         * generators.
+         */
+        ForceFields& getForceFields();
+
+        /**
+         * Returns the contact resolver.
+         */
+        ParticleContactResolver& getContactResolver();
+    };
+
+    /**
+     * A particle world whose particles are moved with the integration
+     * scheme given as the template parameter: SymplecticEuler,
+     * VelocityVerlet or RungeKutta4 (or any class with the same
+     * integrate method). The scheme is fixed when the world is
+     * compiled, so the cheapest one that is stable at the time step
+     * can be chosen without any cost at run time. ParticleWorld itself
+     * always uses Particle::integrate. The world can be run through a
+     * ParticleWorld reference or pointer, and still uses its scheme.
+     *
+     * The scheme is not used in position based mode, which has its
+     * own integration. The force fields are evaluated once at the start
+     * of each step, and held constant over it.
+     */
+    template<class Integrator>
+    class IntegratedParticleWorld : public ParticleWorld
+    {
+    protected:
+        /**
+         * Holds the integrator, along with any working data it needs.
+         */
+        Integrator integrator;
+
+    public:
+        /**
+         * Creates a new particle simulator, as for ParticleWorld.
+         */
+        IntegratedParticleWorld(unsigned maxContacts, unsigned iterations=0)
+            : ParticleWorld(maxContacts, iterations)
+        {
+        }
+
+        /**
+         * Applies the force generators and integrates all the
+         * particles in this world forward in time by the given
+         * duration.
+         */
+        virtual void integrate(real duration)
+        {
+            applyForceFields();
+            integrator.integrate(particles, registry, duration);
+        }
     };
 
     /**
@@ -0,0 +1,259 @@
+/*
+ * Interface file for slot maps and their handles.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains a container that keeps its items packed together
+ * for fast iteration, while handing out handles that stay valid as
+ * other items come and go.
+ */
+#ifndef CYCLONE_SLOTMAP_H
+#define CYCLONE_SLOTMAP_H
+
+#include <vector>
+
+namespace cyclone {
+
+    /**
+     * Refers to an item in a SlotMap (or to a registration in a force
+     * registry). A handle stays valid until its item is removed, and
+     * then it never refers to anything again, even when its slot is
+     * reused.
+     */
+    struct Handle
+    {
+        /**
+         * Holds the slot the item is in.
+         */
+        unsigned index;
+
+        /**
+         * Holds the generation of the slot when the item was added.
+         */
+        unsigned generation;
+
+        /**
+         * Creates a handle that doesn't refer to anything.
+         */
+        Handle() : index(0xffffffff), generation(0) {}
+
+        bool operator==(const Handle &other) const
+        {
+            return index == other.index && generation == other.generation;
+        }
+
+        bool operator!=(const Handle &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Holds a set of items packed together in one array, so they can
+     * be iterated over without gaps, along with a table of slots that
+     * turns handles into positions in the array. Adding and removing
+     * items both take constant time: removing an item moves the last
+     * item into its place, so the order of the items changes.
+     *
+     * Each slot has a generation that goes up every time its item is
+     * removed, so stale handles are detected rather than finding
+     * whatever item now uses the slot.
+     */
+    template<class Item>
+    class SlotMap
+    {
+    protected:
+        /**
+         * Holds the items, packed together.
+         */
+        std::vector<Item> items;
+
+        /**
+         * Holds the slot of each item.
+         */
+        std::vector<unsigned> itemSlots;
+
+        /**
+         * Holds the position of each slot's item in the items array,
+         * or the next free slot if the slot is free.
+         */
+        std::vector<unsigned> slotItems;
+
+        /**
+         * Holds the generation of each slot.
+         */
+        std::vector<unsigned> generations;
+
+        /**
+         * Holds the first free slot, or NO_SLOT if there is none.
+         */
+        unsigned firstFree;
+
+        /**
+         * Marks the end of the free slot list.
+         */
+        static const unsigned NO_SLOT = 0xffffffff;
+
+    public:
+        /**
+         * Creates an empty slot map.
+         */
+        SlotMap() : firstFree(NO_SLOT) {}
+
+        /**
+         * Adds the given item, returning its handle.
+         */
+        Handle add(const Item &item)
+        {
+            Handle handle;
+            if (firstFree != NO_SLOT)
+            {
+                handle.index = firstFree;
+                firstFree = slotItems[firstFree];
+            }
+            else
+            {
+                handle.index = (unsigned)slotItems.size();
+                slotItems.push_back(0);
+                generations.push_back(0);
+            }
+            handle.generation = generations[handle.index];
+
+            slotItems[handle.index] = (unsigned)items.size();
+            items.push_back(item);
+            itemSlots.push_back(handle.index);
+            return handle;
+        }
+
+        /**
+         * Removes the item with the given handle, returning false if
+         * the handle is stale.
+         */
+        bool remove(const Handle &handle)
+        {
+            if (!isValid(handle)) return false;
+
+            // Move the last item into the gap.
+            unsigned position = slotItems[handle.index];
+            unsigned last = (unsigned)items.size() - 1;
+            if (position != last)
+            {
+                items[position] = items[last];
+                itemSlots[position] = itemSlots[last];
+                slotItems[itemSlots[position]] = position;
+            }
+            items.pop_back();
+            itemSlots.pop_back();
+
+            // And free the slot, so the handle is no longer valid.
+            generations[handle.index]++;
+            slotItems[handle.index] = firstFree;
+            firstFree = handle.index;
+            return true;
+        }
+
+        /**
+         * Checks if the given handle refers to an item.
+         */
+        bool isValid(const Handle &handle) const
+        {
+            return handle.index < generations.size() &&
+                generations[handle.index] == handle.generation &&
+                slotItems[handle.index] < items.size() &&
+                itemSlots[slotItems[handle.index]] == handle.index;
+        }
+
+        /**
+         * Returns the item with the given handle, or NULL if the
+         * handle is stale.
+         */
+        Item* get(const Handle &handle)
+        {
+            if (!isValid(handle)) return NULL;
+            return &items[slotItems[handle.index]];
+        }
+
+        /**
+         * Returns the position of the item with the given handle in
+         * the packed array. The handle must be valid.
+         */
+        unsigned getPosition(const Handle &handle) const
+        {
+            return slotItems[handle.index];
+        }
+
+        /**
+         * Returns the handle of the item at the given position in the
+         * packed array.
+         */
+        Handle getHandle(unsigned position) const
+        {
+            Handle handle;
+            handle.index = itemSlots[position];
+            handle.generation = generations[handle.index];
+            return handle;
+        }
+
+        /**
+         * Returns the number of items.
+         */
+        unsigned size() const
+        {
+            return (unsigned)items.size();
+        }
+
+        /**
+         * Checks if there are no items.
+         */
+        bool empty() const
+        {
+            return items.empty();
+        }
+
+        /**
+         * Makes room for the given number of items in total, so that
+         * adding them doesn't need to allocate.
+         */
+        void reserve(unsigned count)
+        {
+            items.reserve(count);
+            itemSlots.reserve(count);
+        }
+
+        /**
+         * Gives access to the item at the given position in the
+         * packed array.
+         */
+        Item& operator[](unsigned position)
+        {
+            return items[position];
+        }
+
+        const Item& operator[](unsigned position) const
+        {
+            return items[position];
+        }
+
+        /**
+         * Removes all the items. Every handle given out becomes
+         * stale.
+         */
+        void clear()
+        {
+            while (!items.empty()) remove(getHandle(size() - 1));
+        }
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_SLOTMAP_H
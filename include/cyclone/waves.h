@@ -0,0 +1,233 @@
+/*
+ * Interface file for wave surfaces and buoyancy on them.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+/**
+ * @file
+ *
+ * This file contains the definitions for a moving water surface made
+ * of waves, and a buoyancy force generator that floats hulls on it.
+ */
+#ifndef CYCLONE_WAVES_H
+#define CYCLONE_WAVES_H
+
+#include <vector>
+#include "fgen.h"
+
+namespace cyclone {
+
+    /**
+     * A water surface made of a sum of Gerstner (trochoidal) waves
+     * travelling over a flat base height. Gerstner waves move the
+     * water sideways as well as up and down, giving sharper crests
+     * and flatter troughs than plain sine waves. With no waves the
+     * surface is flat, like the water plane of Buoyancy.
+     *
+     * The surface changes with time, which the owner moves on once
+     * per frame. One surface can be shared by any number of bodies.
+     */
+    class WaveField
+    {
+    protected:
+        /**
+         * Holds the direction each wave travels in, in the XZ plane.
+         */
+        std::vector<Vector3> directions;
+
+        /**
+         * Holds the height of each wave's crests above the base.
+         */
+        std::vector<real> amplitudes;
+
+        /**
+         * Holds the wave number (2 pi over the wavelength) of each
+         * wave.
+         */
+        std::vector<real> waveNumbers;
+
+        /**
+         * Holds the angular frequency of each wave.
+         */
+        std::vector<real> frequencies;
+
+        /**
+         * Holds how far each wave moves the water sideways.
+         */
+        std::vector<real> sidewaysAmplitudes;
+
+        /**
+         * Holds the phase of each wave at time zero.
+         */
+        std::vector<real> phases;
+
+        /**
+         * Holds the height of the surface with no waves.
+         */
+        real baseHeight;
+
+        /**
+         * Holds the time the surface is at.
+         */
+        real time;
+
+        /**
+         * Holds the acceleration due to gravity used to work out the
+         * speed of the waves.
+         */
+        real gravity;
+
+    public:
+        /**
+         * Creates a flat surface at the given height. The gravity sets
+         * how fast waves of each length travel, as they do in deep
+         * water.
+         */
+        WaveField(real baseHeight = 0, real gravity = (real)9.81);
+
+        /**
+         * Adds a wave travelling along the given direction (only its
+         * x and z are used) with the given crest height above the base
+         * and wavelength, returning its index. The steepness runs from
+         * 0, for a sine wave, to 1, for the sharpest crest the wave
+         * can have. The phase offsets the wave along its direction.
+         */
+        unsigned addWave(const Vector3 &direction, real amplitude,
+                         real wavelength, real steepness = (real)0.5,
+                         real phase = 0);
+
+        /**
+         * Returns the number of waves.
+         */
+        unsigned getWaveCount() const;
+
+        /**
+         * Removes all the waves, leaving the surface flat.
+         */
+        void clear();
+
+        /**
+         * Sets the height of the surface with no waves.
+         */
+        void setBaseHeight(real baseHeight);
+
+        /**
+         * Moves the surface on in time by the given duration.
+         */
+        void advance(real duration);
+
+        /**
+         * Sets the time the surface is at.
+         */
+        void setTime(real time);
+
+        /**
+         * Returns the time the surface is at.
+         */
+        real getTime() const;
+
+        /**
+         * Returns the height of the surface above the given point in
+         * the XZ plane.
+         */
+        real getHeight(real x, real z) const;
+
+        /**
+         * Fills in the height of the surface above each of the given
+         * points (only their x and z are used).
+         */
+        void getHeights(const Vector3 *points, unsigned count,
+                        real *heights) const;
+    };
+
+    /**
+     * A force generator that floats a rigid body on a wave surface.
+     * The body's hull is described by a set of sample points, each
+     * standing for part of its volume. Every sample is tested against
+     * the surface and the buoyancy of the submerged ones is summed
+     * into a single force and torque, which is applied to the body.
+     *
+     * Each sample gives its full buoyancy once it is the maximum
+     * depth below the surface, none once it is the maximum depth
+     * above, and a linear ramp in between. This is the blend
+     * Buoyancy is meant to give; it does not copy that generator's
+     * partly submerged formula, which does not ramp between the two.
+     */
+    class HullBuoyancy : public ForceGenerator
+    {
+    protected:
+        /**
+         * Holds the surface the body floats on.
+         */
+        const WaveField *surface;
+
+        /**
+         * Holds the position of each sample, in body coordinates.
+         */
+        std::vector<Vector3> samples;
+
+        /**
+         * Holds the volume each sample stands for.
+         */
+        std::vector<real> volumes;
+
+        /**
+         * Holds the depth over which each sample goes from dry to
+         * fully submerged, measured either side of the surface.
+         */
+        real maxDepth;
+
+        /**
+         * Holds the density of the liquid.
+         */
+        real liquidDensity;
+
+        /**
+         * Holds the samples in world coordinates, and the height of
+         * the surface above each, for the current update.
+         */
+        std::vector<Vector3> worldSamples;
+        std::vector<real> heights;
+
+    public:
+        /**
+         * Creates a hull with no samples, floating on the given
+         * surface. The surface must outlive the generator.
+         */
+        HullBuoyancy(const WaveField *surface, real maxDepth,
+                     real liquidDensity = 1000.0f);
+
+        /**
+         * Adds a sample at the given point in body coordinates,
+         * standing for the given volume, returning its index.
+         */
+        unsigned addSample(const Vector3 &point, real volume);
+
+        /**
+         * Returns the number of samples.
+         */
+        unsigned getSampleCount() const;
+
+        /**
+         * Calculates the total buoyancy force on the given body, and
+         * its torque about the centre of mass, in world coordinates.
+         */
+        void getForceAndTorque(const RigidBody *body, Vector3 *force,
+                               Vector3 *torque);
+
+        /**
+         * Applies the buoyancy force and torque to the given body.
+         */
+        virtual void updateForce(RigidBody *body, real duration);
+    };
+
+} // namespace cyclone
+
+#endif // CYCLONE_WAVES_H
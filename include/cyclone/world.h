@@ -21,8 +21,24 @@
 
 #include "body.h"
 #include "contacts.h"
+#include "fields.h"
+#include "fgen.h"
+#include "slotmap.h"
 
 namespace cyclone {
+    /**
+     * Holds a position in the world at accumulation precision (see
+     * real_accum). Bodies hold their positions relative to the world's
+     * origin, which keeps them small enough to be stored at the
+     * ordinary precision however far the simulation wanders.
+     */
+    struct WorldPosition
+    {
+        real_accum x;
+        real_accum y;
+        real_accum z;
+    };
+
     /**
      * The world represents an independent simulation of physics.  It
      * keeps track of a set of rigid bodies, and provides the means to
@@ -38,37 +54,31 @@ namespace cyclone {
         bool calculateIterations;
 
         /**
-         * Holds a single rigid body in a linked list of bodies.
+         * Holds the bodies in the world.
          */
-        struct BodyRegistration
-        {
-            RigidBody *body;
-            BodyRegistration * next;
-        };
+        SlotMap<RigidBody*> bodies;
 
         /**
-         * Holds the head of the list of registered bodies.
+         * Holds the transform version of each body (in the same order
+         * as the bodies) when it was last listed as changed.
          */
-        BodyRegistration *firstBody;
+        std::vector<unsigned> reportedVersions;
 
         /**
-         * Holds the resolver for sets of contacts.
+         * Holds the handles of the bodies that moved in the last
+         * frame.
          */
-        ContactResolver resolver;
+        std::vector<Handle> changedBodies;
 
         /**
-         * Holds one contact generators in a linked list.
+         * Holds the resolver for sets of contacts.
          */
-        struct ContactGenRegistration
-        {
-            ContactGenerator *gen;
-            ContactGenRegistration *next;
-        };
+        ContactResolver resolver;
 
         /**
-         * Holds the head of the list of contact generators.
+         * Holds the contact generators.
          */
-        ContactGenRegistration *firstContactGen;
+        SlotMap<ContactGenerator*> contactGenerators;
 
         /**
          * Holds an array of contacts, for filling by the contact
@@ -82,23 +92,97 @@ namespace cyclone {
          */
         unsigned maxContacts;
 
+        /**
+         * Holds the position in the world that body positions are
+         * relative to.
+         */
+        WorldPosition origin;
+
+        /**
+         * Holds the force fields that act on every body.
+         */
+        ForceFields fields;
+
+        /**
+         * Holds the explosions still going on.
+         */
+        std::vector<Explosion*> explosions;
+
     public:
         /**
          * Creates a new simulator that can handle up to the given
          * number of contacts per frame. You can also optionally give
          * a number of contact-resolution iterations to use. If you
          * don't give a number of iterations, then four times the
-         * number of detected contacts will be used for each frame.
+         * number of detected contacts and constraint rows will be
+         * used for each frame.
          */
         World(unsigned maxContacts, unsigned iterations=0);
         ~World();
 
+        /**
+         * Adds the given body to the world, returning a handle that
+         * can be used to remove it again. The world doesn't delete
+         * the body.
+         */
+        Handle addBody(RigidBody *body);
+
+        /**
+         * Adds the given number of bodies to the world at once. If
+         * handles is not NULL, it is filled in with their handles.
+         */
+        void addBodies(RigidBody **bodies, unsigned count,
+                       Handle *handles = NULL);
+
+        /**
+         * Removes the body with the given handle from the world,
+         * returning false if the handle is stale.
+         */
+        bool removeBody(const Handle &handle);
+
+        /**
+         * Returns the body with the given handle, or NULL if the
+         * handle is stale.
+         */
+        RigidBody* getBody(const Handle &handle);
+
+        /**
+         * Returns the number of bodies in the world.
+         */
+        unsigned getBodyCount() const;
+
+        /**
+         * Returns the body at the given position in the world's
+         * list. Positions run from zero to one less than the number of
+         * bodies, and change as bodies are removed.
+         */
+        RigidBody* getBodyAt(unsigned position);
+
+        /**
+         * Adds the given contact generator to the world, returning a
+         * handle that can be used to remove it again.
+         */
+        Handle addContactGenerator(ContactGenerator *generator);
+
+        /**
+         * Removes the contact generator with the given handle from
+         * the world, returning false if the handle is stale.
+         */
+        bool removeContactGenerator(const Handle &handle);
+
         /**
          * Calls each of the registered contact generators to report
          * their contacts. Returns the number of generated contacts.
          */
         unsigned generateContacts();
 
+        /**
+         * Returns the contact resolver, so its resolution modes and
+         * the constraints (joints) it resolves along with the
+         * contacts can be set.
+         */
+        ContactResolver& getContactResolver();
+
         /**
          * Processes all the physics for the world.
          */
@@ -107,11 +191,82 @@ namespace cyclone {
         /**
          * Initialises the world for a simulation frame. This clears
          * the force and torque accumulators for bodies in the
-         * world. After calling this, the bodies can have their forces
-         * and torques for this frame added.
+         * world, and brings the derived data of any body that has
+         * been moved since it was last calculated up to date. After
+         * calling this, the bodies can have their forces and torques
+         * for this frame added.
          */
         void startFrame();
 
+        /**
+         * Returns the handles of the bodies whose position or
+         * orientation changed in the last call to runPhysics, or
+         * since they were last listed (including bodies moved
+         * directly, and bodies that have just been added). Sleeping
+         * bodies that weren't disturbed aren't listed, so renderers
+         * and network code only need to look at these.
+         */
+        const std::vector<Handle>& getChangedBodies() const;
+
+        /**
+         * Returns the force fields that act on every body in the
+         * world. They are applied to each awake body as it is
+         * integrated.
+         */
+        ForceFields& getForceFields();
+
+        /**
+         * Adds an explosion to the world. Each frame it is applied to
+         * the bodies in its broad phase (see Explosion::setBroadPhase)
+         * that it reaches, and once it is finished it is removed
+         * again. The world doesn't delete the explosion.
+         */
+        void addExplosion(Explosion *explosion);
+
+        /**
+         * Returns the number of explosions still going on.
+         */
+        unsigned getExplosionCount() const;
+
+        /**
+         * Returns the position in the world that body positions are
+         * relative to.
+         */
+        const WorldPosition& getOrigin() const
+        {
+            return origin;
+        }
+
+        /**
+         * Converts a position relative to the origin into a position
+         * in the world.
+         */
+        WorldPosition getWorldPosition(const Vector3 &position) const;
+
+        /**
+         * Converts a position in the world into a position relative
+         * to the origin.
+         */
+        Vector3 getLocalPosition(const WorldPosition &position) const;
+
+        /**
+         * Moves the origin by the given offset, and moves every body
+         * the opposite way so it stays where it is in the world.
+         * The force fields and explosions are moved too. Anything
+         * else holding positions relative to the origin, such as
+         * contact generators for the scenery or a broad phase (see
+         * BroadPhase::shiftOrigin), must be moved by the caller.
+         */
+        void shiftOrigin(const Vector3 &offset);
+
+        /**
+         * Moves the origin to the corner of the sector of the given
+         * size that contains the given position, if it isn't there
+         * already. Calling this each frame with the position of the
+         * camera or player keeps nearby bodies close to the origin.
+         */
+        void recentre(const Vector3 &focus, real sectorSize);
+
     };
 
 } // namespace cyclone
@@ -99,8 +99,7 @@ inline cyclone::real VectorLength( cyclone::real x0, cyclone::real y0, cyclone::
 
 class HangmanDemo : public MassAggregateApplication
 {
-    cyclone::ParticleCableConstraint *m_Supports;
-    cyclone::ParticleRod *m_Cables;
+    cyclone::ParticleLinkSet m_Links;
 public:
     HangmanDemo( void );
     virtual ~HangmanDemo( void );
@@ -112,7 +111,7 @@ public:
     virtual void Key( unsigned char key );
 };
 
-HangmanDemo::HangmanDemo( void ) : MassAggregateApplication( PARTICLE_ARRAY_LENGTH ), m_Cables( 0 ), m_Supports( 0 )
+HangmanDemo::HangmanDemo( void ) : MassAggregateApplication( PARTICLE_ARRAY_LENGTH )
 {
     for( unsigned i = 0 ; i < PARTICLE_ARRAY_LENGTH ; ++i )
     {
@@ -127,7 +126,6 @@ HangmanDemo::HangmanDemo( void ) : MassAggregateApplication( PARTICLE_ARRAY_LENG
         this->m_ParticleArray[i].clearAccumulator();
     }
     
-    this->m_Cables = new cyclone::ParticleRod[CABLE_INDEX_ARRAY_LENGTH];
     for( unsigned i = 0 ; i < CABLE_INDEX_ARRAY_LENGTH ; ++i )
     {
         unsigned int a = CABLE_INDEX_ARRAY[i * CABLE_INDEX_ARRAY_STRIDE];
@@ -137,49 +135,37 @@ HangmanDemo::HangmanDemo( void ) : MassAggregateApplication( PARTICLE_ARRAY_LENG
         ap = this->m_ParticleArray[a].getPosition();
         bp = this->m_ParticleArray[b].getPosition();
         
-        this->m_Cables[i].particle[0] = &this->m_ParticleArray[a];
-        this->m_Cables[i].particle[1] = &this->m_ParticleArray[b];
-        this->m_Cables[i].length = VectorLength( ap.x, ap.y, bp.x, bp.y );
-        this->m_World.getContactGenerators().push_back( &this->m_Cables[i] );
-        
-        this->m_Cables[i].particle[0]->clearAccumulator();
-        this->m_Cables[i].particle[1]->clearAccumulator();
+        this->m_Links.addRod( &this->m_ParticleArray[a], &this->m_ParticleArray[b], VectorLength( ap.x, ap.y, bp.x, bp.y ) );
     }
     
-    this->m_Supports = new cyclone::ParticleCableConstraint[SUPPORT_ARRAY_LENGTH];
     for( unsigned i = 0 ; i < SUPPORT_ARRAY_LENGTH ; ++i )
     {
         int supportIndex = SUPPORT_INDEX_ARRAY[i * SUPPORT_ARRAY_STRIDE];
         int particleIndex = SUPPORT_INDEX_ARRAY[i * SUPPORT_ARRAY_STRIDE + 1];
      
-        this->m_Supports[i].particle = &this->m_ParticleArray[particleIndex];
-        this->m_Supports[i].anchor = cyclone::Vector3( 
+        cyclone::Vector3 anchor( 
             SUPPORT_ARRAY[supportIndex * SUPPORT_INDEX_ARRAY_STRIDE] * DEFAULT_SCALE, 
             DEFAULT_DISPLACEMENT - SUPPORT_ARRAY[supportIndex * SUPPORT_INDEX_ARRAY_STRIDE + 1], 
             -1
         );
         
         cyclone::Vector3 ap, bp;
-        ap = this->m_Supports[i].anchor;
-        bp = this->m_Supports[i].particle->getPosition();
-        
-        this->m_Supports[i].maxLength = VectorLength( ap.x, ap.y, bp.x, bp.y );
+        ap = anchor;
+        bp = this->m_ParticleArray[particleIndex].getPosition();
         
-        this->m_Supports[i].restitution = DEFAULT_SUPPORT_RESTITUTION;
-        this->m_World.getContactGenerators().push_back( &this->m_Supports[i] );
+        this->m_Links.addAnchoredCable( &this->m_ParticleArray[particleIndex], anchor, VectorLength( ap.x, ap.y, bp.x, bp.y ), DEFAULT_SUPPORT_RESTITUTION );
     }
+    
+    // The structure never changes, so all the links are handled together.
+    this->m_Links.compile();
+    this->m_World.getContactGenerators().push_back( &this->m_Links );
+    
+    // Project the rods directly so the bridge doesn't stretch.
+    this->m_World.setPositionBased( true );
 }
 
 HangmanDemo::~HangmanDemo()
 {
-    if( this->m_Cables ) 
-    {
-        delete[] this->m_Cables;
-    }
-    if( this->m_Supports ) 
-    {
-        delete[] this->m_Supports;
-    }
 }
 
 void HangmanDemo::Display( void )
@@ -187,23 +173,22 @@ void HangmanDemo::Display( void )
     MassAggregateApplication::Display();
     
     glBegin( GL_LINES );
-        for( unsigned i = 0 ; i < CABLE_INDEX_ARRAY_LENGTH ; ++i )
-        {
-            cyclone::Particle **particles = this->m_Cables[i].particle;
-            const cyclone::Vector3 &p0 = particles[0]->getPosition();
-            const cyclone::Vector3 &p1 = particles[1]->getPosition();
-            
-            glColor3d( 0, 1.0 / CABLE_INDEX_ARRAY_LENGTH * i, 0 );
-            glVertex3d( p0.x, p0.y, p0.z );
-            glVertex3d( p1.x, p1.y, p1.z );
-        }
-        
-        for( unsigned i = 0 ; i < SUPPORT_ARRAY_LENGTH ; ++i )
+        const unsigned linkCount = this->m_Links.getLinkCount();
+        for( unsigned i = 0 ; i < linkCount ; ++i )
         {
-            const cyclone::Vector3 &p0 = this->m_Supports[i].particle->getPosition();
-            const cyclone::Vector3 &p1 = this->m_Supports[i].anchor;
+            cyclone::Particle *a = this->m_Links.getLinkParticle( i, 0 );
+            cyclone::Particle *b = this->m_Links.getLinkParticle( i, 1 );
+            const cyclone::Vector3 &p0 = a->getPosition();
+            const cyclone::Vector3 p1 = b ? b->getPosition() : this->m_Links.getLinkAnchor( i );
             
-            glColor3d( 1.0 / SUPPORT_ARRAY_LENGTH * i, 0, 1 );
+            if( b )
+            {
+                glColor3d( 0, 1.0 / linkCount * i, 0 );
+            }
+            else
+            {
+                glColor3d( 1.0 / linkCount * i, 0, 1 );
+            }
             glVertex3d( p0.x, p0.y, p0.z );
             glVertex3d( p1.x, p1.y, p1.z );
         }
@@ -0,0 +1,451 @@
+/*
+ * Implementation file for articulated bodies.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include <cyclone/cyclone.h>
+#include <assert.h>
+
+using namespace cyclone;
+
+/*
+ * Spatial vectors are held as six reals, angular part first. Motion
+ * vectors hold an angular velocity and the velocity of the point at
+ * the world origin; force vectors hold a moment about the world
+ * origin and a force.
+ */
+
+static inline Vector3 angularPart(const real *s)
+{
+    return Vector3(s[0], s[1], s[2]);
+}
+
+static inline Vector3 linearPart(const real *s)
+{
+    return Vector3(s[3], s[4], s[5]);
+}
+
+static inline void setSpatial(real *s, const Vector3 &angular,
+                              const Vector3 &linear)
+{
+    s[0] = angular.x; s[1] = angular.y; s[2] = angular.z;
+    s[3] = linear.x; s[4] = linear.y; s[5] = linear.z;
+}
+
+static inline real spatialDot(const real *a, const real *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] +
+        a[3]*b[3] + a[4]*b[4] + a[5]*b[5];
+}
+
+/*
+ * Multiplies a 6x6 matrix (stored by rows) by a spatial vector.
+ */
+static inline void spatialTransform(const real *matrix, const real *s,
+                                    real *result)
+{
+    for (unsigned row = 0; row < 6; row++)
+    {
+        result[row] = spatialDot(matrix + row*6, s);
+    }
+}
+
+/*
+ * Works out the cross product of a spatial velocity with a motion
+ * vector.
+ */
+static inline void crossMotion(const real *v, const real *m, real *result)
+{
+    Vector3 w = angularPart(v);
+    setSpatial(result,
+        w % angularPart(m),
+        w % linearPart(m) + linearPart(v) % angularPart(m));
+}
+
+/*
+ * Works out the cross product of a spatial velocity with a force
+ * vector.
+ */
+static inline void crossForce(const real *v, const real *f, real *result)
+{
+    Vector3 w = angularPart(v);
+    setSpatial(result,
+        w % angularPart(f) + linearPart(v) % linearPart(f),
+        w % linearPart(f));
+}
+
+/*
+ * Fills in the spatial inertia of the given body about the world
+ * origin.
+ */
+static void calculateSpatialInertia(const RigidBody *body, real *inertia)
+{
+    real mass = ((real)1.0) / body->getInverseMass();
+    Vector3 c = body->getPosition();
+    Matrix3 tensor = body->getInertiaTensorWorld();
+
+    // Move the rotational inertia from the centre of mass to the
+    // origin (the parallel axis theorem).
+    real squareDistance = c.squareMagnitude();
+    for (unsigned row = 0; row < 3; row++)
+    {
+        for (unsigned col = 0; col < 3; col++)
+        {
+            inertia[row*6 + col] = tensor.data[row*3 + col] -
+                mass * c[row] * c[col];
+            inertia[row*6 + col + 3] = 0;
+            inertia[(row+3)*6 + col] = 0;
+            inertia[(row+3)*6 + col + 3] = 0;
+        }
+        inertia[row*6 + row] += mass * squareDistance;
+        inertia[(row+3)*6 + row + 3] = mass;
+    }
+
+    // The coupling terms are mass times the cross product matrix of
+    // the centre of mass.
+    real cross[9] = {
+        0, -c.z, c.y,
+        c.z, 0, -c.x,
+        -c.y, c.x, 0
+    };
+    for (unsigned row = 0; row < 3; row++)
+    {
+        for (unsigned col = 0; col < 3; col++)
+        {
+            inertia[row*6 + col + 3] = mass * cross[row*3 + col];
+            inertia[(row+3)*6 + col] = -mass * cross[row*3 + col];
+        }
+    }
+}
+
+/*
+ * Rotates the given vector by the given (normalised) quaternion.
+ */
+static inline Vector3 rotate(const Quaternion &q, const Vector3 &v)
+{
+    Vector3 axis(q.i, q.j, q.k);
+    Vector3 t = (axis % v) * 2;
+    return v + t * q.r + axis % t;
+}
+
+unsigned Articulation::addLink(RigidBody *body, int parent, JointType type,
+                               const Vector3 &axis,
+                               const Vector3 &jointPosition)
+{
+    assert(parent < (int)links.size());
+    assert(body->getInverseMass() > 0);
+
+    Link link;
+    link.body = body;
+    link.parent = parent;
+    link.type = type;
+    link.position = 0;
+    link.velocity = 0;
+    link.drive = 0;
+    link.damping = 0;
+
+    Vector3 axisWorld = axis;
+    axisWorld.normalise();
+
+    Quaternion parentOrientation;
+    if (parent >= 0)
+    {
+        RigidBody *parentBody = links[parent].body;
+        link.axis = parentBody->getDirectionInLocalSpace(axisWorld);
+        link.parentOffset = parentBody->getPointInLocalSpace(jointPosition);
+        parentOrientation = parentBody->getOrientation();
+    }
+    else
+    {
+        link.axis = axisWorld;
+        link.parentOffset = jointPosition;
+    }
+    link.linkOffset = body->getPointInLocalSpace(jointPosition);
+
+    // Find the orientation relative to the parent, by undoing the
+    // parent's orientation.
+    link.restOrientation = Quaternion(parentOrientation.r,
+        -parentOrientation.i, -parentOrientation.j, -parentOrientation.k);
+    link.restOrientation *= body->getOrientation();
+    link.restOrientation.normalise();
+
+    links.push_back(link);
+    states.resize(links.size());
+    jointAccelerations.resize(links.size());
+    return (unsigned)links.size() - 1;
+}
+
+void Articulation::updateLinkPositions()
+{
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        Link &link = links[i];
+
+        // Find the joint in the world.
+        Quaternion orientation;
+        Vector3 jointWorld = link.parentOffset;
+        Vector3 axisWorld = link.axis;
+        if (link.parent >= 0)
+        {
+            RigidBody *parentBody = links[link.parent].body;
+            orientation = parentBody->getOrientation();
+            jointWorld = parentBody->getPosition() +
+                rotate(orientation, link.parentOffset);
+            axisWorld = rotate(orientation, link.axis);
+        }
+
+        // Then move the link about it.
+        if (link.type == REVOLUTE)
+        {
+            real s = real_sin(link.position * (real)0.5);
+            orientation *= Quaternion(real_cos(link.position * (real)0.5),
+                link.axis.x * s, link.axis.y * s, link.axis.z * s);
+        }
+        else
+        {
+            jointWorld.addScaledVector(axisWorld, link.position);
+        }
+        orientation *= link.restOrientation;
+        orientation.normalise();
+
+        link.body->setOrientation(orientation);
+        link.body->setPosition(jointWorld - rotate(orientation, link.linkOffset));
+        link.body->calculateDerivedData();
+    }
+}
+
+void Articulation::calculateLinkVelocities()
+{
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        Link &link = links[i];
+        LinkState &state = states[i];
+
+        Vector3 axisWorld = link.axis;
+        if (link.parent >= 0)
+        {
+            axisWorld = links[link.parent].body->getDirectionInWorldSpace(
+                link.axis);
+        }
+
+        // The spatial axis of a revolute joint includes the motion
+        // of the world origin as the link turns about the joint.
+        if (link.type == REVOLUTE)
+        {
+            Vector3 jointWorld =
+                link.body->getPointInWorldSpace(link.linkOffset);
+            setSpatial(state.axis, axisWorld, jointWorld % axisWorld);
+        }
+        else
+        {
+            setSpatial(state.axis, Vector3(), axisWorld);
+        }
+
+        for (unsigned j = 0; j < 6; j++)
+        {
+            state.velocity[j] = state.axis[j] * link.velocity;
+            if (link.parent >= 0)
+            {
+                state.velocity[j] += states[link.parent].velocity[j];
+            }
+        }
+    }
+}
+
+void Articulation::updateLinkVelocities()
+{
+    calculateLinkVelocities();
+
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        RigidBody *body = links[i].body;
+        Vector3 rotation = angularPart(states[i].velocity);
+        body->setRotation(rotation);
+        body->setVelocity(linearPart(states[i].velocity) +
+            rotation % body->getPosition());
+    }
+}
+
+void Articulation::calculateJointAccelerations(
+    const std::vector<real> &forces, bool dynamics)
+{
+    int i;
+    unsigned j, k;
+    real temp[6];
+
+    // Work out the inertia and bias force of each link on its own.
+    for (i = 0; i < (int)links.size(); i++)
+    {
+        Link &link = links[i];
+        LinkState &state = states[i];
+        calculateSpatialInertia(link.body, state.inertia);
+
+        if (dynamics)
+        {
+            real jointMotion[6];
+            for (j = 0; j < 6; j++) jointMotion[j] = state.axis[j] * link.velocity;
+            crossMotion(state.velocity, jointMotion, state.bias);
+
+            real momentum[6];
+            spatialTransform(state.inertia, state.velocity, momentum);
+            crossForce(state.velocity, momentum, state.force);
+
+            state.jointForce = link.drive - link.damping * link.velocity;
+        }
+        else
+        {
+            for (j = 0; j < 6; j++) state.bias[j] = state.force[j] = 0;
+            state.jointForce = 0;
+        }
+        for (j = 0; j < 6; j++) state.force[j] -= forces[i*6 + j];
+    }
+
+    // Gather the articulated inertia of each subtree from the leaves
+    // inward. Parents always come before their children.
+    for (i = (int)links.size() - 1; i >= 0; i--)
+    {
+        Link &link = links[i];
+        LinkState &state = states[i];
+
+        spatialTransform(state.inertia, state.axis, state.inertiaAxis);
+        state.jointInertia = spatialDot(state.axis, state.inertiaAxis);
+        state.jointForce -= spatialDot(state.axis, state.force);
+
+        if (link.parent < 0) continue;
+        LinkState &parent = states[link.parent];
+
+        // Pass on the inertia the joint can't move freely.
+        real inverseJointInertia = ((real)1.0) / state.jointInertia;
+        for (j = 0; j < 6; j++)
+        {
+            for (k = 0; k < 6; k++)
+            {
+                state.inertia[j*6 + k] -= state.inertiaAxis[j] *
+                    state.inertiaAxis[k] * inverseJointInertia;
+            }
+        }
+        spatialTransform(state.inertia, state.bias, temp);
+        for (j = 0; j < 36; j++) parent.inertia[j] += state.inertia[j];
+        for (j = 0; j < 6; j++)
+        {
+            parent.force[j] += state.force[j] + temp[j] +
+                state.inertiaAxis[j] * state.jointForce * inverseJointInertia;
+        }
+    }
+
+    // Then find the joint accelerations from the roots outward. The
+    // roots are joined to the world, which doesn't accelerate.
+    for (i = 0; i < (int)links.size(); i++)
+    {
+        Link &link = links[i];
+        LinkState &state = states[i];
+
+        for (j = 0; j < 6; j++)
+        {
+            state.acceleration[j] = state.bias[j];
+            if (link.parent >= 0)
+            {
+                state.acceleration[j] += states[link.parent].acceleration[j];
+            }
+        }
+
+        real jointAcceleration = (state.jointForce -
+            spatialDot(state.inertiaAxis, state.acceleration)) /
+            state.jointInertia;
+        for (j = 0; j < 6; j++)
+        {
+            state.acceleration[j] += state.axis[j] * jointAcceleration;
+        }
+        jointAccelerations[i] = jointAcceleration;
+    }
+}
+
+void Articulation::integrate(real duration)
+{
+    if (links.empty()) return;
+
+    // Make sure the spatial axes and velocities match the joints.
+    calculateLinkVelocities();
+
+    // Gather the forces on each link, about the world origin.
+    linkForces.resize(links.size() * 6);
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        RigidBody *body = links[i].body;
+        Vector3 force = body->forceAccum;
+        force.addScaledVector(body->acceleration,
+            ((real)1.0) / body->inverseMass);
+        Vector3 torque = body->torqueAccum + body->position % force;
+        setSpatial(&linkForces[i*6], torque, force);
+    }
+
+    calculateJointAccelerations(linkForces, true);
+
+    // Remember where the bodies were heading, so the acceleration
+    // they had can be reported.
+    std::vector<Vector3> lastVelocity(links.size());
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        lastVelocity[i] = links[i].body->getVelocity();
+    }
+
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        Link &link = links[i];
+        link.velocity += jointAccelerations[i] * duration;
+        link.position += link.velocity * duration;
+    }
+
+    updateLinkPositions();
+    updateLinkVelocities();
+
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        RigidBody *body = links[i].body;
+        body->lastFrameAcceleration =
+            (body->getVelocity() - lastVelocity[i]) * (((real)1.0) / duration);
+        body->clearAccumulators();
+    }
+}
+
+void Articulation::absorbVelocityChanges()
+{
+    if (links.empty()) return;
+
+    // Find the velocities the joints give each link.
+    calculateLinkVelocities();
+
+    // The difference from the bodies' velocities is the result of
+    // impulses on the free links: find those impulses, about the
+    // world origin.
+    linkForces.resize(links.size() * 6);
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        RigidBody *body = links[i].body;
+        Vector3 rotation = angularPart(states[i].velocity);
+        Vector3 velocity = linearPart(states[i].velocity) +
+            rotation % body->getPosition();
+
+        Vector3 impulse = (body->getVelocity() - velocity) *
+            (((real)1.0) / body->getInverseMass());
+        Vector3 angularImpulse = body->getInertiaTensorWorld().transform(
+            body->getRotation() - rotation);
+        setSpatial(&linkForces[i*6],
+            angularImpulse + body->getPosition() % impulse, impulse);
+    }
+
+    // Apply them to the whole articulation.
+    calculateJointAccelerations(linkForces, false);
+    for (unsigned i = 0; i < links.size(); i++)
+    {
+        links[i].velocity += jointAccelerations[i];
+    }
+    updateLinkVelocities();
+}
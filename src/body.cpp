@@ -99,6 +99,65 @@ static inline void _transformInertiaTensor(Matrix3 &iitWorld,
         t62*rotmat.data[10];
 }
 
+/**
+ * Internal function to transform a diagonal inertia tensor. The world
+ * tensor is symmetric, and each element is a sum over the three body
+ * axes, so this takes a third of the work of the general transform.
+ */
+static inline void _transformDiagonalInertiaTensor(Matrix3 &iitWorld,
+                                                   const Matrix3 &iitBody,
+                                                   const Matrix4 &rotmat)
+{
+    // Scale each row of the rotation by the body tensor.
+    real a0 = rotmat.data[0]*iitBody.data[0];
+    real a1 = rotmat.data[1]*iitBody.data[4];
+    real a2 = rotmat.data[2]*iitBody.data[8];
+    real b0 = rotmat.data[4]*iitBody.data[0];
+    real b1 = rotmat.data[5]*iitBody.data[4];
+    real b2 = rotmat.data[6]*iitBody.data[8];
+    real c0 = rotmat.data[8]*iitBody.data[0];
+    real c1 = rotmat.data[9]*iitBody.data[4];
+    real c2 = rotmat.data[10]*iitBody.data[8];
+
+    iitWorld.data[0] = a0*rotmat.data[0] + a1*rotmat.data[1] +
+        a2*rotmat.data[2];
+    iitWorld.data[1] = a0*rotmat.data[4] + a1*rotmat.data[5] +
+        a2*rotmat.data[6];
+    iitWorld.data[2] = a0*rotmat.data[8] + a1*rotmat.data[9] +
+        a2*rotmat.data[10];
+    iitWorld.data[4] = b0*rotmat.data[4] + b1*rotmat.data[5] +
+        b2*rotmat.data[6];
+    iitWorld.data[5] = b0*rotmat.data[8] + b1*rotmat.data[9] +
+        b2*rotmat.data[10];
+    iitWorld.data[8] = c0*rotmat.data[8] + c1*rotmat.data[9] +
+        c2*rotmat.data[10];
+
+    iitWorld.data[3] = iitWorld.data[1];
+    iitWorld.data[6] = iitWorld.data[2];
+    iitWorld.data[7] = iitWorld.data[5];
+}
+
+/**
+ * Internal function that works out the shape of an inverse inertia
+ * tensor in body space.
+ */
+static inline RigidBody::InertiaType _classifyInertiaTensor(
+    const Matrix3 &iitBody)
+{
+    if (iitBody.data[1] != 0 || iitBody.data[2] != 0 ||
+        iitBody.data[3] != 0 || iitBody.data[5] != 0 ||
+        iitBody.data[6] != 0 || iitBody.data[7] != 0)
+    {
+        return RigidBody::FULL_INERTIA;
+    }
+    if (iitBody.data[0] == iitBody.data[4] &&
+        iitBody.data[4] == iitBody.data[8])
+    {
+        return RigidBody::ISOTROPIC_INERTIA;
+    }
+    return RigidBody::DIAGONAL_INERTIA;
+}
+
 /**
  * Inline function that creates a transform matrix from a
  * position and orientation.
@@ -137,6 +196,23 @@ static inline void _calculateTransformMatrix(Matrix4 &transformMatrix,
  * FUNCTIONS DECLARED IN HEADER:
  * --------------------------------------------------------------------------
  */
+RigidBody::RigidBody()
+:
+transformVersion(0),
+inertiaType(ISOTROPIC_INERTIA),
+bodyType(DYNAMIC_BODY),
+isAwake(true),
+canSleep(true),
+derivedDataDirty(true),
+inverseMass(0),
+dragDuration(0),
+motion(0),
+linearDamping(1),
+angularDamping(1),
+hasTarget(false)
+{
+}
+
 void RigidBody::calculateDerivedData()
 {
     orientation.normalise();
@@ -144,25 +220,55 @@ void RigidBody::calculateDerivedData()
     // Calculate the transform matrix for the body.
     _calculateTransformMatrix(transformMatrix, position, orientation);
 
-    // Calculate the inertiaTensor in world space.
-    _transformInertiaTensor(inverseInertiaTensorWorld,
-        orientation,
-        inverseInertiaTensor,
-        transformMatrix);
+    // Calculate the inertiaTensor in world space. An isotropic tensor
+    // is the same in every orientation, so it was set along with the
+    // body space tensor.
+    switch (inertiaType)
+    {
+    case DIAGONAL_INERTIA:
+        _transformDiagonalInertiaTensor(inverseInertiaTensorWorld,
+            inverseInertiaTensor,
+            transformMatrix);
+        break;
+
+    case FULL_INERTIA:
+        _transformInertiaTensor(inverseInertiaTensorWorld,
+            orientation,
+            inverseInertiaTensor,
+            transformMatrix);
+        break;
+
+    default:
+        break;
+    }
 
+    // Anything cached from the old transform is now stale.
+    transformVersion++;
+    derivedDataDirty = false;
+}
+
+bool RigidBody::updateDerivedData()
+{
+    if (!derivedDataDirty) return false;
+    calculateDerivedData();
+    return true;
 }
 
 void RigidBody::integrate(real duration)
 {
-    if (!isAwake) return;
+    if (!isAwake || bodyType == STATIC_BODY) return;
+    if (bodyType == KINEMATIC_BODY)
+    {
+        integrateKinematic(duration);
+        return;
+    }
 
     // Calculate linear acceleration from force inputs.
     lastFrameAcceleration = acceleration;
     lastFrameAcceleration.addScaledVector(forceAccum, inverseMass);
 
     // Calculate angular acceleration from torque inputs.
-    Vector3 angularAcceleration =
-        inverseInertiaTensorWorld.transform(torqueAccum);
+    Vector3 angularAcceleration = getRotationChange(torqueAccum);
 
     // Adjust velocities
     // Update linear velocity from both acceleration and impulse.
@@ -171,9 +277,16 @@ void RigidBody::integrate(real duration)
     // Update angular velocity from both acceleration and impulse.
     rotation.addScaledVector(angularAcceleration, duration);
 
-    // Impose drag.
-    velocity *= real_pow(linearDamping, duration);
-    rotation *= real_pow(angularDamping, duration);
+    // Impose drag. The factors only change with the time step.
+    if (duration != dragDuration)
+    {
+        linearDrag = real_pow(linearDamping, duration);
+        angularDrag = real_pow(angularDamping, duration);
+        motionBias = real_pow(0.5, duration);
+        dragDuration = duration;
+    }
+    velocity *= linearDrag;
+    rotation *= angularDrag;
 
     // Adjust positions
     // Update linear position.
@@ -195,14 +308,77 @@ void RigidBody::integrate(real duration)
         real currentMotion = velocity.scalarProduct(velocity) +
             rotation.scalarProduct(rotation);
 
-        real bias = real_pow(0.5, duration);
-        motion = bias*motion + (1-bias)*currentMotion;
+        motion = motionBias*motion + (1-motionBias)*currentMotion;
 
         if (motion < sleepEpsilon) setAwake(false);
         else if (motion > 10 * sleepEpsilon) motion = 10 * sleepEpsilon;
     }
 }
 
+void RigidBody::integrateKinematic(real duration)
+{
+    // Forces have no effect on kinematic bodies.
+    lastFrameAcceleration.clear();
+    clearAccumulators();
+
+    if (hasTarget && duration > 0)
+    {
+        // Find the velocity and rotation that carry the body to its
+        // target. The rotation is the first order one the integrator
+        // uses, so that integrating it would reach the target too.
+        Quaternion change = targetOrientation;
+        change *= Quaternion(orientation.r,
+            -orientation.i, -orientation.j, -orientation.k);
+
+        // Take the shorter way round.
+        real scale = ((real)2.0 / duration);
+        if (change.r < 0) scale = -scale;
+
+        velocity = (targetPosition - position) * ((real)1.0 / duration);
+        rotation = Vector3(change.i, change.j, change.k) * scale;
+
+        position = targetPosition;
+        orientation = targetOrientation;
+        hasTarget = false;
+    }
+    else
+    {
+        position.addScaledVector(velocity, duration);
+        orientation.addScaledVector(rotation, duration);
+    }
+
+    calculateDerivedData();
+}
+
+void RigidBody::setBodyType(BodyType bodyType)
+{
+    RigidBody::bodyType = bodyType;
+    hasTarget = false;
+    if (bodyType == DYNAMIC_BODY) return;
+
+    inverseMass = 0;
+    setInverseInertiaTensor(Matrix3());
+    if (bodyType == STATIC_BODY)
+    {
+        canSleep = true;
+        setAwake(false);
+    }
+    else
+    {
+        setCanSleep(false);
+        setAwake();
+    }
+}
+
+void RigidBody::setKinematicTarget(const Vector3 &position,
+                                   const Quaternion &orientation)
+{
+    targetPosition = position;
+    targetOrientation = orientation;
+    targetOrientation.normalise();
+    hasTarget = true;
+}
+
 void RigidBody::setMass(const real mass)
 {
     assert(mass != 0);
@@ -235,8 +411,9 @@ bool RigidBody::hasFiniteMass() const
 
 void RigidBody::setInertiaTensor(const Matrix3 &inertiaTensor)
 {
+    Matrix3 inverseInertiaTensor;
     inverseInertiaTensor.setInverse(inertiaTensor);
-    _checkInverseInertiaTensor(inverseInertiaTensor);
+    setInverseInertiaTensor(inverseInertiaTensor);
 }
 
 void RigidBody::getInertiaTensor(Matrix3 *inertiaTensor) const
@@ -267,6 +444,16 @@ void RigidBody::setInverseInertiaTensor(const Matrix3 &inverseInertiaTensor)
 {
     _checkInverseInertiaTensor(inverseInertiaTensor);
     RigidBody::inverseInertiaTensor = inverseInertiaTensor;
+
+    inertiaType = _classifyInertiaTensor(inverseInertiaTensor);
+    if (inertiaType == ISOTROPIC_INERTIA)
+    {
+        inverseInertiaTensorWorld = inverseInertiaTensor;
+    }
+    else
+    {
+        derivedDataDirty = true;
+    }
 }
 
 void RigidBody::getInverseInertiaTensor(Matrix3 *inverseInertiaTensor) const
@@ -289,16 +476,32 @@ Matrix3 RigidBody::getInverseInertiaTensorWorld() const
     return inverseInertiaTensorWorld;
 }
 
+RigidBody::InertiaType RigidBody::getInertiaType() const
+{
+    return inertiaType;
+}
+
+Vector3 RigidBody::getRotationChange(const Vector3 &impulsiveTorque) const
+{
+    if (inertiaType == ISOTROPIC_INERTIA)
+    {
+        return impulsiveTorque * inverseInertiaTensorWorld.data[0];
+    }
+    return inverseInertiaTensorWorld.transform(impulsiveTorque);
+}
+
 void RigidBody::setDamping(const real linearDamping,
                const real angularDamping)
 {
     RigidBody::linearDamping = linearDamping;
     RigidBody::angularDamping = angularDamping;
+    dragDuration = 0;
 }
 
 void RigidBody::setLinearDamping(const real linearDamping)
 {
     RigidBody::linearDamping = linearDamping;
+    dragDuration = 0;
 }
 
 real RigidBody::getLinearDamping() const
@@ -309,6 +512,7 @@ real RigidBody::getLinearDamping() const
 void RigidBody::setAngularDamping(const real angularDamping)
 {
     RigidBody::angularDamping = angularDamping;
+    dragDuration = 0;
 }
 
 real RigidBody::getAngularDamping() const
@@ -319,6 +523,8 @@ real RigidBody::getAngularDamping() const
 void RigidBody::setPosition(const Vector3 &position)
 {
     RigidBody::position = position;
+    transformVersion++;
+    derivedDataDirty = true;
 }
 
 void RigidBody::setPosition(const real x, const real y, const real z)
@@ -326,6 +532,8 @@ void RigidBody::setPosition(const real x, const real y, const real z)
     position.x = x;
     position.y = y;
     position.z = z;
+    transformVersion++;
+    derivedDataDirty = true;
 }
 
 void RigidBody::getPosition(Vector3 *position) const
@@ -342,6 +550,8 @@ void RigidBody::setOrientation(const Quaternion &orientation)
 {
     RigidBody::orientation = orientation;
     RigidBody::orientation.normalise();
+    transformVersion++;
+    derivedDataDirty = true;
 }
 
 void RigidBody::setOrientation(const real r, const real i,
@@ -352,6 +562,8 @@ void RigidBody::setOrientation(const real r, const real i,
     orientation.j = j;
     orientation.k = k;
     orientation.normalise();
+    transformVersion++;
+    derivedDataDirty = true;
 }
 
 void RigidBody::getOrientation(Quaternion *orientation) const
@@ -502,6 +714,9 @@ void RigidBody::addRotation(const Vector3 &deltaRotation)
 
 void RigidBody::setAwake(const bool awake)
 {
+    // Static bodies are never woken.
+    if (awake && bodyType == STATIC_BODY) return;
+
     if (awake) {
         isAwake= true;
 
@@ -541,7 +756,9 @@ void RigidBody::clearAccumulators()
 void RigidBody::addForce(const Vector3 &force)
 {
     forceAccum += force;
-    isAwake = true;
+
+    // Static bodies are never woken.
+    if (bodyType != STATIC_BODY) isAwake = true;
 }
 
 void RigidBody::addForceAtBodyPoint(const Vector3 &force,
@@ -550,8 +767,6 @@ void RigidBody::addForceAtBodyPoint(const Vector3 &force,
     // Convert to coordinates relative to center of mass.
     Vector3 pt = getPointInWorldSpace(point);
     addForceAtPoint(force, pt);
-
-    isAwake = true;
 }
 
 void RigidBody::addForceAtPoint(const Vector3 &force,
@@ -564,13 +779,14 @@ void RigidBody::addForceAtPoint(const Vector3 &force,
     forceAccum += force;
     torqueAccum += pt % force;
 
-    isAwake = true;
+    if (bodyType != STATIC_BODY) isAwake = true;
 }
 
 void RigidBody::addTorque(const Vector3 &torque)
 {
     torqueAccum += torque;
-    isAwake = true;
+
+    if (bodyType != STATIC_BODY) isAwake = true;
 }
 
 void RigidBody::setAcceleration(const Vector3 &acceleration)
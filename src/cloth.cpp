@@ -0,0 +1,486 @@
+/*
+ * Implementation file for cloth and soft bodies.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include <cyclone/cyclone.h>
+#include <assert.h>
+
+using namespace cyclone;
+
+Cloth::Cloth()
+:
+damping(1),
+maxIterations(50),
+tolerance((real)0.0001),
+thickness((real)0.01),
+friction((real)0.2),
+iterationsUsed(0)
+{
+}
+
+unsigned Cloth::addMass(const Vector3 &position, real inverseMass)
+{
+    positions.push_back(position);
+    velocities.push_back(Vector3());
+    inverseMasses.push_back(inverseMass);
+    forceAccums.push_back(Vector3());
+    return (unsigned)positions.size() - 1;
+}
+
+unsigned Cloth::addSpring(unsigned first, unsigned second,
+                          real stiffness, real damping)
+{
+    assert(first < positions.size() && second < positions.size());
+
+    springEnds.push_back(first);
+    springEnds.push_back(second);
+    restLengths.push_back((positions[first] - positions[second]).magnitude());
+    stiffnesses.push_back(stiffness);
+    dampings.push_back(damping);
+    return (unsigned)restLengths.size() - 1;
+}
+
+unsigned Cloth::addSheet(const Vector3 &origin, const Vector3 &columnStep,
+                         const Vector3 &rowStep, unsigned columns,
+                         unsigned rows, real totalMass, real stiffness,
+                         real damping, real bendStiffness)
+{
+    assert(columns > 0 && rows > 0 && totalMass > 0);
+
+    unsigned first = (unsigned)positions.size();
+    real inverseMass = (real)(columns * rows) / totalMass;
+    for (unsigned row = 0; row < rows; row++)
+    {
+        for (unsigned column = 0; column < columns; column++)
+        {
+            addMass(origin + columnStep * (real)column + rowStep * (real)row,
+                inverseMass);
+        }
+    }
+
+    for (unsigned row = 0; row < rows; row++)
+    {
+        for (unsigned column = 0; column < columns; column++)
+        {
+            unsigned index = first + row * columns + column;
+
+            // Stretch springs to the next mass along and down.
+            if (column + 1 < columns)
+            {
+                addSpring(index, index + 1, stiffness, damping);
+            }
+            if (row + 1 < rows)
+            {
+                addSpring(index, index + columns, stiffness, damping);
+            }
+
+            // Shear springs across each square.
+            if (column + 1 < columns && row + 1 < rows)
+            {
+                addSpring(index, index + columns + 1, stiffness, damping);
+                addSpring(index + 1, index + columns, stiffness, damping);
+            }
+
+            // Bending springs to the masses two along and two down.
+            if (column + 2 < columns)
+            {
+                addSpring(index, index + 2, bendStiffness, damping);
+            }
+            if (row + 2 < rows)
+            {
+                addSpring(index, index + columns * 2, bendStiffness, damping);
+            }
+        }
+    }
+
+    return first;
+}
+
+unsigned Cloth::getMassCount() const
+{
+    return (unsigned)positions.size();
+}
+
+unsigned Cloth::getSpringCount() const
+{
+    return (unsigned)restLengths.size();
+}
+
+const Vector3& Cloth::getPosition(unsigned index) const
+{
+    return positions[index];
+}
+
+void Cloth::setPosition(unsigned index, const Vector3 &position)
+{
+    positions[index] = position;
+}
+
+const Vector3& Cloth::getVelocity(unsigned index) const
+{
+    return velocities[index];
+}
+
+void Cloth::setVelocity(unsigned index, const Vector3 &velocity)
+{
+    velocities[index] = velocity;
+}
+
+real Cloth::getInverseMass(unsigned index) const
+{
+    return inverseMasses[index];
+}
+
+void Cloth::setInverseMass(unsigned index, real inverseMass)
+{
+    inverseMasses[index] = inverseMass;
+}
+
+void Cloth::getSpringEnds(unsigned spring, unsigned *first,
+                          unsigned *second) const
+{
+    *first = springEnds[spring*2];
+    *second = springEnds[spring*2 + 1];
+}
+
+void Cloth::addForce(unsigned index, const Vector3 &force)
+{
+    forceAccums[index] += force;
+}
+
+void Cloth::setAcceleration(const Vector3 &acceleration)
+{
+    Cloth::acceleration = acceleration;
+}
+
+void Cloth::setDamping(real damping)
+{
+    Cloth::damping = damping;
+}
+
+void Cloth::setSolverIterations(unsigned maxIterations, real tolerance)
+{
+    Cloth::maxIterations = maxIterations;
+    Cloth::tolerance = tolerance;
+}
+
+unsigned Cloth::getIterationsUsed() const
+{
+    return iterationsUsed;
+}
+
+void Cloth::setCollisionResponse(real thickness, real friction)
+{
+    Cloth::thickness = thickness;
+    Cloth::friction = friction;
+}
+
+void Cloth::addCollisionPlane(const CollisionPlane *plane)
+{
+    planes.push_back(plane);
+}
+
+void Cloth::addCollisionSphere(const CollisionSphere *sphere)
+{
+    spheres.push_back(sphere);
+}
+
+void Cloth::addCollisionBox(const CollisionBox *box)
+{
+    boxes.push_back(box);
+}
+
+void Cloth::clearCollisionPrimitives()
+{
+    planes.clear();
+    spheres.clear();
+    boxes.clear();
+}
+
+void Cloth::multiply(const std::vector<Vector3> &vector,
+                     std::vector<Vector3> &result) const
+{
+    unsigned numMasses = (unsigned)positions.size();
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        result[i] = inverseMasses[i] > 0 ?
+            vector[i] * (((real)1.0) / inverseMasses[i]) : Vector3();
+    }
+
+    for (unsigned s = 0; s < restLengths.size(); s++)
+    {
+        unsigned i = springEnds[s*2], j = springEnds[s*2 + 1];
+        Vector3 change = springMatrices[s].transform(vector[i] - vector[j]);
+        result[i] += change;
+        result[j] -= change;
+    }
+
+    // Pinned masses don't take part.
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        if (inverseMasses[i] <= 0) result[i].clear();
+    }
+}
+
+void Cloth::integrate(real duration)
+{
+    unsigned numMasses = (unsigned)positions.size();
+    unsigned numSprings = (unsigned)restLengths.size();
+    if (numMasses == 0) return;
+
+    assert(duration > 0.0);
+
+    velocityChanges.assign(numMasses, Vector3());
+    residuals.resize(numMasses);
+    directions.resize(numMasses);
+    products.resize(numMasses);
+    preconditioner.resize(numMasses);
+    springMatrices.resize(numSprings);
+
+    // Start with the applied forces and gravity.
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        if (inverseMasses[i] > 0)
+        {
+            real mass = ((real)1.0) / inverseMasses[i];
+            residuals[i] = forceAccums[i] + acceleration * mass;
+            preconditioner[i] = mass;
+        }
+        else
+        {
+            residuals[i].clear();
+            preconditioner[i] = 1;
+        }
+    }
+
+    // Add the spring forces, and work out how each spring's force
+    // changes with position and velocity. The backward Euler step
+    // solves (M - h dF/dv - h^2 dF/dx) dv = h (F + h dF/dx v).
+    real squareDuration = duration * duration;
+    for (unsigned s = 0; s < numSprings; s++)
+    {
+        unsigned i = springEnds[s*2], j = springEnds[s*2 + 1];
+        Vector3 delta = positions[i] - positions[j];
+        real length = delta.magnitude();
+        if (length <= 0)
+        {
+            springMatrices[s] = Matrix3();
+            continue;
+        }
+
+        Vector3 normal = delta * (((real)1.0) / length);
+        Vector3 relativeVelocity = velocities[i] - velocities[j];
+        real closingSpeed = relativeVelocity * normal;
+
+        Vector3 force = normal * (-stiffnesses[s] * (length - restLengths[s])
+            - dampings[s] * closingSpeed);
+
+        // A stretched spring also resists turning. A compressed one
+        // would push sideways, which makes the system indefinite, so
+        // that part is left out.
+        real transverse = length > restLengths[s] ?
+            1 - restLengths[s] / length : 0;
+
+        // The force will also change over the step as the ends keep
+        // moving (the h dF/dx v term).
+        Vector3 positionTerm = (normal * closingSpeed +
+            (relativeVelocity - normal * closingSpeed) * transverse) *
+            (-stiffnesses[s] * duration);
+        force += positionTerm;
+        residuals[i] += force;
+        residuals[j] -= force;
+
+        // The spring's part of the system matrix is
+        // a n n^T + b I, with a and b from its stiffness and damping.
+        real along = dampings[s] * duration +
+            stiffnesses[s] * squareDuration * (1 - transverse);
+        real across = stiffnesses[s] * squareDuration * transverse;
+        Matrix3 &matrix = springMatrices[s];
+        for (unsigned row = 0; row < 3; row++)
+        {
+            for (unsigned col = 0; col < 3; col++)
+            {
+                matrix.data[row*3 + col] = along * normal[row] * normal[col];
+            }
+            matrix.data[row*3 + row] += across;
+        }
+
+        real diagonal = along / 3 + across;
+        preconditioner[i] += diagonal;
+        preconditioner[j] += diagonal;
+    }
+
+    real squareNorm = 0;
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        if (inverseMasses[i] > 0) residuals[i] *= duration;
+        else residuals[i].clear();
+        squareNorm += residuals[i].squareMagnitude();
+    }
+
+    // Solve for the change in velocity with preconditioned conjugate
+    // gradients, starting from no change.
+    real threshold = squareNorm * tolerance * tolerance;
+    real residualDotPreconditioned = 0;
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        directions[i] = residuals[i] * (((real)1.0) / preconditioner[i]);
+        residualDotPreconditioned += residuals[i] * directions[i];
+    }
+
+    for (iterationsUsed = 0; iterationsUsed < maxIterations;
+        iterationsUsed++)
+    {
+        if (squareNorm <= threshold) break;
+
+        multiply(directions, products);
+        real curvature = 0;
+        for (unsigned i = 0; i < numMasses; i++)
+        {
+            curvature += directions[i] * products[i];
+        }
+        if (curvature <= 0) break;
+
+        real step = residualDotPreconditioned / curvature;
+        real newDot = 0;
+        squareNorm = 0;
+        for (unsigned i = 0; i < numMasses; i++)
+        {
+            velocityChanges[i].addScaledVector(directions[i], step);
+            residuals[i].addScaledVector(products[i], -step);
+            squareNorm += residuals[i].squareMagnitude();
+            newDot += residuals[i] * residuals[i] *
+                (((real)1.0) / preconditioner[i]);
+        }
+
+        real ratio = newDot / residualDotPreconditioned;
+        residualDotPreconditioned = newDot;
+        for (unsigned i = 0; i < numMasses; i++)
+        {
+            directions[i] = residuals[i] * (((real)1.0) / preconditioner[i]) +
+                directions[i] * ratio;
+        }
+    }
+
+    // Update the velocities, then move with them.
+    real drag = real_pow(damping, duration);
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        if (inverseMasses[i] <= 0) continue;
+
+        velocities[i] += velocityChanges[i];
+        velocities[i] *= drag;
+        positions[i].addScaledVector(velocities[i], duration);
+    }
+
+    collide();
+
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        forceAccums[i].clear();
+    }
+}
+
+/*
+ * Returns the velocity of the given point on the given primitive's
+ * body.
+ */
+static Vector3 surfaceVelocity(const CollisionPrimitive *primitive,
+                               const Vector3 &point)
+{
+    RigidBody *body = primitive->body;
+    if (!body) return Vector3();
+    return body->getVelocity() +
+        body->getRotation() % (point - body->getPosition());
+}
+
+void Cloth::resolveCollision(unsigned index, const Vector3 &normal,
+                             real penetration,
+                             const Vector3 &surfaceVelocity)
+{
+    positions[index].addScaledVector(normal, penetration);
+
+    // Work relative to the surface.
+    Vector3 velocity = velocities[index] - surfaceVelocity;
+    real normalSpeed = velocity * normal;
+    if (normalSpeed < 0) velocity.addScaledVector(normal, -normalSpeed);
+
+    // Then slow any sliding.
+    Vector3 sliding = velocity - normal * (velocity * normal);
+    velocity.addScaledVector(sliding, -friction);
+
+    velocities[index] = surfaceVelocity + velocity;
+}
+
+void Cloth::collide()
+{
+    unsigned numMasses = (unsigned)positions.size();
+    for (unsigned i = 0; i < numMasses; i++)
+    {
+        if (inverseMasses[i] <= 0) continue;
+
+        for (unsigned p = 0; p < planes.size(); p++)
+        {
+            const CollisionPlane *plane = planes[p];
+            real distance = positions[i] * plane->direction -
+                plane->offset - thickness;
+            if (distance < 0)
+            {
+                resolveCollision(i, plane->direction, -distance, Vector3());
+            }
+        }
+
+        for (unsigned s = 0; s < spheres.size(); s++)
+        {
+            const CollisionSphere *sphere = spheres[s];
+            Vector3 delta = positions[i] - sphere->getAxis(3);
+            real distance = delta.magnitude();
+            real penetration = sphere->radius + thickness - distance;
+            if (penetration > 0 && distance > 0)
+            {
+                resolveCollision(i, delta * (((real)1.0) / distance),
+                    penetration, surfaceVelocity(sphere, positions[i]));
+            }
+        }
+
+        for (unsigned b = 0; b < boxes.size(); b++)
+        {
+            const CollisionBox *box = boxes[b];
+            Vector3 local = box->getTransform().transformInverse(positions[i]);
+
+            // Find the face the mass is closest to getting out of.
+            unsigned bestAxis = 3;
+            real bestPenetration = REAL_MAX;
+            for (unsigned axis = 0; axis < 3; axis++)
+            {
+                real penetration = box->halfSize[axis] + thickness -
+                    real_abs(local[axis]);
+                if (penetration <= 0)
+                {
+                    bestAxis = 3;
+                    break;
+                }
+                if (penetration < bestPenetration)
+                {
+                    bestPenetration = penetration;
+                    bestAxis = axis;
+                }
+            }
+            if (bestAxis == 3) continue;
+
+            Vector3 normal = box->getAxis(bestAxis);
+            normal.normalise();
+            if (local[bestAxis] < 0) normal.invert();
+            resolveCollision(i, normal, bestPenetration,
+                surfaceVelocity(box, positions[i]));
+        }
+    }
+}
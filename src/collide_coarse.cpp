@@ -12,6 +12,8 @@
 
 
 #include <cyclone/collide_coarse.h>
+#include <cyclone/collide_fine.h>
+#include <algorithm>
 
 using namespace cyclone;
 
@@ -75,4 +77,445 @@ real BoundingSphere::getGrowth(const BoundingSphere &other) const
     // We return a value proportional to the change in surface
     // area of the sphere.
     return newSphere.radius*newSphere.radius - radius*radius;
-}
\ No newline at end of file
+}
+
+BoundingBox::BoundingBox(const Vector3 &centre, const Vector3 &halfSize)
+{
+    BoundingBox::centre = centre;
+    BoundingBox::halfSize = halfSize;
+}
+
+BoundingBox::BoundingBox(const BoundingBox &one, const BoundingBox &two)
+{
+    // Find the extremes of both boxes on each axis, and centre the
+    // new box between them.
+    for (unsigned i = 0; i < 3; i++)
+    {
+        real low = one.centre[i] - one.halfSize[i];
+        real high = one.centre[i] + one.halfSize[i];
+
+        real otherLow = two.centre[i] - two.halfSize[i];
+        real otherHigh = two.centre[i] + two.halfSize[i];
+
+        if (otherLow < low) low = otherLow;
+        if (otherHigh > high) high = otherHigh;
+
+        centre[i] = (low + high) * ((real)0.5);
+        halfSize[i] = (high - low) * ((real)0.5);
+    }
+}
+
+bool BoundingBox::overlaps(const BoundingBox *other) const
+{
+    // Boxes overlap only if they overlap on all three axes
+    Vector3 distance = centre - other->centre;
+    return
+        real_abs(distance.x) <= halfSize.x + other->halfSize.x &&
+        real_abs(distance.y) <= halfSize.y + other->halfSize.y &&
+        real_abs(distance.z) <= halfSize.z + other->halfSize.z;
+}
+
+real BoundingBox::getGrowth(const BoundingBox &other) const
+{
+    BoundingBox newBox(*this, other);
+
+    // We return a value proportional to the change in surface
+    // area of the box.
+    return
+        (newBox.halfSize.x * newBox.halfSize.y +
+         newBox.halfSize.y * newBox.halfSize.z +
+         newBox.halfSize.z * newBox.halfSize.x) -
+        (halfSize.x * halfSize.y +
+         halfSize.y * halfSize.z +
+         halfSize.z * halfSize.x);
+}
+
+/**
+ * Internal function that returns the low end of a primitive's
+ * bounding box along the x axis.
+ */
+static inline real _lowX(const CollisionPrimitive *primitive)
+{
+    const BoundingBox &box = primitive->getBoundingBox();
+    return box.centre.x - box.halfSize.x;
+}
+
+/**
+ * Internal function that checks if a contact between the two bodies
+ * could change anything: one must be dynamic, and one awake.
+ */
+static inline bool _canRespond(const RigidBody *one, const RigidBody *two)
+{
+    return (one->getBodyType() == RigidBody::DYNAMIC_BODY ||
+            two->getBodyType() == RigidBody::DYNAMIC_BODY) &&
+        (one->getAwake() || two->getAwake());
+}
+
+/**
+ * Orders static primitives by the centre of the bounding boxes they
+ * were added with, along one axis.
+ */
+struct BroadPhase::CentreOrder
+{
+    unsigned axis;
+
+    bool operator()(const StaticPrimitive &one,
+                    const StaticPrimitive &two) const
+    {
+        return one.volume.centre[axis] < two.volume.centre[axis];
+    }
+};
+
+BroadPhase::BroadPhase()
+:
+staticTreeValid(true),
+movingMaxWidth(0)
+{
+}
+
+void BroadPhase::add(CollisionPrimitive *primitive)
+{
+    if (primitive->body->getBodyType() == RigidBody::STATIC_BODY)
+    {
+        // Static primitives never move, so their bounding boxes are
+        // only needed once.
+        primitive->calculateInternals();
+
+        StaticPrimitive item;
+        item.primitive = primitive;
+        item.volume = primitive->getBoundingBox();
+        staticPrimitives.push_back(item);
+        staticTreeValid = false;
+    }
+    else
+    {
+        movingPrimitives.push_back(primitive);
+    }
+}
+
+bool BroadPhase::remove(CollisionPrimitive *primitive)
+{
+    for (unsigned i = 0; i < movingPrimitives.size(); i++)
+    {
+        if (movingPrimitives[i] == primitive)
+        {
+            movingPrimitives.erase(movingPrimitives.begin() + i);
+            return true;
+        }
+    }
+    for (unsigned i = 0; i < staticPrimitives.size(); i++)
+    {
+        if (staticPrimitives[i].primitive == primitive)
+        {
+            staticPrimitives.erase(staticPrimitives.begin() + i);
+            staticTreeValid = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned BroadPhase::getStaticCount() const
+{
+    return (unsigned)staticPrimitives.size();
+}
+
+unsigned BroadPhase::getMovingCount() const
+{
+    return (unsigned)movingPrimitives.size();
+}
+
+void BroadPhase::buildStaticTree()
+{
+    staticTree.clear();
+    if (!staticPrimitives.empty())
+    {
+        buildStaticNode(0, (unsigned)staticPrimitives.size());
+    }
+    staticTreeValid = true;
+}
+
+void BroadPhase::buildStaticNode(unsigned first, unsigned count)
+{
+    unsigned index = (unsigned)staticTree.size();
+    staticTree.push_back(StaticNode());
+
+    BoundingBox volume = staticPrimitives[first].volume;
+    for (unsigned i = first + 1; i < first + count; i++)
+    {
+        volume = BoundingBox(volume, staticPrimitives[i].volume);
+    }
+    staticTree[index].volume = volume;
+
+    if (count <= STATIC_LEAF_SIZE)
+    {
+        staticTree[index].first = first;
+        staticTree[index].count = count;
+        return;
+    }
+
+    // Split the primitives in half along the longest axis, ordering
+    // them by the boxes they were added with.
+    CentreOrder order;
+    order.axis = 0;
+    if (volume.halfSize.y > volume.halfSize[order.axis]) order.axis = 1;
+    if (volume.halfSize.z > volume.halfSize[order.axis]) order.axis = 2;
+
+    unsigned half = count / 2;
+    std::nth_element(staticPrimitives.begin() + first,
+                     staticPrimitives.begin() + first + half,
+                     staticPrimitives.begin() + first + count,
+                     order);
+
+    buildStaticNode(first, half);
+    staticTree[index].first = (unsigned)staticTree.size();
+    staticTree[index].count = 0;
+    buildStaticNode(first + half, count - half);
+}
+
+unsigned BroadPhase::findStaticCollisions(CollisionPrimitive *primitive,
+                                          PotentialCollision *pairs,
+                                          unsigned limit) const
+{
+    if (staticTree.empty()) return 0;
+    const BoundingBox &box = primitive->getBoundingBox();
+
+    // Walk the tree with a stack of the nodes still to visit. The
+    // tree is balanced, so this can't overflow.
+    unsigned stack[64];
+    unsigned top = 0;
+    unsigned count = 0;
+    stack[top++] = 0;
+    while (top > 0 && count < limit)
+    {
+        unsigned index = stack[--top];
+        const StaticNode &node = staticTree[index];
+        if (!box.overlaps(&node.volume)) continue;
+
+        if (node.count == 0)
+        {
+            stack[top++] = node.first;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (unsigned i = node.first;
+             i < node.first + node.count && count < limit; i++)
+        {
+            if (!box.overlaps(&staticPrimitives[i].volume)) continue;
+            pairs[count].primitive[0] = primitive;
+            pairs[count].primitive[1] = staticPrimitives[i].primitive;
+            count++;
+        }
+    }
+    return count;
+}
+
+void BroadPhase::sortMovingPrimitives()
+{
+    // The primitives move little between searches, so an insertion
+    // sort takes close to linear time.
+    movingMaxWidth = 0;
+    for (unsigned i = 0; i < movingPrimitives.size(); i++)
+    {
+        CollisionPrimitive *primitive = movingPrimitives[i];
+        real width = primitive->getBoundingBox().halfSize.x * 2;
+        if (width > movingMaxWidth) movingMaxWidth = width;
+        if (i == 0) continue;
+
+        real low = _lowX(primitive);
+        unsigned j = i;
+        while (j > 0 && _lowX(movingPrimitives[j-1]) > low)
+        {
+            movingPrimitives[j] = movingPrimitives[j-1];
+            j--;
+        }
+        movingPrimitives[j] = primitive;
+    }
+}
+
+unsigned BroadPhase::findPotentialCollisions(PotentialCollision *pairs,
+                                             unsigned limit)
+{
+    if (!staticTreeValid) buildStaticTree();
+    sortMovingPrimitives();
+
+    unsigned count = 0;
+    for (unsigned i = 0; i < movingPrimitives.size() && count < limit; i++)
+    {
+        CollisionPrimitive *primitive = movingPrimitives[i];
+        const BoundingBox &box = primitive->getBoundingBox();
+        real high = box.centre.x + box.halfSize.x;
+
+        // Sweep over the primitives that start before this one ends.
+        for (unsigned j = i + 1;
+             j < movingPrimitives.size() && count < limit; j++)
+        {
+            CollisionPrimitive *other = movingPrimitives[j];
+            if (_lowX(other) > high) break;
+            if (!_canRespond(primitive->body, other->body)) continue;
+            if (!box.overlaps(&other->getBoundingBox())) continue;
+
+            pairs[count].primitive[0] = primitive;
+            pairs[count].primitive[1] = other;
+            count++;
+        }
+
+        // Only awake dynamic primitives can respond to the scenery.
+        if (primitive->body->getBodyType() == RigidBody::DYNAMIC_BODY &&
+            primitive->body->getAwake())
+        {
+            count += findStaticCollisions(primitive, pairs + count,
+                                          limit - count);
+        }
+    }
+    return count;
+}
+
+unsigned BroadPhase::findMovingPrimitives(const BoundingBox &volume,
+                                          CollisionPrimitive **found,
+                                          unsigned limit)
+{
+    // Searches leave the primitives in order, so a search made in
+    // the same frame as the pair search costs little more than the
+    // primitives it passes over.
+    sortMovingPrimitives();
+
+    // No primitive is wider than the widest, so the search can start
+    // from the first one that could reach the box.
+    real low = volume.centre.x - volume.halfSize.x - movingMaxWidth;
+    real high = volume.centre.x + volume.halfSize.x;
+    unsigned first = 0, last = (unsigned)movingPrimitives.size();
+    while (first < last)
+    {
+        unsigned middle = (first + last) / 2;
+        if (_lowX(movingPrimitives[middle]) < low) first = middle + 1;
+        else last = middle;
+    }
+
+    unsigned count = 0;
+    for (unsigned i = first; i < movingPrimitives.size() && count < limit; i++)
+    {
+        CollisionPrimitive *primitive = movingPrimitives[i];
+        if (_lowX(primitive) > high) break;
+        if (!volume.overlaps(&primitive->getBoundingBox())) continue;
+        found[count++] = primitive;
+    }
+    return count;
+}
+
+void BroadPhase::addHalfSpace(const CollisionPlane &plane)
+{
+    halfSpaceDirections.push_back(plane.direction);
+    halfSpaceOffsets.push_back(plane.offset);
+}
+
+void BroadPhase::clearHalfSpaces()
+{
+    halfSpaceDirections.clear();
+    halfSpaceOffsets.clear();
+}
+
+unsigned BroadPhase::getHalfSpaceCount() const
+{
+    return (unsigned)halfSpaceOffsets.size();
+}
+
+void BroadPhase::shiftOrigin(const Vector3 &offset)
+{
+    for (unsigned i = 0; i < staticPrimitives.size(); i++)
+    {
+        staticPrimitives[i].primitive->calculateInternals();
+        staticPrimitives[i].volume.centre -= offset;
+    }
+    for (unsigned i = 0; i < staticTree.size(); i++)
+    {
+        staticTree[i].volume.centre -= offset;
+    }
+
+    // Moving the origin by the offset moves each plane back along
+    // its normal by the offset's component in that direction.
+    for (unsigned i = 0; i < halfSpaceOffsets.size(); i++)
+    {
+        halfSpaceOffsets[i] -= halfSpaceDirections[i] * offset;
+    }
+}
+
+unsigned BroadPhase::findHalfSpaceContacts(CollisionData *data)
+{
+    if (halfSpaceOffsets.empty()) return 0;
+
+    // Gather the bounding boxes of the primitives that can respond
+    // to a half-space into flat arrays.
+    candidates.clear();
+    for (unsigned i = 0; i < movingPrimitives.size(); i++)
+    {
+        RigidBody *body = movingPrimitives[i]->body;
+        if (body->getBodyType() == RigidBody::DYNAMIC_BODY &&
+            body->getAwake())
+        {
+            candidates.push_back(movingPrimitives[i]);
+        }
+    }
+    unsigned count = (unsigned)candidates.size();
+    if (count == 0) return 0;
+
+    for (unsigned axis = 0; axis < 3; axis++)
+    {
+        candidateCentres[axis].resize(count);
+        candidateHalfSizes[axis].resize(count);
+    }
+    candidateDepths.resize(count);
+    real *cx = &candidateCentres[0][0];
+    real *cy = &candidateCentres[1][0];
+    real *cz = &candidateCentres[2][0];
+    real *hx = &candidateHalfSizes[0][0];
+    real *hy = &candidateHalfSizes[1][0];
+    real *hz = &candidateHalfSizes[2][0];
+    for (unsigned i = 0; i < count; i++)
+    {
+        const BoundingBox &box = candidates[i]->getBoundingBox();
+        cx[i] = box.centre.x;
+        cy[i] = box.centre.y;
+        cz[i] = box.centre.z;
+        hx[i] = box.halfSize.x;
+        hy[i] = box.halfSize.y;
+        hz[i] = box.halfSize.z;
+    }
+
+    unsigned used = 0;
+    real *depths = &candidateDepths[0];
+    for (unsigned p = 0; p < halfSpaceOffsets.size(); p++)
+    {
+        // Copy the plane into locals, so the compiler knows writing
+        // the depths can't change it.
+        const real nx = halfSpaceDirections[p].x;
+        const real ny = halfSpaceDirections[p].y;
+        const real nz = halfSpaceDirections[p].z;
+        const real ax = real_abs(nx);
+        const real ay = real_abs(ny);
+        const real az = real_abs(nz);
+        const real offset = halfSpaceOffsets[p];
+
+        // The box reaches the half-space if its corner furthest along
+        // the inward normal is below the plane. This loop has no
+        // branches, so the compiler can vectorise it.
+        for (unsigned i = 0; i < count; i++)
+        {
+            depths[i] = offset - (cx[i]*nx + cy[i]*ny + cz[i]*nz) +
+                (hx[i]*ax + hy[i]*ay + hz[i]*az);
+        }
+
+        // Only the primitives that reach it get the full test.
+        CollisionPlane plane;
+        plane.direction = halfSpaceDirections[p];
+        plane.offset = offset;
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (depths[i] < 0) continue;
+            if (data->contactsLeft <= 0) return used;
+            used += candidates[i]->collideHalfSpace(plane, data);
+        }
+    }
+    return used;
+}
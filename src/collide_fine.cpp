@@ -21,7 +21,59 @@ using namespace cyclone;
 
 void CollisionPrimitive::calculateInternals()
 {
+    // Nothing to do if the body hasn't moved since we last looked.
+    if (body == cachedBody &&
+        body->getTransformVersion() == cachedVersion) return;
+
     transform = body->getTransform() * offset;
+    calculateBoundingBox();
+
+    cachedBody = body;
+    cachedVersion = body->getTransformVersion();
+}
+
+void CollisionPrimitive::calculateBoundingBox()
+{
+    boundingBox.centre = transform.getAxisVector(3);
+    boundingBox.halfSize.clear();
+}
+
+unsigned CollisionPrimitive::collideHalfSpace(const CollisionPlane & /*plane*/,
+                                              CollisionData * /*data*/) const
+{
+    return 0;
+}
+
+unsigned CollisionSphere::collideHalfSpace(const CollisionPlane &plane,
+                                           CollisionData *data) const
+{
+    return CollisionDetector::sphereAndHalfSpace(*this, plane, data);
+}
+
+unsigned CollisionBox::collideHalfSpace(const CollisionPlane &plane,
+                                        CollisionData *data) const
+{
+    return CollisionDetector::boxAndHalfSpace(*this, plane, data);
+}
+
+void CollisionSphere::calculateBoundingBox()
+{
+    boundingBox.centre = transform.getAxisVector(3);
+    boundingBox.halfSize = Vector3(radius, radius, radius);
+}
+
+void CollisionBox::calculateBoundingBox()
+{
+    // The extent on each world axis is the half-size projected
+    // through the absolute values of the rotation.
+    boundingBox.centre = transform.getAxisVector(3);
+    for (unsigned i = 0; i < 3; i++)
+    {
+        boundingBox.halfSize[i] =
+            halfSize.x * real_abs(transform.data[i*4]) +
+            halfSize.y * real_abs(transform.data[i*4+1]) +
+            halfSize.z * real_abs(transform.data[i*4+2]);
+    }
 }
 
 bool IntersectionTests::sphereAndHalfSpace(
@@ -11,11 +11,25 @@
  */
 
 #include <cyclone/contacts.h>
+#include <cyclone/joints.h>
 #include <memory.h>
 #include <assert.h>
+#include <algorithm>
 
 using namespace cyclone;
 
+/*
+ * Static and kinematic bodies, and bodies with infinite mass, are
+ * never moved by the resolver, so they behave like the scenery: they
+ * can take part in any number of contacts being resolved at the same
+ * time.
+ */
+static inline bool isDynamic(const RigidBody *body)
+{
+    return body && body->getBodyType() == RigidBody::DYNAMIC_BODY &&
+        body->getInverseMass() > 0;
+}
+
 // Contact implementation
 
 void Contact::setBodyData(RigidBody* one, RigidBody *two,
@@ -35,10 +49,12 @@ void Contact::matchAwakeState()
     bool body0awake = body[0]->getAwake();
     bool body1awake = body[1]->getAwake();
 
-    // Wake up only the sleeping one
+    // Wake up only the sleeping one (as long as it can move).
     if (body0awake ^ body1awake) {
-        if (body0awake) body[1]->setAwake();
-        else body[0]->setAwake();
+        if (body0awake) {
+            if (isDynamic(body[1])) body[1]->setAwake();
+        }
+        else if (isDynamic(body[0])) body[0]->setAwake();
     }
 }
 
@@ -206,23 +222,24 @@ void Contact::calculateInternals(real duration)
 void Contact::applyVelocityChange(Vector3 velocityChange[2],
                                   Vector3 rotationChange[2])
 {
-    // Get hold of the inverse mass and inverse inertia tensor, both in
-    // world coordinates.
-    Matrix3 inverseInertiaTensor[2];
-    body[0]->getInverseInertiaTensorWorld(&inverseInertiaTensor[0]);
-    if (body[1])
-        body[1]->getInverseInertiaTensorWorld(&inverseInertiaTensor[1]);
-
     // We will calculate the impulse for each contact axis
     Vector3 impulseContact;
 
     if (friction == (real)0.0)
     {
         // Use the short format for frictionless contacts
-        impulseContact = calculateFrictionlessImpulse(inverseInertiaTensor);
+        impulseContact = calculateFrictionlessImpulse();
     }
     else
     {
+        // Get hold of the inverse inertia tensors in world
+        // coordinates. Immovable bodies keep a zero tensor.
+        Matrix3 inverseInertiaTensor[2];
+        if (isDynamic(body[0]))
+            body[0]->getInverseInertiaTensorWorld(&inverseInertiaTensor[0]);
+        if (isDynamic(body[1]))
+            body[1]->getInverseInertiaTensorWorld(&inverseInertiaTensor[1]);
+
         // Otherwise we may have impulses that aren't in the direction of the
         // contact, so we need the more complex version.
         impulseContact = calculateFrictionImpulse(inverseInertiaTensor);
@@ -233,42 +250,78 @@ void Contact::applyVelocityChange(Vector3 velocityChange[2],
 
     // Split in the impulse into linear and rotational components
     Vector3 impulsiveTorque = relativeContactPosition[0] % impulse;
-    rotationChange[0] = inverseInertiaTensor[0].transform(impulsiveTorque);
+    rotationChange[0].clear();
+    if (isDynamic(body[0]))
+        rotationChange[0] = body[0]->getRotationChange(impulsiveTorque);
     velocityChange[0].clear();
     velocityChange[0].addScaledVector(impulse, body[0]->getInverseMass());
 
     // Apply the changes
-    body[0]->addVelocity(velocityChange[0]);
-    body[0]->addRotation(rotationChange[0]);
+    if (isDynamic(body[0]))
+    {
+        body[0]->addVelocity(velocityChange[0]);
+        body[0]->addRotation(rotationChange[0]);
+    }
 
     if (body[1])
     {
         // Work out body one's linear and angular changes
         Vector3 impulsiveTorque = impulse % relativeContactPosition[1];
-        rotationChange[1] = inverseInertiaTensor[1].transform(impulsiveTorque);
+        rotationChange[1].clear();
+        if (isDynamic(body[1]))
+            rotationChange[1] = body[1]->getRotationChange(impulsiveTorque);
         velocityChange[1].clear();
         velocityChange[1].addScaledVector(impulse, -body[1]->getInverseMass());
 
         // And apply them.
-        body[1]->addVelocity(velocityChange[1]);
-        body[1]->addRotation(rotationChange[1]);
+        if (isDynamic(body[1]))
+        {
+            body[1]->addVelocity(velocityChange[1]);
+            body[1]->addRotation(rotationChange[1]);
+        }
+    }
+}
+
+void Contact::updateContactVelocity(real duration)
+{
+    contactVelocity = calculateLocalVelocity(0, duration);
+    if (body[1]) {
+        contactVelocity -= calculateLocalVelocity(1, duration);
     }
 }
 
+bool Contact::resolveVelocity(real duration, real velocityEpsilon)
+{
+    // Bring the closing velocity up to date with any impulses applied
+    // to the bodies since it was last calculated.
+    updateContactVelocity(duration);
+    calculateDesiredDeltaVelocity(duration);
+    if (desiredDeltaVelocity <= velocityEpsilon) return false;
+
+    Vector3 velocityChange[2], rotationChange[2];
+    matchAwakeState();
+    applyVelocityChange(velocityChange, rotationChange);
+    return true;
+}
+
 inline
-Vector3 Contact::calculateFrictionlessImpulse(Matrix3 * inverseInertiaTensor)
+Vector3 Contact::calculateFrictionlessImpulse()
 {
     Vector3 impulseContact;
+    real deltaVelocity = 0;
 
     // Build a vector that shows the change in velocity in
     // world space for a unit impulse in the direction of the contact
-    // normal.
-    Vector3 deltaVelWorld = relativeContactPosition[0] % contactNormal;
-    deltaVelWorld = inverseInertiaTensor[0].transform(deltaVelWorld);
-    deltaVelWorld = deltaVelWorld % relativeContactPosition[0];
+    // normal. Immovable bodies don't rotate.
+    if (isDynamic(body[0]))
+    {
+        Vector3 deltaVelWorld = relativeContactPosition[0] % contactNormal;
+        deltaVelWorld = body[0]->getRotationChange(deltaVelWorld);
+        deltaVelWorld = deltaVelWorld % relativeContactPosition[0];
 
-    // Work out the change in velocity in contact coordiantes.
-    real deltaVelocity = deltaVelWorld * contactNormal;
+        // Work out the change in velocity in contact coordiantes.
+        deltaVelocity = deltaVelWorld * contactNormal;
+    }
 
     // Add the linear component of velocity change
     deltaVelocity += body[0]->getInverseMass();
@@ -277,9 +330,13 @@ Vector3 Contact::calculateFrictionlessImpulse(Matrix3 * inverseInertiaTensor)
     if (body[1])
     {
         // Go through the same transformation sequence again
-        Vector3 deltaVelWorld = relativeContactPosition[1] % contactNormal;
-        deltaVelWorld = inverseInertiaTensor[1].transform(deltaVelWorld);
-        deltaVelWorld = deltaVelWorld % relativeContactPosition[1];
+        Vector3 deltaVelWorld;
+        if (isDynamic(body[1]))
+        {
+            deltaVelWorld = relativeContactPosition[1] % contactNormal;
+            deltaVelWorld = body[1]->getRotationChange(deltaVelWorld);
+            deltaVelWorld = deltaVelWorld % relativeContactPosition[1];
+        }
 
         // Add the change in velocity due to rotation
         deltaVelocity += deltaVelWorld * contactNormal;
@@ -375,6 +432,139 @@ Vector3 Contact::calculateFrictionImpulse(Matrix3 * inverseInertiaTensor)
     return impulseContact;
 }
 
+void Contact::applyWorldImpulse(const Vector3 &impulse)
+{
+    for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
+    {
+        // The second body receives the opposite impulse.
+        real sign = (i == 0)?1:-1;
+        Vector3 velocityChange = impulse * (sign * body[i]->getInverseMass());
+        Vector3 rotationChange = body[i]->getRotationChange(
+            relativeContactPosition[i] % impulse) * sign;
+
+        body[i]->addVelocity(velocityChange);
+        body[i]->addRotation(rotationChange);
+    }
+}
+
+real Contact::calculateNormalResponse(const Contact &other) const
+{
+    real response = 0;
+    for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
+    {
+        response += body[i]->getInverseMass() *
+            (other.contactNormal * contactNormal);
+        response += (other.angularPerUnitImpulse[i] %
+            relativeContactPosition[i]) * contactNormal;
+    }
+    return response;
+}
+
+bool Contact::resolveFriction(real duration, real velocityEpsilon)
+{
+    if (friction == (real)0.0) return false;
+
+    updateContactVelocity(duration);
+
+    // Find the impulse along each tangent that would stop the sliding.
+    Vector3 tangent[2];
+    real inverseMass[2];
+    real impulse[2];
+    for (unsigned axis = 0; axis < 2; axis++)
+    {
+        tangent[axis] = contactToWorld.getAxisVector(axis + 1);
+        inverseMass[axis] = 0;
+        for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
+        {
+            inverseMass[axis] += body[i]->getInverseMass();
+            inverseMass[axis] += (body[i]->getRotationChange(
+                relativeContactPosition[i] % tangent[axis]) %
+                relativeContactPosition[i]) * tangent[axis];
+        }
+        impulse[axis] = (inverseMass[axis] > 0) ?
+            -contactVelocity[axis + 1] / inverseMass[axis] : 0;
+    }
+
+    // Keep the total friction impulse inside the friction cone.
+    real_accum y = frictionImpulse[0] + impulse[0];
+    real_accum z = frictionImpulse[1] + impulse[1];
+    real_accum limit = friction * normalImpulse;
+    real_accum planarImpulse = real_accum_sqrt(y*y + z*z);
+    if (planarImpulse > limit)
+    {
+        real_accum scale = (planarImpulse > 0) ? limit / planarImpulse : 0;
+        y *= scale;
+        z *= scale;
+    }
+    impulse[0] = (real)(y - frictionImpulse[0]);
+    impulse[1] = (real)(z - frictionImpulse[1]);
+    frictionImpulse[0] = y;
+    frictionImpulse[1] = z;
+
+    applyWorldImpulse(tangent[0] * impulse[0] + tangent[1] * impulse[1]);
+    return real_abs(impulse[0] * inverseMass[0]) > velocityEpsilon ||
+        real_abs(impulse[1] * inverseMass[1]) > velocityEpsilon;
+}
+
+void Contact::calculateNormalMass()
+{
+    real inverseNormalMass = 0;
+    for (unsigned i = 0; i < 2; i++)
+    {
+        if (!isDynamic(body[i]))
+        {
+            angularPerUnitImpulse[i].clear();
+            continue;
+        }
+
+        // This follows the frictionless impulse calculation.
+        angularPerUnitImpulse[i] = body[i]->getRotationChange(
+            relativeContactPosition[i] % contactNormal);
+
+        inverseNormalMass += body[i]->getInverseMass();
+        inverseNormalMass += (angularPerUnitImpulse[i] %
+            relativeContactPosition[i]) * contactNormal;
+    }
+
+    normalMass = (inverseNormalMass > 0) ? (real)1.0/inverseNormalMass : 0;
+}
+
+void Contact::preparePseudoVelocity(real targetVelocity)
+{
+    calculateNormalMass();
+    pseudoTarget = targetVelocity;
+    pseudoImpulse = 0;
+}
+
+real Contact::applyPseudoImpulse(Vector3 *pseudoVelocities,
+                                 Vector3 *pseudoRotations)
+{
+    // Find the current separating pseudo-velocity.
+    real separatingVelocity = 0;
+    for (unsigned i = 0; i < 2; i++) if (bodyIndex[i] != ContactResolver::NO_BODY)
+    {
+        Vector3 velocity = pseudoVelocities[bodyIndex[i]] +
+            pseudoRotations[bodyIndex[i]] % relativeContactPosition[i];
+        separatingVelocity += (velocity * contactNormal) * (i?-1:1);
+    }
+
+    // Keep the total impulse pushing the bodies apart.
+    real impulse = (pseudoTarget - separatingVelocity) * normalMass;
+    if (pseudoImpulse + impulse < 0) impulse = (real)-pseudoImpulse;
+    if (impulse == 0) return 0;
+    pseudoImpulse += impulse;
+
+    for (unsigned i = 0; i < 2; i++) if (bodyIndex[i] != ContactResolver::NO_BODY)
+    {
+        real sign = (i == 0)?impulse:-impulse;
+        pseudoVelocities[bodyIndex[i]].addScaledVector(
+            contactNormal, sign * body[i]->getInverseMass());
+        pseudoRotations[bodyIndex[i]].addScaledVector(
+            angularPerUnitImpulse[i], sign);
+    }
+    return impulse / normalMass;
+}
+
 void Contact::applyPositionChange(Vector3 linearChange[2],
                                   Vector3 angularChange[2],
                                   real penetration)
@@ -389,17 +579,14 @@ void Contact::applyPositionChange(Vector3 linearChange[2],
 
     // We need to work out the inertia of each object in the direction
     // of the contact normal, due to angular inertia only.
-    for (unsigned i = 0; i < 2; i++) if (body[i])
+    for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
     {
-        Matrix3 inverseInertiaTensor;
-        body[i]->getInverseInertiaTensorWorld(&inverseInertiaTensor);
-
         // Use the same procedure as for calculating frictionless
         // velocity change to work out the angular inertia.
         Vector3 angularInertiaWorld =
             relativeContactPosition[i] % contactNormal;
         angularInertiaWorld =
-            inverseInertiaTensor.transform(angularInertiaWorld);
+            body[i]->getRotationChange(angularInertiaWorld);
         angularInertiaWorld =
             angularInertiaWorld % relativeContactPosition[i];
         angularInertia[i] =
@@ -416,8 +603,15 @@ void Contact::applyPositionChange(Vector3 linearChange[2],
         // continuing.
     }
 
+    // Immovable bodies don't take any of the change.
+    for (unsigned i = 0; i < 2; i++) if (!isDynamic(body[i]))
+    {
+        linearChange[i].clear();
+        angularChange[i].clear();
+    }
+
     // Loop through again calculating and applying the changes
-    for (unsigned i = 0; i < 2; i++) if (body[i])
+    for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
     {
         // The linear and angular movements required are in proportion to
         // the two inverse inertias.
@@ -467,12 +661,9 @@ void Contact::applyPositionChange(Vector3 linearChange[2],
             Vector3 targetAngularDirection =
                 relativeContactPosition[i].vectorProduct(contactNormal);
 
-            Matrix3 inverseInertiaTensor;
-            body[i]->getInverseInertiaTensorWorld(&inverseInertiaTensor);
-
             // Work out the direction we'd need to rotate to achieve that
             angularChange[i] =
-                inverseInertiaTensor.transform(targetAngularDirection) *
+                body[i]->getRotationChange(targetAngularDirection) *
                 (angularMove[i] / angularInertia[i]);
         }
 
@@ -492,13 +683,6 @@ void Contact::applyPositionChange(Vector3 linearChange[2],
         body[i]->getOrientation(&q);
         q.addScaledVector(angularChange[i], ((real)1.0));
         body[i]->setOrientation(q);
-
-        // We need to calculate the derived data for any body that is
-        // asleep, so that the changes are reflected in the object's
-        // data. Otherwise the resolution will not change the position
-        // of the object, and the next collision detection round will
-        // have the same penetration.
-        if (!body[i]->getAwake()) body[i]->calculateDerivedData();
     }
 }
 
@@ -514,6 +698,10 @@ ContactResolver::ContactResolver(unsigned iterations,
 {
     setIterations(iterations, iterations);
     setEpsilon(velocityEpsilon, positionEpsilon);
+    setBatching(false);
+    setSplitImpulse(false);
+    setBlockSolver(false);
+    setConstraints(NULL, 0);
 }
 
 ContactResolver::ContactResolver(unsigned velocityIterations,
@@ -521,8 +709,12 @@ ContactResolver::ContactResolver(unsigned velocityIterations,
                                  real velocityEpsilon,
                                  real positionEpsilon)
 {
-    setIterations(velocityIterations);
+    setIterations(velocityIterations, positionIterations);
     setEpsilon(velocityEpsilon, positionEpsilon);
+    setBatching(false);
+    setSplitImpulse(false);
+    setBlockSolver(false);
+    setConstraints(NULL, 0);
 }
 
 void ContactResolver::setIterations(unsigned iterations)
@@ -544,22 +736,72 @@ void ContactResolver::setEpsilon(real velocityEpsilon,
     ContactResolver::positionEpsilon = positionEpsilon;
 }
 
+void ContactResolver::setBatching(bool batched, unsigned threads)
+{
+    ContactResolver::batched = batched;
+    ContactResolver::threads = threads > 0 ? threads : 1;
+}
+
+void ContactResolver::setSplitImpulse(bool splitImpulse, real bias)
+{
+    ContactResolver::splitImpulse = splitImpulse;
+    ContactResolver::splitImpulseBias = bias;
+}
+
+void ContactResolver::setBlockSolver(bool blockSolver)
+{
+    ContactResolver::blockSolver = blockSolver;
+}
+
+void ContactResolver::setConstraints(Constraint **constraints,
+                                     unsigned numConstraints)
+{
+    ContactResolver::constraints = constraints;
+    ContactResolver::numConstraints = numConstraints;
+}
+
+unsigned ContactResolver::getConstraintRowCount() const
+{
+    unsigned rows = 0;
+    for (unsigned i = 0; i < numConstraints; i++)
+    {
+        unsigned count = constraints[i]->rowCount;
+        rows += (count > 0) ? count : Constraint::MAX_ROWS;
+    }
+    return rows;
+}
+
 void ContactResolver::resolveContacts(Contact *contacts,
                                       unsigned numContacts,
                                       real duration)
 {
     // Make sure we have something to do.
-    if (numContacts == 0) return;
+    if (numContacts == 0 && numConstraints == 0) return;
     if (!isValid()) return;
 
     // Prepare the contacts for processing
     prepareContacts(contacts, numContacts, duration);
 
+    // Everything but worst-first resolution needs the bodies indexed.
+    if (batched || splitImpulse || blockSolver || numConstraints > 0)
+    {
+        colourContacts(contacts, numContacts);
+    }
+    if (numConstraints > 0) prepareConstraints(duration);
+
     // Resolve the interpenetration problems with the contacts.
-    adjustPositions(contacts, numContacts, duration);
+    if (splitImpulse)
+        adjustPseudoVelocities(contacts, numContacts, duration);
+    else if (batched)
+        adjustPositionsBatched(contacts, numContacts, duration);
+    else
+        adjustPositions(contacts, numContacts, duration);
 
     // Resolve the velocity problems with the contacts.
-    adjustVelocities(contacts, numContacts, duration);
+    if (batched || blockSolver || numConstraints > 0)
+        adjustVelocitiesBatched(contacts, numContacts, duration);
+    else
+        adjustVelocities(contacts, numContacts, duration);
 }
 
 void ContactResolver::prepareContacts(Contact* contacts,
@@ -702,4 +944,598 @@ void ContactResolver::adjustPositions(Contact *c,
         }
         positionIterationsUsed++;
     }
+
+    updateSleepingBodies(c, numContacts);
+}
+
+void ContactResolver::colourContacts(Contact *c, unsigned numContacts)
+{
+    unsigned i, b, g;
+
+    // Find the distinct bodies that can be moved, so each can be given
+    // a slot of its own.
+    bodies.clear();
+    for (i = 0; i < numContacts; i++)
+    {
+        for (b = 0; b < 2; b++) if (isDynamic(c[i].body[b]))
+        {
+            bodies.push_back(c[i].body[b]);
+        }
+    }
+    for (i = 0; i < numConstraints; i++)
+    {
+        for (b = 0; b < 2; b++) if (isDynamic(constraints[i]->body[b]))
+        {
+            bodies.push_back(constraints[i]->body[b]);
+        }
+    }
+    std::sort(bodies.begin(), bodies.end());
+    bodies.erase(std::unique(bodies.begin(), bodies.end()), bodies.end());
+
+    for (i = 0; i < numContacts; i++)
+    {
+        for (b = 0; b < 2; b++)
+        {
+            if (isDynamic(c[i].body[b]))
+            {
+                c[i].bodyIndex[b] = (unsigned)(std::lower_bound(
+                    bodies.begin(), bodies.end(), c[i].body[b]
+                    ) - bodies.begin());
+            }
+            else c[i].bodyIndex[b] = NO_BODY;
+        }
+    }
+
+    // Constraints are coloured on their own, as they are resolved
+    // ahead of the contacts in each sweep.
+    groupBodies.resize(numConstraints * 2);
+    for (i = 0; i < numConstraints; i++)
+    {
+        Constraint *constraint = constraints[i];
+        for (b = 0; b < 2; b++)
+        {
+            if (isDynamic(constraint->body[b]))
+            {
+                constraint->bodyIndex[b] = (unsigned)(std::lower_bound(
+                    bodies.begin(), bodies.end(), constraint->body[b]
+                    ) - bodies.begin());
+            }
+            else constraint->bodyIndex[b] = NO_BODY;
+            groupBodies[i*2 + b] = constraint->bodyIndex[b];
+        }
+    }
+    colourGroups(batchConstraints, constraintOffsets);
+
+    // With the block solver, consecutive contacts between the same
+    // bodies form a manifold, otherwise each contact is on its own.
+    groupStarts.clear();
+    for (i = 0; i < numContacts; i++)
+    {
+        if (blockSolver && !groupStarts.empty())
+        {
+            unsigned first = groupStarts.back();
+            if (i - first < MAX_MANIFOLD &&
+                c[i].body[0] == c[first].body[0] &&
+                c[i].body[1] == c[first].body[1]) continue;
+        }
+        groupStarts.push_back(i);
+    }
+    unsigned numGroups = (unsigned)groupStarts.size();
+    groupStarts.push_back(numContacts);
+
+    // Every contact in a group has the same bodies.
+    groupBodies.resize(numGroups * 2);
+    for (g = 0; g < numGroups; g++)
+    {
+        for (b = 0; b < 2; b++)
+        {
+            groupBodies[g*2 + b] = c[groupStarts[g]].bodyIndex[b];
+        }
+    }
+    colourGroups(batchGroups, batchOffsets);
+}
+
+void ContactResolver::colourGroups(std::vector<unsigned> &order,
+                                   std::vector<unsigned> &offsets)
+{
+    unsigned numGroups = (unsigned)groupBodies.size() / 2;
+    unsigned b, g;
+
+    // Give each group the first batch that neither of its bodies is
+    // in yet. Groups that don't fit go in the final, serial batch.
+    bodyBatches.assign(bodies.size(), 0u);
+    groupBatches.resize(numGroups);
+    offsets.assign(MAX_BATCHES + 2, 0u);
+    for (g = 0; g < numGroups; g++)
+    {
+        unsigned used = 0;
+        for (b = 0; b < 2; b++) if (groupBodies[g*2 + b] != NO_BODY)
+        {
+            used |= bodyBatches[groupBodies[g*2 + b]];
+        }
+
+        unsigned batch = 0;
+        while (batch < MAX_BATCHES && (used & (1u << batch))) batch++;
+        if (batch < MAX_BATCHES)
+        {
+            for (b = 0; b < 2; b++) if (groupBodies[g*2 + b] != NO_BODY)
+            {
+                bodyBatches[groupBodies[g*2 + b]] |= 1u << batch;
+            }
+        }
+        groupBatches[g] = batch;
+        offsets[batch + 1]++;
+    }
+
+    // Sort the groups by batch, keeping them in order within each.
+    for (b = 0; b <= MAX_BATCHES; b++)
+    {
+        offsets[b + 1] += offsets[b];
+    }
+    std::vector<unsigned> next(offsets.begin(), offsets.end() - 1);
+    order.resize(numGroups);
+    for (g = 0; g < numGroups; g++)
+    {
+        order[next[groupBatches[g]]++] = g;
+    }
+}
+
+void ContactResolver::prepareConstraints(real duration)
+{
+    for (unsigned batch = 0; batch <= MAX_BATCHES; batch++)
+    {
+        int start = (int)constraintOffsets[batch];
+        int end = (int)constraintOffsets[batch + 1];
+
+        // Constraints in the final batch may share bodies.
+#ifdef _OPENMP
+        int workers = (batched && batch < MAX_BATCHES) ? (int)threads : 1;
+#endif
+
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+        for (int k = start; k < end; k++)
+        {
+            constraints[batchConstraints[k]]->prepare(duration);
+        }
+    }
+}
+
+void ContactResolver::adjustVelocitiesBatched(Contact *c,
+                                              unsigned numContacts,
+                                              real duration)
+{
+    // The block solver builds up its impulses from zero, aiming for
+    // the separating velocity each contact should end the frame with.
+    if (blockSolver)
+    {
+        for (unsigned i = 0; i < numContacts; i++)
+        {
+            c[i].calculateNormalMass();
+            c[i].targetVelocity =
+                c[i].contactVelocity.x + c[i].desiredDeltaVelocity;
+            c[i].normalImpulse = 0;
+            c[i].frictionImpulse[0] = c[i].frictionImpulse[1] = 0;
+        }
+    }
+
+    // Sweep through the batches until nothing needs resolving.
+    velocityIterationsUsed = 0;
+    while (velocityIterationsUsed < velocityIterations)
+    {
+        int resolved = 0;
+        unsigned batch;
+        for (batch = 0; batch <= MAX_BATCHES && numConstraints > 0; batch++)
+        {
+            int start = (int)constraintOffsets[batch];
+            int end = (int)constraintOffsets[batch + 1];
+
+            // Constraints in the final batch may share bodies.
+#ifdef _OPENMP
+            int workers = (batched && batch < MAX_BATCHES) ? (int)threads : 1;
+#endif
+
+#ifdef _OPENMP
+            #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:resolved) schedule(static)
+#endif
+            for (int k = start; k < end; k++)
+            {
+                if (constraints[batchConstraints[k]]->solve(velocityEpsilon))
+                {
+                    resolved++;
+                }
+            }
+        }
+
+        for (batch = 0; batch <= MAX_BATCHES; batch++)
+        {
+            int start = (int)batchOffsets[batch];
+            int end = (int)batchOffsets[batch + 1];
+
+            // Groups in the final batch may share bodies.
+#ifdef _OPENMP
+            int workers = (batched && batch < MAX_BATCHES) ? (int)threads : 1;
+#endif
+
+#ifdef _OPENMP
+            #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:resolved) schedule(static)
+#endif
+            for (int k = start; k < end; k++)
+            {
+                unsigned first = groupStarts[batchGroups[k]];
+                unsigned last = groupStarts[batchGroups[k] + 1];
+
+                if (blockSolver)
+                {
+                    if (resolveManifold(c + first, last - first, duration))
+                    {
+                        resolved++;
+                    }
+                }
+                else for (unsigned i = first; i < last; i++)
+                {
+                    if (c[i].resolveVelocity(duration, velocityEpsilon))
+                    {
+                        resolved++;
+                    }
+                }
+            }
+        }
+        velocityIterationsUsed++;
+        if (resolved == 0) break;
+    }
+}
+
+void ContactResolver::adjustPositionsBatched(Contact *c,
+                                             unsigned numContacts,
+                                             real duration)
+{
+    linearChanges.assign(bodies.size(), Vector3());
+    angularChanges.assign(bodies.size(), Vector3());
+
+    // Sweep through the batches until nothing needs resolving.
+    positionIterationsUsed = 0;
+    while (positionIterationsUsed < positionIterations)
+    {
+        int resolved = 0;
+        for (unsigned batch = 0; batch <= MAX_BATCHES; batch++)
+        {
+            int start = (int)batchOffsets[batch];
+            int end = (int)batchOffsets[batch + 1];
+
+            // Groups in the final batch may share bodies.
+#ifdef _OPENMP
+            int workers = (batch < MAX_BATCHES) ? (int)threads : 1;
+#endif
+
+#ifdef _OPENMP
+            #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:resolved) schedule(static)
+#endif
+            for (int k = start; k < end; k++)
+            {
+                unsigned first = groupStarts[batchGroups[k]];
+                unsigned last = groupStarts[batchGroups[k] + 1];
+                for (unsigned i = first; i < last; i++)
+                {
+                    Contact &contact = c[i];
+
+                    // Bring the penetration up to date with the
+                    // movement of the bodies so far.
+                    real penetration = contact.penetration;
+                    unsigned b;
+                    for (b = 0; b < 2; b++) if (contact.bodyIndex[b] != NO_BODY)
+                    {
+                        unsigned index = contact.bodyIndex[b];
+                        Vector3 deltaPosition = linearChanges[index] +
+                            angularChanges[index].vectorProduct(
+                                contact.relativeContactPosition[b]);
+                        penetration +=
+                            deltaPosition.scalarProduct(contact.contactNormal)
+                            * (b?1:-1);
+                    }
+                    if (penetration <= positionEpsilon) continue;
+
+                    Vector3 linearChange[2], angularChange[2];
+                    contact.matchAwakeState();
+                    contact.applyPositionChange(
+                        linearChange,
+                        angularChange,
+                        penetration);
+
+                    // No other group in this batch can move these bodies.
+                    for (b = 0; b < 2; b++) if (contact.bodyIndex[b] != NO_BODY)
+                    {
+                        linearChanges[contact.bodyIndex[b]] += linearChange[b];
+                        angularChanges[contact.bodyIndex[b]] += angularChange[b];
+                    }
+                    resolved++;
+                }
+            }
+        }
+        positionIterationsUsed++;
+        if (resolved == 0) break;
+    }
+
+    // Leave each contact with the penetration it was resolved to.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++) if (c[i].bodyIndex[b] != NO_BODY)
+        {
+            unsigned index = c[i].bodyIndex[b];
+            Vector3 deltaPosition = linearChanges[index] +
+                angularChanges[index].vectorProduct(
+                    c[i].relativeContactPosition[b]);
+            c[i].penetration +=
+                deltaPosition.scalarProduct(c[i].contactNormal) * (b?1:-1);
+        }
+    }
+
+    updateSleepingBodies(c, numContacts);
+}
+
+void ContactResolver::updateSleepingBodies(Contact *c, unsigned numContacts)
+{
+    // We need to calculate the derived data for any body that is
+    // asleep, so that the changes are reflected in the object's
+    // data. Otherwise the resolution will not change the position
+    // of the object, and the next collision detection round will
+    // have the same penetration. Bodies moved by several contacts
+    // are only brought up to date once.
+    for (unsigned i = 0; i < numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++)
+        {
+            RigidBody *body = c[i].body[b];
+            if (body && !body->getAwake()) body->updateDerivedData();
+        }
+    }
+}
+
+void ContactResolver::adjustPseudoVelocities(Contact *c,
+                                             unsigned numContacts,
+                                             real duration)
+{
+    int i;
+
+    // Aim to remove the penetration beyond the tolerance over the
+    // course of this frame.
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads((int)threads) if(batched && threads > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        real excess = c[i].penetration - positionEpsilon;
+        c[i].preparePseudoVelocity(
+            excess > 0 ? splitImpulseBias * excess / duration : 0);
+    }
+
+    positionIterationsUsed = 0;
+    if (bodies.empty()) return;
+
+    pseudoVelocities.assign(bodies.size(), Vector3());
+    pseudoRotations.assign(bodies.size(), Vector3());
+
+    // Sweep through the batches until the changes no longer move any
+    // body by more than the position tolerance.
+    real changeLimit = positionEpsilon / duration;
+    while (positionIterationsUsed < positionIterations)
+    {
+        int resolved = 0;
+        for (unsigned batch = 0; batch <= MAX_BATCHES; batch++)
+        {
+            int start = (int)batchOffsets[batch];
+            int end = (int)batchOffsets[batch + 1];
+
+            // Groups in the final batch may share bodies.
+#ifdef _OPENMP
+            int workers = (batched && batch < MAX_BATCHES) ? (int)threads : 1;
+#endif
+
+#ifdef _OPENMP
+            #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:resolved) schedule(static)
+#endif
+            for (int k = start; k < end; k++)
+            {
+                unsigned first = groupStarts[batchGroups[k]];
+                unsigned last = groupStarts[batchGroups[k] + 1];
+                for (unsigned j = first; j < last; j++)
+                {
+                    real change = c[j].applyPseudoImpulse(
+                        &pseudoVelocities[0], &pseudoRotations[0]);
+                    if (real_abs(change) > changeLimit)
+                    {
+                        c[j].matchAwakeState();
+                        resolved++;
+                    }
+                }
+            }
+        }
+        positionIterationsUsed++;
+        if (resolved == 0) break;
+    }
+
+    // Move each body by its pseudo-velocity. This is the only time the
+    // bodies are touched, and the pseudo-velocities are then discarded.
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads((int)threads) if(batched && threads > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)bodies.size(); i++)
+    {
+        RigidBody *body = bodies[i];
+
+        Vector3 pos;
+        body->getPosition(&pos);
+        pos.addScaledVector(pseudoVelocities[i], duration);
+        body->setPosition(pos);
+
+        Quaternion q;
+        body->getOrientation(&q);
+        q.addScaledVector(pseudoRotations[i], duration);
+        body->setOrientation(q);
+
+        // As for direct position resolution, sleeping bodies need their
+        // derived data bringing up to date.
+        if (!body->getAwake()) body->updateDerivedData();
+    }
+
+    // Leave each contact with the penetration it was resolved to.
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++) if (c[i].bodyIndex[b] != NO_BODY)
+        {
+            unsigned index = c[i].bodyIndex[b];
+            Vector3 deltaPosition = pseudoVelocities[index] +
+                pseudoRotations[index].vectorProduct(
+                    c[i].relativeContactPosition[b]);
+            c[i].penetration -= deltaPosition.scalarProduct(
+                c[i].contactNormal) * duration * (b?-1:1);
+        }
+    }
+}
+
+/*
+ * Solves the linear complementarity problem w = Ax + b, with x >= 0,
+ * w >= 0 and each x[i]*w[i] = 0, by direct enumeration: every set of
+ * pushing contacts is tried in turn, starting with all of them, and
+ * the first set whose solution is valid is kept. With at most
+ * MAX_MANIFOLD unknowns there are few enough sets for this to be
+ * cheaper than an iterative solution, and it is exact. Returns false
+ * if no set gives a valid solution.
+ */
+static bool solveBlockLCP(const real A[][ContactResolver::MAX_MANIFOLD],
+                          const real *b, real *x, unsigned n)
+{
+    const unsigned size = ContactResolver::MAX_MANIFOLD;
+    const real tolerance = (real)1e-6;
+
+    for (int set = (1 << n) - 1; set >= 0; set--)
+    {
+        // Build the equations for the pushing contacts.
+        unsigned active[size];
+        unsigned count = 0;
+        unsigned i, j, k;
+        for (i = 0; i < n; i++) if (set & (1 << i)) active[count++] = i;
+
+        real m[size][size + 1];
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0; j < count; j++) m[i][j] = A[active[i]][active[j]];
+            m[i][count] = -b[active[i]];
+        }
+
+        // Gaussian elimination with partial pivoting.
+        bool singular = false;
+        for (k = 0; k < count && !singular; k++)
+        {
+            unsigned pivot = k;
+            for (i = k + 1; i < count; i++)
+            {
+                if (real_abs(m[i][k]) > real_abs(m[pivot][k])) pivot = i;
+            }
+            if (real_abs(m[pivot][k]) < tolerance) singular = true;
+            else
+            {
+                if (pivot != k) for (j = k; j <= count; j++)
+                {
+                    real temp = m[k][j];
+                    m[k][j] = m[pivot][j];
+                    m[pivot][j] = temp;
+                }
+                for (i = k + 1; i < count; i++)
+                {
+                    real factor = m[i][k] / m[k][k];
+                    for (j = k; j <= count; j++) m[i][j] -= factor * m[k][j];
+                }
+            }
+        }
+        if (singular) continue;
+
+        // Back substitute, checking every impulse pushes.
+        for (i = 0; i < n; i++) x[i] = 0;
+        bool valid = true;
+        for (int r = (int)count - 1; r >= 0 && valid; r--)
+        {
+            real value = m[r][count];
+            for (j = r + 1; j < count; j++) value -= m[r][j] * x[active[j]];
+            value /= m[r][r];
+            if (value < -tolerance) valid = false;
+            x[active[r]] = value > 0 ? value : 0;
+        }
+        if (!valid) continue;
+
+        // Check the contacts left out aren't closing.
+        for (i = 0; i < n && valid; i++) if (!(set & (1 << i)))
+        {
+            real w = b[i];
+            for (j = 0; j < n; j++) w += A[i][j] * x[j];
+            if (w < -tolerance) valid = false;
+        }
+        if (valid) return true;
+    }
+    return false;
+}
+
+bool ContactResolver::resolveManifold(Contact *c,
+                                      unsigned numContacts,
+                                      real duration)
+{
+    real A[MAX_MANIFOLD][MAX_MANIFOLD];
+    real b[MAX_MANIFOLD];
+    real x[MAX_MANIFOLD];
+    unsigned i, j;
+
+    // Work out the response of each point to a unit impulse at every
+    // point, and the velocity each point would be left with if the
+    // impulses applied so far were taken away again.
+    for (i = 0; i < numContacts; i++)
+    {
+        c[i].updateContactVelocity(duration);
+        b[i] = c[i].contactVelocity.x - c[i].targetVelocity;
+        for (j = 0; j < numContacts; j++)
+        {
+            A[i][j] = c[i].calculateNormalResponse(c[j]);
+        }
+    }
+    for (i = 0; i < numContacts; i++)
+    {
+        for (j = 0; j < numContacts; j++)
+        {
+            b[i] -= (real)(A[i][j] * c[j].normalImpulse);
+        }
+    }
+
+    if (!solveBlockLCP(A, b, x, numContacts))
+    {
+        // Fall back on a single projected Gauss-Seidel pass.
+        for (i = 0; i < numContacts; i++) x[i] = (real)c[i].normalImpulse;
+        for (i = 0; i < numContacts; i++) if (A[i][i] > 0)
+        {
+            real w = b[i];
+            for (j = 0; j < numContacts; j++) w += A[i][j] * x[j];
+            x[i] -= w / A[i][i];
+            if (x[i] < 0) x[i] = 0;
+        }
+    }
+
+    // Apply the change in each normal impulse.
+    bool changed = false;
+    for (i = 0; i < numContacts; i++)
+    {
+        real impulse = (real)(x[i] - c[i].normalImpulse);
+        c[i].normalImpulse = x[i];
+        if (impulse == 0) continue;
+
+        c[i].applyWorldImpulse(c[i].contactNormal * impulse);
+        if (real_abs(impulse * A[i][i]) > velocityEpsilon) changed = true;
+    }
+
+    // Friction is limited by the new normal impulses.
+    for (i = 0; i < numContacts; i++)
+    {
+        if (c[i].resolveFriction(duration, velocityEpsilon)) changed = true;
+    }
+
+    if (changed) c[0].matchAwakeState();
+    return changed;
 }
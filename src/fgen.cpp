@@ -11,24 +11,199 @@
  */
 
 #include <cyclone/fgen.h>
+#include <cyclone/collide_fine.h>
+#include <algorithm>
 
 using namespace cyclone;
 
+Handle ForceRegistry::add(RigidBody *body, ForceGenerator *fg)
+{
+    // Find the generator's batch, starting one if it is new.
+    std::map<ForceGenerator*, unsigned>::iterator found =
+        batchIndices.find(fg);
+    if (found == batchIndices.end())
+    {
+        found = batchIndices.insert(
+            std::make_pair(fg, (unsigned)batches.size())).first;
+        batches.push_back(ForceBatch());
+        batches.back().fg = fg;
+    }
+    ForceBatch &batch = batches[found->second];
+
+    ForceRegistry::ForceRegistration registration;
+    registration.batch = found->second;
+    registration.position = (unsigned)batch.bodies.size();
+    Handle handle = registrations.add(registration);
+
+    batch.bodies.push_back(body);
+    batch.handles.push_back(handle);
+    return handle;
+}
+
+void ForceRegistry::add(RigidBody **bodies, unsigned count,
+                        ForceGenerator *fg, Handle *handles)
+{
+    registrations.reserve(registrations.size() + count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        Handle handle = add(bodies[i], fg);
+        if (handles) handles[i] = handle;
+    }
+}
+
+bool ForceRegistry::remove(const Handle &handle)
+{
+    ForceRegistration *registration = registrations.get(handle);
+    if (!registration) return false;
+
+    // Move the last body of the batch into the gap.
+    ForceBatch &batch = batches[registration->batch];
+    unsigned position = registration->position;
+    unsigned last = (unsigned)batch.bodies.size() - 1;
+    if (position != last)
+    {
+        batch.bodies[position] = batch.bodies[last];
+        batch.handles[position] = batch.handles[last];
+        registrations.get(batch.handles[position])->position = position;
+    }
+    batch.bodies.pop_back();
+    batch.handles.pop_back();
+
+    registrations.remove(handle);
+    return true;
+}
+
+void ForceRegistry::remove(RigidBody *body, ForceGenerator *fg)
+{
+    std::map<ForceGenerator*, unsigned>::iterator found =
+        batchIndices.find(fg);
+    if (found == batchIndices.end()) return;
+
+    ForceBatch &batch = batches[found->second];
+    for (unsigned i = 0; i < batch.bodies.size(); i++)
+    {
+        if (batch.bodies[i] == body)
+        {
+            remove(batch.handles[i]);
+            return;
+        }
+    }
+}
+
 void ForceRegistry::updateForces(real duration)
 {
-    Registry::iterator i = registrations.begin();
-    for (; i != registrations.end(); i++)
+    for (unsigned b = 0; b < batches.size(); b++)
+    {
+        ForceBatch &batch = batches[b];
+        if (batch.bodies.empty()) continue;
+        batch.fg->updateForces(&batch.bodies[0],
+                               (unsigned)batch.bodies.size(), duration);
+    }
+
+    for (unsigned i = 0; i < springSets.size(); i++)
     {
-        i->fg->updateForce(i->body, duration);
+        springSets[i]->updateForces(duration);
     }
 }
 
-void ForceRegistry::add(RigidBody *body, ForceGenerator *fg)
+void ForceRegistry::add(SpringSet *springs)
 {
-    ForceRegistry::ForceRegistration registration;
-    registration.body = body;
-    registration.fg = fg;
-    registrations.push_back(registration);
+    springSets.push_back(springs);
+}
+
+void ForceRegistry::remove(SpringSet *springs)
+{
+    for (unsigned i = 0; i < springSets.size(); i++)
+    {
+        if (springSets[i] == springs)
+        {
+            springSets.erase(springSets.begin() + i);
+            return;
+        }
+    }
+}
+
+void ForceRegistry::clear()
+{
+    batches.clear();
+    batchIndices.clear();
+    registrations.clear();
+    springSets.clear();
+}
+
+void ForceGenerator::updateForces(RigidBody **bodies, unsigned count,
+                                  real duration)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        updateForce(bodies[i], duration);
+    }
+}
+
+unsigned SpringSet::addSpring(RigidBody *first, const Vector3 &firstPoint,
+                             RigidBody *second, const Vector3 &secondPoint,
+                             real springConstant, real restLength,
+                             real damping)
+{
+    ends.push_back(first);
+    ends.push_back(second);
+    connectionPoints.push_back(firstPoint);
+    connectionPoints.push_back(secondPoint);
+    restLengths.push_back(restLength);
+    springConstants.push_back(springConstant);
+    dampings.push_back(damping);
+    return (unsigned)restLengths.size() - 1;
+}
+
+unsigned SpringSet::getSpringCount() const
+{
+    return (unsigned)restLengths.size();
+}
+
+void SpringSet::clear()
+{
+    ends.clear();
+    connectionPoints.clear();
+    restLengths.clear();
+    springConstants.clear();
+    dampings.clear();
+}
+
+void SpringSet::updateForces(real duration)
+{
+    unsigned count = (unsigned)restLengths.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        RigidBody *first = ends[i*2];
+        RigidBody *second = ends[i*2 + 1];
+
+        // Calculate the two ends in world space
+        Vector3 firstEnd =
+            first->getPointInWorldSpace(connectionPoints[i*2]);
+        Vector3 secondEnd =
+            second->getPointInWorldSpace(connectionPoints[i*2 + 1]);
+
+        Vector3 direction = firstEnd - secondEnd;
+        real length = direction.magnitude();
+        if (length <= 0) continue;
+        direction *= ((real)1.0) / length;
+
+        // Work out the pull between the ends once.
+        real magnitude = springConstants[i] * (length - restLengths[i]);
+        if (dampings[i] != 0)
+        {
+            Vector3 firstVelocity = first->getVelocity() +
+                first->getRotation() % (firstEnd - first->getPosition());
+            Vector3 secondVelocity = second->getVelocity() +
+                second->getRotation() % (secondEnd - second->getPosition());
+            magnitude += dampings[i] *
+                ((firstVelocity - secondVelocity) * direction);
+        }
+
+        // And apply it to both, in opposite directions.
+        first->addForceAtPoint(direction * -magnitude, firstEnd);
+        second->addForceAtPoint(direction * magnitude, secondEnd);
+    }
 }
 
 Buoyancy::Buoyancy(const Vector3 &cOfB, real maxDepth, real volume,
@@ -65,6 +240,27 @@ void Buoyancy::updateForce(RigidBody *body, real duration)
     body->addForceAtBodyPoint(force, centreOfBuoyancy);
 }
 
+void Buoyancy::updateForces(RigidBody **bodies, unsigned count,
+                            real duration)
+{
+    real maxForce = liquidDensity * volume;
+    real top = waterHeight + maxDepth;
+    real bottom = waterHeight - maxDepth;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        RigidBody *body = bodies[i];
+        real depth = body->getPointInWorldSpace(centreOfBuoyancy).y;
+        if (depth >= top) continue;
+
+        Vector3 force(0,0,0);
+        if (depth <= bottom) force.y = maxForce;
+        else force.y = maxForce *
+            (depth - maxDepth - waterHeight) / 2 * maxDepth;
+        body->addForceAtBodyPoint(force, centreOfBuoyancy);
+    }
+}
+
 Gravity::Gravity(const Vector3& gravity)
 : gravity(gravity)
 {
@@ -79,6 +275,19 @@ void Gravity::updateForce(RigidBody* body, real duration)
     body->addForce(gravity * body->getMass());
 }
 
+void Gravity::updateForces(RigidBody **bodies, unsigned count,
+                           real duration)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        // Bodies with infinite mass don't move, so are skipped.
+        RigidBody *body = bodies[i];
+        if (body->inverseMass <= 0) continue;
+        body->forceAccum.addScaledVector(gravity, 1 / body->inverseMass);
+        if (body->bodyType != RigidBody::STATIC_BODY) body->isAwake = true;
+    }
+}
+
 Spring::Spring(const Vector3 &localConnectionPt,
                RigidBody *other,
                const Vector3 &otherConnectionPt,
@@ -132,11 +341,12 @@ void Aero::updateForceFromTensor(RigidBody *body, real duration,
     velocity += *windspeed;
 
     // Calculate the velocity in body coordinates
-    Vector3 bodyVel = body->getTransform().transformInverseDirection(velocity);
+    Matrix4 transform = body->getTransform();
+    Vector3 bodyVel = transform.transformInverseDirection(velocity);
 
     // Calculate the force in body coordinates
     Vector3 bodyForce = tensor.transform(bodyVel);
-    Vector3 force = body->getTransform().transformDirection(bodyForce);
+    Vector3 force = transform.transformDirection(bodyForce);
 
     // Apply the force
     body->addForceAtBodyPoint(force, position);
@@ -178,7 +388,345 @@ void AeroControl::updateForce(RigidBody *body, real duration)
     Aero::updateForceFromTensor(body, duration, tensor);
 }
 
+AngledAero::AngledAero(const Matrix3 &tensor, const Vector3 &position,
+                       const Vector3 *windspeed)
+:
+Aero(tensor, position, windspeed),
+orientation(1, 0, 0, 0)
+{
+}
+
+void AngledAero::setOrientation(const Quaternion &quat)
+{
+    orientation = quat;
+}
+
+void AngledAero::updateForce(RigidBody *body, real duration)
+{
+    // Turn the tensor into body coordinates.
+    Matrix3 rotation;
+    rotation.setOrientation(orientation);
+    Aero::updateForceFromTensor(body, duration,
+                                rotation * tensor * rotation.transpose());
+}
+
+AeroAssembly::AeroAssembly(const Vector3 *windspeed)
+:
+windspeed(windspeed),
+summed(true)
+{
+}
+
+unsigned AeroAssembly::addSurface(const Matrix3 &tensor,
+                                  const Vector3 &position)
+{
+    return addControlSurface(tensor, tensor, tensor, position);
+}
+
+unsigned AeroAssembly::addControlSurface(const Matrix3 &base,
+                                         const Matrix3 &min,
+                                         const Matrix3 &max,
+                                         const Vector3 &position)
+{
+    tensors.push_back(base);
+    minTensors.push_back(min);
+    maxTensors.push_back(max);
+    orientations.push_back(Quaternion(1, 0, 0, 0));
+    positions.push_back(position);
+    controls.push_back(0);
+    summed = false;
+    return (unsigned)tensors.size() - 1;
+}
+
+unsigned AeroAssembly::getSurfaceCount() const
+{
+    return (unsigned)tensors.size();
+}
+
+void AeroAssembly::setControl(unsigned surface, real value)
+{
+    controls[surface] = value;
+    summed = false;
+}
+
+void AeroAssembly::setOrientation(unsigned surface, const Quaternion &quat)
+{
+    orientations[surface] = quat;
+    summed = false;
+}
+
+void AeroAssembly::sumTensors()
+{
+    forceTensor = Matrix3();
+    torqueTensor = Matrix3();
+
+    for (unsigned i = 0; i < tensors.size(); i++)
+    {
+        // Find the tensor for the control setting, as AeroControl
+        // does.
+        Matrix3 tensor;
+        real control = controls[i];
+        if (control <= -1.0f) tensor = minTensors[i];
+        else if (control >= 1.0f) tensor = maxTensors[i];
+        else if (control < 0)
+        {
+            tensor = Matrix3::linearInterpolate(minTensors[i], tensors[i],
+                                                control+1.0f);
+        }
+        else if (control > 0)
+        {
+            tensor = Matrix3::linearInterpolate(tensors[i], maxTensors[i],
+                                                control);
+        }
+        else tensor = tensors[i];
+
+        // Turn it into body coordinates, as AngledAero does.
+        Matrix3 rotation;
+        rotation.setOrientation(orientations[i]);
+        tensor = rotation * tensor * rotation.transpose();
+
+        // The torque is the surface position crossed with the force.
+        Matrix3 arm;
+        arm.setSkewSymmetric(positions[i]);
+        forceTensor += tensor;
+        torqueTensor += arm * tensor;
+    }
+
+    summed = true;
+}
+
+void AeroAssembly::getForceAndTorque(const RigidBody *body, Vector3 *force,
+                                     Vector3 *torque)
+{
+    if (!summed) sumTensors();
+
+    // Calculate total velocity (windspeed and body's velocity), in
+    // body coordinates.
+    Vector3 velocity = body->getVelocity();
+    if (windspeed) velocity += *windspeed;
+    Matrix4 transform = body->getTransform();
+    Vector3 bodyVel = transform.transformInverseDirection(velocity);
+
+    *force = transform.transformDirection(forceTensor.transform(bodyVel));
+    *torque = transform.transformDirection(torqueTensor.transform(bodyVel));
+}
+
+void AeroAssembly::updateForce(RigidBody *body, real duration)
+{
+    Vector3 force, torque;
+    getForceAndTorque(body, &force, &torque);
+    body->addForce(force);
+    body->addTorque(torque);
+}
+
+Explosion::Explosion()
+:
+timePassed(0),
+detonation(0, 0, 0),
+implosionMaxRadius(4),
+implosionMinRadius(1),
+implosionDuration((real)0.1),
+implosionForce(50),
+shockwaveSpeed(50),
+shockwaveThickness(3),
+peakConcussionForce(1000),
+concussionDuration((real)0.5),
+peakConvectionForce(100),
+chimneyRadius(2),
+chimneyHeight(10),
+convectionDuration(3),
+broadPhase(NULL)
+{
+}
+
+Vector3 Explosion::getForce(const Vector3 &position,
+                            const Vector3 &velocity) const
+{
+    Vector3 force;
+    Vector3 offset = position - detonation;
+    real distance = offset.magnitude();
+    Vector3 direction;
+    if (distance > 0) direction = offset * (((real)1.0) / distance);
+
+    // The implosion pulls in objects in a shell around the
+    // detonation.
+    if (timePassed < implosionDuration &&
+        distance > implosionMinRadius && distance < implosionMaxRadius)
+    {
+        force.addScaledVector(direction, -implosionForce);
+    }
+
+    // The shock wave starts when the implosion ends, and pushes
+    // objects near its front outwards. Objects already moving out
+    // feel less of it, and objects moving in feel more.
+    real shockTime = timePassed - implosionDuration;
+    if (shockTime >= 0 && shockTime < concussionDuration)
+    {
+        real halfThickness = shockwaveThickness * (real)0.5;
+        real fromFront = real_abs(distance - shockwaveSpeed * shockTime);
+        if (fromFront < halfThickness)
+        {
+            real scale = peakConcussionForce *
+                (1 - fromFront / halfThickness) *
+                (1 - shockTime / concussionDuration) *
+                (1 - (velocity * direction) / shockwaveSpeed);
+            if (scale > 0) force.addScaledVector(direction, scale);
+        }
+    }
+
+    // The chimney lifts objects above the detonation, most strongly
+    // at its centre and bottom.
+    if (timePassed < convectionDuration)
+    {
+        real height = offset.y;
+        real radius = real_sqrt(offset.x*offset.x + offset.z*offset.z);
+        if (height >= 0 && height < chimneyHeight && radius < chimneyRadius)
+        {
+            force.y += peakConvectionForce *
+                (1 - radius / chimneyRadius) *
+                (1 - height / chimneyHeight) *
+                (1 - timePassed / convectionDuration);
+        }
+    }
+
+    return force;
+}
+
 void Explosion::updateForce(RigidBody* body, real duration)
 {
+    if (body->getInverseMass() <= 0) return;
+    body->addForce(getForce(body->getPosition(), body->getVelocity()));
+}
 
+void Explosion::updateForce(Particle* particle, real duration)
+{
+    if (particle->getInverseMass() <= 0) return;
+    particle->addForce(getForce(particle->getPosition(),
+                                particle->getVelocity()));
+}
+
+void Explosion::setBroadPhase(BroadPhase *broadPhase)
+{
+    Explosion::broadPhase = broadPhase;
+}
+
+real Explosion::getActiveRadius() const
+{
+    real radius = 0;
+    if (timePassed < implosionDuration) radius = implosionMaxRadius;
+
+    real shockTime = timePassed - implosionDuration;
+    if (shockTime >= 0 && shockTime < concussionDuration)
+    {
+        real front = shockwaveSpeed * shockTime +
+            shockwaveThickness * (real)0.5;
+        if (front > radius) radius = front;
+    }
+
+    if (timePassed < convectionDuration)
+    {
+        real reach = real_sqrt(chimneyRadius*chimneyRadius +
+                               chimneyHeight*chimneyHeight);
+        if (reach > radius) radius = reach;
+    }
+
+    return radius;
+}
+
+bool Explosion::reachesActiveRegion(real distance, real radius) const
+{
+    real nearest = distance - radius;
+    real furthest = distance + radius;
+
+    if (timePassed < implosionDuration &&
+        nearest < implosionMaxRadius && furthest > implosionMinRadius)
+    {
+        return true;
+    }
+
+    real shockTime = timePassed - implosionDuration;
+    if (shockTime >= 0 && shockTime < concussionDuration)
+    {
+        real front = shockwaveSpeed * shockTime;
+        real halfThickness = shockwaveThickness * (real)0.5;
+        if (nearest < front + halfThickness &&
+            furthest > front - halfThickness)
+        {
+            return true;
+        }
+    }
+
+    if (timePassed < convectionDuration)
+    {
+        // Test against a sphere around the chimney.
+        real reach = real_sqrt(chimneyRadius*chimneyRadius +
+                               chimneyHeight*chimneyHeight);
+        if (nearest < reach) return true;
+    }
+
+    return false;
+}
+
+void Explosion::apply(real duration)
+{
+    affectedBodies.clear();
+    nearbyPrimitives.resize(broadPhase ? broadPhase->getMovingCount() : 0);
+    if (!nearbyPrimitives.empty() && !isFinished())
+    {
+        // Find the primitives in the box around the active regions,
+        // then keep the dynamic bodies whose primitives' bounding
+        // spheres reach into them.
+        real radius = getActiveRadius();
+        BoundingBox volume(detonation, Vector3(radius, radius, radius));
+        unsigned count = broadPhase->findMovingPrimitives(
+            volume, &nearbyPrimitives[0], (unsigned)nearbyPrimitives.size());
+        for (unsigned i = 0; i < count; i++)
+        {
+            CollisionPrimitive *primitive = nearbyPrimitives[i];
+            if (primitive->body->getBodyType() != RigidBody::DYNAMIC_BODY)
+            {
+                continue;
+            }
+
+            const BoundingBox &box = primitive->getBoundingBox();
+            real distance = (box.centre - detonation).magnitude();
+            if (reachesActiveRegion(distance, box.halfSize.magnitude()))
+            {
+                affectedBodies.push_back(primitive->body);
+            }
+        }
+
+        // A body with several primitives is only pushed once.
+        std::sort(affectedBodies.begin(), affectedBodies.end());
+        affectedBodies.erase(
+            std::unique(affectedBodies.begin(), affectedBodies.end()),
+            affectedBodies.end());
+        for (unsigned i = 0; i < affectedBodies.size(); i++)
+        {
+            updateForce(affectedBodies[i], duration);
+        }
+    }
+
+    advance(duration);
+}
+
+void Explosion::advance(real duration)
+{
+    timePassed += duration;
+}
+
+real Explosion::getTimePassed() const
+{
+    return timePassed;
+}
+
+void Explosion::reset()
+{
+    timePassed = 0;
+}
+
+bool Explosion::isFinished() const
+{
+    return timePassed >= implosionDuration + concussionDuration &&
+        timePassed >= convectionDuration;
 }
\ No newline at end of file
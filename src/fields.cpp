@@ -0,0 +1,240 @@
+/*
+ * Implementation file for world force fields.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include <assert.h>
+#include <cyclone/fields.h>
+
+using namespace cyclone;
+
+unsigned ForceFields::addField(FieldType type, const Vector3 &vector,
+                               const Vector3 &centre, real strength,
+                               real radius)
+{
+    Field field;
+    field.type = type;
+    field.vector = vector;
+    field.centre = centre;
+    field.strength = strength;
+    field.radius = radius;
+    field.gridSize[0] = field.gridSize[1] = field.gridSize[2] = 0;
+    field.gridStart = 0;
+    fields.push_back(field);
+    return (unsigned)fields.size() - 1;
+}
+
+unsigned ForceFields::addUniform(const Vector3 &acceleration)
+{
+    return addField(UNIFORM, acceleration, Vector3(), 0, 0);
+}
+
+unsigned ForceFields::addWind(const Vector3 &windVelocity,
+                              real coefficient)
+{
+    return addField(WIND, windVelocity, Vector3(), coefficient, 0);
+}
+
+unsigned ForceFields::addRadial(const Vector3 &centre, real strength,
+                                real radius)
+{
+    assert(radius > 0);
+    return addField(RADIAL, Vector3(), centre, strength, radius);
+}
+
+unsigned ForceFields::addVortex(const Vector3 &centre, const Vector3 &axis,
+                                real strength, real radius)
+{
+    assert(radius > 0);
+    return addField(VORTEX, axis.unit(), centre, strength, radius);
+}
+
+unsigned ForceFields::addWindGrid(const Vector3 &corner, real spacing,
+                                  unsigned xPoints, unsigned yPoints,
+                                  unsigned zPoints, real coefficient)
+{
+    assert(spacing > 0 && xPoints > 1 && yPoints > 1 && zPoints > 1);
+    unsigned index = addField(WIND_GRID, Vector3(), corner,
+                              coefficient, spacing);
+    Field &field = fields[index];
+    field.gridSize[0] = xPoints;
+    field.gridSize[1] = yPoints;
+    field.gridSize[2] = zPoints;
+    field.gridStart = (unsigned)gridVelocities.size();
+    gridVelocities.resize(gridVelocities.size() +
+                          xPoints * yPoints * zPoints);
+    return index;
+}
+
+void ForceFields::setGridVelocity(unsigned field, unsigned x, unsigned y,
+                                  unsigned z, const Vector3 &velocity)
+{
+    const Field &grid = fields[field];
+    assert(grid.type == WIND_GRID);
+    assert(x < grid.gridSize[0] && y < grid.gridSize[1] &&
+           z < grid.gridSize[2]);
+    gridVelocities[grid.gridStart +
+        (z * grid.gridSize[1] + y) * grid.gridSize[0] + x] = velocity;
+}
+
+void ForceFields::setVector(unsigned field, const Vector3 &vector)
+{
+    if (fields[field].type == VORTEX) fields[field].vector = vector.unit();
+    else fields[field].vector = vector;
+}
+
+void ForceFields::setStrength(unsigned field, real strength)
+{
+    fields[field].strength = strength;
+}
+
+unsigned ForceFields::getFieldCount() const
+{
+    return (unsigned)fields.size();
+}
+
+void ForceFields::clear()
+{
+    fields.clear();
+    gridVelocities.clear();
+}
+
+void ForceFields::shiftOrigin(const Vector3 &offset)
+{
+    for (unsigned i = 0; i < fields.size(); i++)
+    {
+        fields[i].centre -= offset;
+    }
+}
+
+bool ForceFields::sampleGrid(const Field &field, const Vector3 &position,
+                             Vector3 *velocity) const
+{
+    // Find the cell the position is in, and how far across it.
+    Vector3 local = (position - field.centre) * (((real)1.0) / field.radius);
+    real coordinates[3] = { local.x, local.y, local.z };
+    unsigned cell[3];
+    real fraction[3];
+    for (unsigned axis = 0; axis < 3; axis++)
+    {
+        real last = (real)(field.gridSize[axis] - 1);
+        if (coordinates[axis] < 0 || coordinates[axis] > last) return false;
+
+        // The far face belongs to the last cell.
+        real start = real_floor(coordinates[axis]);
+        if (start >= last) start = last - 1;
+        cell[axis] = (unsigned)start;
+        fraction[axis] = coordinates[axis] - start;
+    }
+
+    // Blend the eight corners of the cell.
+    unsigned xStride = 1;
+    unsigned yStride = field.gridSize[0];
+    unsigned zStride = field.gridSize[0] * field.gridSize[1];
+    const Vector3 *corner = &gridVelocities[field.gridStart +
+        cell[2] * zStride + cell[1] * yStride + cell[0]];
+
+    velocity->clear();
+    for (unsigned i = 0; i < 8; i++)
+    {
+        real weight = 1;
+        unsigned offset = 0;
+        for (unsigned axis = 0; axis < 3; axis++)
+        {
+            bool upper = (i & (1 << axis)) != 0;
+            weight *= upper ? fraction[axis] : 1 - fraction[axis];
+            if (upper) offset += (axis == 0) ? xStride :
+                (axis == 1) ? yStride : zStride;
+        }
+        velocity->addScaledVector(corner[offset], weight);
+    }
+    return true;
+}
+
+Vector3 ForceFields::getAcceleration(const Vector3 &position,
+                                     const Vector3 &velocity,
+                                     real inverseMass) const
+{
+    Vector3 acceleration;
+    if (inverseMass <= 0) return acceleration;
+
+    for (unsigned i = 0; i < fields.size(); i++)
+    {
+        const Field &field = fields[i];
+        switch (field.type)
+        {
+        case UNIFORM:
+            acceleration += field.vector;
+            break;
+
+        case WIND:
+            acceleration.addScaledVector(field.vector - velocity,
+                                         field.strength * inverseMass);
+            break;
+
+        case RADIAL:
+            {
+                Vector3 offset = position - field.centre;
+                real distance = offset.magnitude();
+                if (distance <= 0 || distance >= field.radius) break;
+                acceleration.addScaledVector(offset,
+                    field.strength * (1 - distance / field.radius) /
+                    distance);
+            }
+            break;
+
+        case VORTEX:
+            {
+                // Work with the offset at right angles to the axis.
+                Vector3 offset = position - field.centre;
+                offset.addScaledVector(field.vector,
+                                       -(offset * field.vector));
+                real distance = offset.magnitude();
+                if (distance <= 0 || distance >= field.radius) break;
+                acceleration.addScaledVector(field.vector % offset,
+                    field.strength * (1 - distance / field.radius) /
+                    distance);
+            }
+            break;
+
+        case WIND_GRID:
+            {
+                Vector3 wind;
+                if (!sampleGrid(field, position, &wind)) break;
+                acceleration.addScaledVector(wind - velocity,
+                                             field.strength * inverseMass);
+            }
+            break;
+        }
+    }
+    return acceleration;
+}
+
+void ForceFields::applyTo(Particle *particle) const
+{
+    real inverseMass = particle->getInverseMass();
+    if (fields.empty() || inverseMass <= 0) return;
+
+    particle->addForce(getAcceleration(particle->getPosition(),
+                                       particle->getVelocity(),
+                                       inverseMass) *
+                       (((real)1.0) / inverseMass));
+}
+
+void ForceFields::applyTo(RigidBody *body) const
+{
+    real inverseMass = body->getInverseMass();
+    if (fields.empty() || inverseMass <= 0) return;
+
+    body->addForce(getAcceleration(body->getPosition(),
+                                   body->getVelocity(),
+                                   inverseMass) *
+                   (((real)1.0) / inverseMass));
+}
@@ -0,0 +1,219 @@
+/*
+ * Implementation file for the particle integrators.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include <assert.h>
+#include <cyclone/integrators.h>
+
+using namespace cyclone;
+
+void SymplecticEuler::integrate(std::vector<Particle*> &particles,
+                                ParticleForceRegistry &registry,
+                                real duration)
+{
+    assert(duration > 0.0);
+
+    registry.updateForces(duration);
+
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        Particle *p = particles[i];
+        real inverseMass = p->getInverseMass();
+        if (inverseMass > 0)
+        {
+            // Update the velocity first, and move with the new one.
+            Vector3 acceleration = p->getAcceleration();
+            acceleration.addScaledVector(p->getAccumulatedForce(),
+                                         inverseMass);
+
+            Vector3 velocity = p->getVelocity();
+            velocity.addScaledVector(acceleration, duration);
+            velocity *= p->getDrag(duration);
+            p->setVelocity(velocity);
+
+            Vector3 position = p->getPosition();
+            position.addScaledVector(velocity, duration);
+            p->setPosition(position);
+        }
+        p->clearAccumulator();
+    }
+}
+
+void VelocityVerlet::integrate(std::vector<Particle*> &particles,
+                               ParticleForceRegistry &registry,
+                               real duration)
+{
+    assert(duration > 0.0);
+
+    unsigned count = (unsigned)particles.size();
+    appliedForces.resize(count);
+    startAccelerations.resize(count);
+
+    // Keep the forces added before the step, then work out the
+    // starting accelerations.
+    for (unsigned i = 0; i < count; i++)
+    {
+        appliedForces[i] = particles[i]->getAccumulatedForce();
+    }
+    registry.updateForces(duration);
+
+    real halfDuration = duration * (real)0.5;
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *p = particles[i];
+        real inverseMass = p->getInverseMass();
+        if (inverseMass <= 0) continue;
+
+        Vector3 acceleration = p->getAcceleration();
+        acceleration.addScaledVector(p->getAccumulatedForce(), inverseMass);
+        startAccelerations[i] = acceleration;
+
+        // Move the particle, and predict its velocity so that any
+        // velocity dependent forces see something sensible.
+        Vector3 velocity = p->getVelocity();
+        Vector3 position = p->getPosition();
+        position.addScaledVector(velocity, duration);
+        position.addScaledVector(acceleration, duration * halfDuration);
+        p->setPosition(position);
+
+        velocity.addScaledVector(acceleration, duration);
+        p->setVelocity(velocity);
+    }
+
+    // Evaluate the forces again at the new positions.
+    for (unsigned i = 0; i < count; i++)
+    {
+        particles[i]->clearAccumulator();
+        particles[i]->addForce(appliedForces[i]);
+    }
+    registry.updateForces(duration);
+
+    // Correct the velocities with the average of the accelerations.
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *p = particles[i];
+        real inverseMass = p->getInverseMass();
+        if (inverseMass > 0)
+        {
+            Vector3 acceleration = p->getAcceleration();
+            acceleration.addScaledVector(p->getAccumulatedForce(),
+                                         inverseMass);
+            acceleration -= startAccelerations[i];
+
+            Vector3 velocity = p->getVelocity();
+            velocity.addScaledVector(acceleration, halfDuration);
+            velocity *= p->getDrag(duration);
+            p->setVelocity(velocity);
+        }
+        p->clearAccumulator();
+    }
+}
+
+void RungeKutta4::evaluate(std::vector<Particle*> &particles,
+                           ParticleForceRegistry &registry, real duration)
+{
+    unsigned count = (unsigned)particles.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        particles[i]->clearAccumulator();
+        particles[i]->addForce(appliedForces[i]);
+    }
+    registry.updateForces(duration);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *p = particles[i];
+        velocities[i] = p->getVelocity();
+        accelerations[i] = p->getAcceleration();
+        accelerations[i].addScaledVector(p->getAccumulatedForce(),
+                                         p->getInverseMass());
+    }
+}
+
+void RungeKutta4::integrate(std::vector<Particle*> &particles,
+                            ParticleForceRegistry &registry,
+                            real duration)
+{
+    assert(duration > 0.0);
+
+    unsigned count = (unsigned)particles.size();
+    appliedForces.resize(count);
+    startPositions.resize(count);
+    startVelocities.resize(count);
+    velocitySums.resize(count);
+    accelerationSums.resize(count);
+    velocities.resize(count);
+    accelerations.resize(count);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *p = particles[i];
+        appliedForces[i] = p->getAccumulatedForce();
+        startPositions[i] = p->getPosition();
+        startVelocities[i] = p->getVelocity();
+        velocitySums[i].clear();
+        accelerationSums[i].clear();
+    }
+
+    // The four evaluations: at the start, twice at the midpoint and
+    // at the end. Each is made from the start of the step with the
+    // rates found by the one before it.
+    static const real offsets[4] = { 0, 0.5, 0.5, 1 };
+    static const real weights[4] = { 1, 2, 2, 1 };
+    for (unsigned stage = 0; stage < 4; stage++)
+    {
+        if (stage > 0)
+        {
+            real step = duration * offsets[stage];
+            for (unsigned i = 0; i < count; i++)
+            {
+                Particle *p = particles[i];
+                if (p->getInverseMass() <= 0) continue;
+
+                Vector3 position = startPositions[i];
+                position.addScaledVector(velocities[i], step);
+                p->setPosition(position);
+
+                Vector3 velocity = startVelocities[i];
+                velocity.addScaledVector(accelerations[i], step);
+                p->setVelocity(velocity);
+            }
+        }
+
+        evaluate(particles, registry, duration);
+
+        for (unsigned i = 0; i < count; i++)
+        {
+            velocitySums[i].addScaledVector(velocities[i], weights[stage]);
+            accelerationSums[i].addScaledVector(accelerations[i],
+                                                weights[stage]);
+        }
+    }
+
+    // Blend the evaluations into the final state.
+    real sixth = duration / (real)6;
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *p = particles[i];
+        if (p->getInverseMass() > 0)
+        {
+            Vector3 position = startPositions[i];
+            position.addScaledVector(velocitySums[i], sixth);
+            p->setPosition(position);
+
+            Vector3 velocity = startVelocities[i];
+            velocity.addScaledVector(accelerationSums[i], sixth);
+            velocity *= p->getDrag(duration);
+            p->setVelocity(velocity);
+        }
+        p->clearAccumulator();
+    }
+}
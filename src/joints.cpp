@@ -81,4 +81,407 @@ unsigned PointJoint::addContact( Contact *contact, unsigned limit ) const
     }
 
     return 0;
+}
+
+/*
+ * The constraint solver leaves immovable bodies alone, whether they
+ * are missing, static or kinematic, or just have infinite mass.
+ */
+static inline bool isDynamic(const RigidBody *body)
+{
+    return body && body->getBodyType() == RigidBody::DYNAMIC_BODY &&
+        body->getInverseMass() > 0;
+}
+
+Constraint::Constraint()
+:
+errorReduction((real)0.2),
+warmStarting((real)1.0),
+rowCount(0)
+{
+    body[0] = body[1] = NULL;
+    for (unsigned i = 0; i < MAX_ROWS; i++) rows[i].impulse = 0;
+}
+
+Constraint::~Constraint()
+{
+}
+
+void Constraint::set(RigidBody *a, const Vector3& a_pos,
+                     RigidBody *b, const Vector3& b_pos)
+{
+    body[0] = a;
+    body[1] = b;
+
+    position[0] = a_pos;
+    position[1] = b_pos;
+
+    // Impulses from a previous configuration mean nothing now.
+    for (unsigned i = 0; i < MAX_ROWS; i++) rows[i].impulse = 0;
+}
+
+Vector3 Constraint::getWorldAnchor(unsigned i) const
+{
+    if (body[i]) return body[i]->getPointInWorldSpace(position[i]);
+    return position[i];
+}
+
+Vector3 Constraint::getWorldDirection(unsigned i, const Vector3 &direction) const
+{
+    if (body[i]) return body[i]->getDirectionInWorldSpace(direction);
+    return direction;
+}
+
+/*
+ * Builds the rotation matrix of the given body (the identity for the
+ * world).
+ */
+static Matrix3 getRotation(const RigidBody *body)
+{
+    if (!body) return Matrix3(1,0,0, 0,1,0, 0,0,1);
+    return Matrix3(
+        body->getDirectionInWorldSpace(Vector3(1,0,0)),
+        body->getDirectionInWorldSpace(Vector3(0,1,0)),
+        body->getDirectionInWorldSpace(Vector3(0,0,1))
+        );
+}
+
+Matrix3 Constraint::calculateRelativeOrientation() const
+{
+    return getRotation(body[1]).transpose() * getRotation(body[0]);
+}
+
+Vector3 Constraint::calculateOrientationError(const Matrix3 &reference) const
+{
+    // Find the rotation from where the first body should be to where
+    // it is. For small angles the skew symmetric part of this holds
+    // the rotation vector.
+    Matrix3 error = getRotation(body[0]) *
+        (getRotation(body[1]) * reference).transpose();
+    return Vector3(
+        error.data[7] - error.data[5],
+        error.data[2] - error.data[6],
+        error.data[3] - error.data[1]
+        ) * (real)0.5;
+}
+
+void Constraint::setLinearRow(unsigned row, const Vector3 &direction,
+                              real error, real duration)
+{
+    ConstraintRow &r = rows[row];
+    r.linear = direction;
+    for (unsigned i = 0; i < 2; i++)
+    {
+        Vector3 relativePosition = getWorldAnchor(i);
+        if (body[i]) relativePosition -= body[i]->getPosition();
+        r.angular[i] = relativePosition % direction;
+    }
+    r.targetVelocity = -errorReduction * error / duration;
+    r.lowerLimit = -REAL_MAX;
+    r.upperLimit = REAL_MAX;
+}
+
+void Constraint::setAngularRow(unsigned row, const Vector3 &axis,
+                               real error, real duration)
+{
+    ConstraintRow &r = rows[row];
+    r.linear.clear();
+    r.angular[0] = axis;
+    r.angular[1] = axis;
+    r.targetVelocity = -errorReduction * error / duration;
+    r.lowerLimit = -REAL_MAX;
+    r.upperLimit = REAL_MAX;
+}
+
+void Constraint::setOrientationRows(unsigned row, const Matrix3 &reference,
+                                    real duration)
+{
+    Vector3 error = calculateOrientationError(reference);
+    setAngularRow(row, Vector3(1,0,0), error.x, duration);
+    setAngularRow(row + 1, Vector3(0,1,0), error.y, duration);
+    setAngularRow(row + 2, Vector3(0,0,1), error.z, duration);
+}
+
+void Constraint::applyImpulse(const ConstraintRow &row, real impulse)
+{
+    for (unsigned i = 0; i < 2; i++) if (isDynamic(body[i]))
+    {
+        // The second body receives the opposite impulse.
+        real sign = (i == 0)?impulse:-impulse;
+        body[i]->addVelocity(row.linear * (sign * body[i]->getInverseMass()));
+        body[i]->addRotation(row.angularPerUnitImpulse[i] * sign);
+    }
+}
+
+void Constraint::prepare(real duration)
+{
+    calculateRows(duration);
+
+    for (unsigned j = 0; j < rowCount; j++)
+    {
+        ConstraintRow &row = rows[j];
+
+        // Work out how the row's velocity responds to an impulse. This
+        // doesn't change during the frame, so it is only done once.
+        real inverseMass = 0;
+        for (unsigned i = 0; i < 2; i++)
+        {
+            if (!isDynamic(body[i]))
+            {
+                row.angularPerUnitImpulse[i].clear();
+                continue;
+            }
+            row.angularPerUnitImpulse[i] =
+                body[i]->getRotationChange(row.angular[i]);
+            inverseMass += body[i]->getInverseMass() *
+                (row.linear * row.linear);
+            inverseMass += row.angular[i] * row.angularPerUnitImpulse[i];
+        }
+        row.effectiveMass = (inverseMass > 0) ? (real)1.0/inverseMass : 0;
+
+        // Start from last frame's solution.
+        row.impulse *= warmStarting;
+        if (row.impulse < row.lowerLimit) row.impulse = row.lowerLimit;
+        if (row.impulse > row.upperLimit) row.impulse = row.upperLimit;
+        if (row.impulse != 0) applyImpulse(row, (real)row.impulse);
+    }
+}
+
+bool Constraint::solve(real velocityEpsilon)
+{
+    bool changed = false;
+    for (unsigned j = 0; j < rowCount; j++)
+    {
+        ConstraintRow &row = rows[j];
+
+        // Find the current relative velocity along the row.
+        real velocity = 0;
+        if (body[0])
+        {
+            velocity += row.linear * body[0]->getVelocity();
+            velocity += row.angular[0] * body[0]->getRotation();
+        }
+        if (body[1])
+        {
+            velocity -= row.linear * body[1]->getVelocity();
+            velocity -= row.angular[1] * body[1]->getRotation();
+        }
+
+        // Keep the total impulse within the row's limits.
+        real_accum total = row.impulse +
+            (row.targetVelocity - velocity) * row.effectiveMass;
+        if (total < row.lowerLimit) total = row.lowerLimit;
+        if (total > row.upperLimit) total = row.upperLimit;
+        real impulse = (real)(total - row.impulse);
+        row.impulse = total;
+        if (impulse == 0) continue;
+
+        applyImpulse(row, impulse);
+        if (row.effectiveMass > 0 &&
+            real_abs(impulse / row.effectiveMass) > velocityEpsilon)
+        {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void BallJoint::calculateRows(real duration)
+{
+    Vector3 error = getWorldAnchor(0) - getWorldAnchor(1);
+    setLinearRow(0, Vector3(1,0,0), error.x, duration);
+    setLinearRow(1, Vector3(0,1,0), error.y, duration);
+    setLinearRow(2, Vector3(0,0,1), error.z, duration);
+    rowCount = 3;
+}
+
+HingeJoint::HingeJoint()
+:
+limited(false),
+limitState(0)
+{
+}
+
+void HingeJoint::set(RigidBody *a, const Vector3& a_pos, const Vector3& a_axis,
+                     RigidBody *b, const Vector3& b_pos, const Vector3& b_axis)
+{
+    Constraint::set(a, a_pos, b, b_pos);
+    axis[0] = a_axis;
+    axis[1] = b_axis;
+    axis[0].normalise();
+    axis[1].normalise();
+    limitState = 0;
+}
+
+void HingeJoint::setLimits(real lower, real upper)
+{
+    limited = true;
+    lowerAngle = lower;
+    upperAngle = upper;
+
+    // Take any direction at right angles to the first body's axis,
+    // and find the same direction on the second body.
+    Vector3 axisWorld = getWorldDirection(0, axis[0]);
+    Vector3 other = (real_abs(axisWorld.x) < (real)0.57) ?
+        Vector3(1,0,0) : Vector3(0,1,0);
+    Vector3 referenceWorld = axisWorld % other;
+    referenceWorld.normalise();
+
+    reference[0] = body[0] ?
+        body[0]->getDirectionInLocalSpace(referenceWorld) : referenceWorld;
+    reference[1] = body[1] ?
+        body[1]->getDirectionInLocalSpace(referenceWorld) : referenceWorld;
+}
+
+void HingeJoint::clearLimits()
+{
+    limited = false;
+}
+
+void HingeJoint::calculateRows(real duration)
+{
+    // Keep the connection points together.
+    Vector3 error = getWorldAnchor(0) - getWorldAnchor(1);
+    setLinearRow(0, Vector3(1,0,0), error.x, duration);
+    setLinearRow(1, Vector3(0,1,0), error.y, duration);
+    setLinearRow(2, Vector3(0,0,1), error.z, duration);
+
+    // Keep the axes lined up, by stopping any turning at right angles
+    // to the hinge.
+    Vector3 axisWorld[2];
+    axisWorld[0] = getWorldDirection(0, axis[0]);
+    axisWorld[1] = getWorldDirection(1, axis[1]);
+
+    Vector3 other = (real_abs(axisWorld[0].x) < (real)0.57) ?
+        Vector3(1,0,0) : Vector3(0,1,0);
+    Vector3 tangent[2];
+    tangent[0] = axisWorld[0] % other;
+    tangent[0].normalise();
+    tangent[1] = axisWorld[0] % tangent[0];
+
+    Vector3 misalignment = axisWorld[1] % axisWorld[0];
+    setAngularRow(3, tangent[0], misalignment * tangent[0], duration);
+    setAngularRow(4, tangent[1], misalignment * tangent[1], duration);
+    rowCount = 5;
+
+    if (!limited)
+    {
+        limitState = 0;
+        return;
+    }
+
+    // Measure how far the first body has turned about the hinge.
+    Vector3 referenceWorld[2];
+    referenceWorld[0] = getWorldDirection(0, reference[0]);
+    referenceWorld[1] = getWorldDirection(1, reference[1]);
+    real angle = (real)atan2(
+        (referenceWorld[1] % referenceWorld[0]) * axisWorld[0],
+        referenceWorld[1] * referenceWorld[0]
+        );
+
+    int state = 0;
+    if (angle < lowerAngle) state = -1;
+    else if (angle > upperAngle) state = 1;
+
+    // A limit only pushes one way, and its impulse is only meaningful
+    // while the same limit stays in force.
+    if (state != limitState) rows[5].impulse = 0;
+    limitState = state;
+    if (state == 0) return;
+
+    setAngularRow(5, axisWorld[0],
+        angle - (state < 0 ? lowerAngle : upperAngle), duration);
+    if (state < 0) rows[5].lowerLimit = 0;
+    else rows[5].upperLimit = 0;
+    rowCount = 6;
+}
+
+SliderJoint::SliderJoint()
+:
+limited(false),
+limitState(0)
+{
+}
+
+void SliderJoint::set(RigidBody *a, const Vector3& a_pos,
+                      RigidBody *b, const Vector3& b_pos,
+                      const Vector3& axis)
+{
+    Constraint::set(a, a_pos, b, b_pos);
+    SliderJoint::axis = axis;
+    SliderJoint::axis.normalise();
+    referenceOrientation = calculateRelativeOrientation();
+    limitState = 0;
+}
+
+void SliderJoint::setLimits(real lower, real upper)
+{
+    limited = true;
+    lowerDistance = lower;
+    upperDistance = upper;
+}
+
+void SliderJoint::clearLimits()
+{
+    limited = false;
+}
+
+void SliderJoint::calculateRows(real duration)
+{
+    // Stop the bodies turning relative to one another.
+    setOrientationRows(0, referenceOrientation, duration);
+
+    // Keep the connection points on the line of the slide.
+    Vector3 axisWorld = getWorldDirection(0, axis);
+    Vector3 other = (real_abs(axisWorld.x) < (real)0.57) ?
+        Vector3(1,0,0) : Vector3(0,1,0);
+    Vector3 tangent[2];
+    tangent[0] = axisWorld % other;
+    tangent[0].normalise();
+    tangent[1] = axisWorld % tangent[0];
+
+    Vector3 separation = getWorldAnchor(0) - getWorldAnchor(1);
+    setLinearRow(3, tangent[0], separation * tangent[0], duration);
+    setLinearRow(4, tangent[1], separation * tangent[1], duration);
+    rowCount = 5;
+
+    if (!limited)
+    {
+        limitState = 0;
+        return;
+    }
+
+    real distance = separation * axisWorld;
+    int state = 0;
+    if (distance < lowerDistance) state = -1;
+    else if (distance > upperDistance) state = 1;
+
+    // As for the hinge, a limit's impulse only carries over while the
+    // same limit stays in force.
+    if (state != limitState) rows[5].impulse = 0;
+    limitState = state;
+    if (state == 0) return;
+
+    setLinearRow(5, axisWorld,
+        distance - (state < 0 ? lowerDistance : upperDistance), duration);
+    if (state < 0) rows[5].lowerLimit = 0;
+    else rows[5].upperLimit = 0;
+    rowCount = 6;
+}
+
+void FixedJoint::set(RigidBody *a, const Vector3& a_pos,
+                     RigidBody *b, const Vector3& b_pos)
+{
+    Constraint::set(a, a_pos, b, b_pos);
+    referenceOrientation = calculateRelativeOrientation();
+}
+
+void FixedJoint::calculateRows(real duration)
+{
+    Vector3 error = getWorldAnchor(0) - getWorldAnchor(1);
+    setLinearRow(0, Vector3(1,0,0), error.x, duration);
+    setLinearRow(1, Vector3(0,1,0), error.y, duration);
+    setLinearRow(2, Vector3(0,0,1), error.z, duration);
+    setOrientationRows(3, referenceOrientation, duration);
+    rowCount = 6;
 }
\ No newline at end of file
@@ -22,6 +22,12 @@ using namespace cyclone;
  * --------------------------------------------------------------------------
  */
 
+Particle::Particle()
+:
+dragDuration(0)
+{
+}
+
 void Particle::integrate(real duration)
 {
     // We don't integrate things with zero mass.
@@ -40,12 +46,31 @@ void Particle::integrate(real duration)
     velocity.addScaledVector(resultingAcc, duration);
 
     // Impose drag.
-    velocity *= real_pow(damping, duration);
+    velocity *= getDrag(duration);
 
     // Clear the forces.
     clearAccumulator();
 }
 
+void Particle::predictPosition(real duration)
+{
+    // We don't integrate things with zero mass.
+    if (inverseMass <= 0.0f) return;
+
+    assert(duration > 0.0);
+
+    // Work out the acceleration from the force
+    Vector3 resultingAcc = acceleration;
+    resultingAcc.addScaledVector(forceAccum, inverseMass);
+
+    // Update linear velocity from the acceleration, and impose drag.
+    velocity.addScaledVector(resultingAcc, duration);
+    velocity *= getDrag(duration);
+
+    // Update linear position with the new velocity.
+    position.addScaledVector(velocity, duration);
+}
+
 
 
 void Particle::setMass(const real mass)
@@ -81,6 +106,7 @@ bool Particle::hasFiniteMass() const
 void Particle::setDamping(const real damping)
 {
     Particle::damping = damping;
+    dragDuration = 0;
 }
 
 real Particle::getDamping() const
@@ -88,6 +114,16 @@ real Particle::getDamping() const
     return damping;
 }
 
+real Particle::getDrag(real duration)
+{
+    if (duration != dragDuration)
+    {
+        drag = real_pow(damping, duration);
+        dragDuration = duration;
+    }
+    return drag;
+}
+
 void Particle::setPosition(const Vector3 &position)
 {
     Particle::position = position;
@@ -163,3 +199,8 @@ void Particle::addForce(const Vector3 &force)
 {
     forceAccum += force;
 }
+
+Vector3 Particle::getAccumulatedForce() const
+{
+    return forceAccum;
+}
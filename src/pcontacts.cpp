@@ -11,6 +11,7 @@
  */
 
 #include <cyclone/pcontacts.h>
+#include <algorithm>
 
 using namespace cyclone;
 
@@ -43,23 +44,8 @@ void ParticleContact::resolveVelocity(real duration)
     }
 
     // Calculate the new separating velocity
-    real newSepVelocity = -separatingVelocity * restitution;
-
-    // Check the velocity build-up due to acceleration only
-    Vector3 accCausedVelocity = particle[0]->getAcceleration();
-    if (particle[1]) accCausedVelocity -= particle[1]->getAcceleration();
-    real accCausedSepVelocity = accCausedVelocity * contactNormal * duration;
-
-    // If we've got a closing velocity due to acelleration build-up,
-    // remove it from the new separating velocity
-    if (accCausedSepVelocity < 0)
-    {
-        newSepVelocity += restitution * accCausedSepVelocity;
-
-        // Make sure we haven't removed more than was
-        // there to remove.
-        if (newSepVelocity < 0) newSepVelocity = 0;
-    }
+    real newSepVelocity = calculateTargetVelocity(separatingVelocity,
+        duration);
 
     real deltaVelocity = newSepVelocity - separatingVelocity;
 
@@ -92,6 +78,31 @@ void ParticleContact::resolveVelocity(real duration)
     }
 }
 
+real ParticleContact::calculateTargetVelocity(real separatingVelocity,
+                                              real duration) const
+{
+    // Calculate the new separating velocity
+    real newSepVelocity = -separatingVelocity * restitution;
+
+    // Check the velocity build-up due to acceleration only
+    Vector3 accCausedVelocity = particle[0]->getAcceleration();
+    if (particle[1]) accCausedVelocity -= particle[1]->getAcceleration();
+    real accCausedSepVelocity = accCausedVelocity * contactNormal * duration;
+
+    // If we've got a closing velocity due to acelleration build-up,
+    // remove it from the new separating velocity
+    if (accCausedSepVelocity < 0)
+    {
+        newSepVelocity += restitution * accCausedSepVelocity;
+
+        // Make sure we haven't removed more than was
+        // there to remove.
+        if (newSepVelocity < 0) newSepVelocity = 0;
+    }
+
+    return newSepVelocity;
+}
+
 void ParticleContact::resolveInterpenetration(real duration)
 {
     // If we don't have any penetration, skip this step.
@@ -125,7 +136,10 @@ void ParticleContact::resolveInterpenetration(real duration)
 
 ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 :
-iterations(iterations)
+iterations(iterations),
+jacobi(false),
+sweeps(16),
+threads(1)
 {
 }
 
@@ -134,10 +148,24 @@ void ParticleContactResolver::setIterations(unsigned iterations)
     ParticleContactResolver::iterations = iterations;
 }
 
+void ParticleContactResolver::setJacobi(bool jacobi, unsigned sweeps,
+                                        unsigned threads)
+{
+    ParticleContactResolver::jacobi = jacobi;
+    ParticleContactResolver::sweeps = sweeps;
+    ParticleContactResolver::threads = threads > 0 ? threads : 1;
+}
+
 void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
                                               unsigned numContacts,
                                               real duration)
 {
+    if (jacobi)
+    {
+        resolveContactsJacobi(contactArray, numContacts, duration);
+        return;
+    }
+
     unsigned i;
 
     iterationsUsed = 0;
@@ -190,4 +218,269 @@ void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
 
         iterationsUsed++;
     }
-}
\ No newline at end of file
+}
+
+void ParticleContactResolver::indexParticles(ParticleContact *contactArray,
+                                             unsigned numContacts)
+{
+    int i;
+#ifdef _OPENMP
+    int workers = (int)threads;
+#endif
+
+    // Find each particle once.
+    particles.clear();
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        particles.push_back(contactArray[i].particle[0]);
+        if (contactArray[i].particle[1])
+        {
+            particles.push_back(contactArray[i].particle[1]);
+        }
+    }
+    std::sort(particles.begin(), particles.end());
+    particles.erase(std::unique(particles.begin(), particles.end()),
+        particles.end());
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++)
+        {
+            Particle *particle = contactArray[i].particle[b];
+            contactArray[i].particleIndex[b] = particle ?
+                (unsigned)(std::lower_bound(particles.begin(),
+                    particles.end(), particle) - particles.begin()) :
+                NO_PARTICLE;
+        }
+    }
+
+    // Then list the contacts on each particle: count them, turn the
+    // counts into starting points, and fill in the entries.
+    unsigned numParticles = (unsigned)particles.size();
+    adjacencyStarts.assign(numParticles + 1, 0);
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++)
+        {
+            unsigned index = contactArray[i].particleIndex[b];
+            if (index != NO_PARTICLE) adjacencyStarts[index + 1]++;
+        }
+    }
+    for (unsigned p = 0; p < numParticles; p++)
+    {
+        adjacencyStarts[p + 1] += adjacencyStarts[p];
+    }
+
+    adjacency.resize(adjacencyStarts[numParticles]);
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        for (unsigned b = 0; b < 2; b++)
+        {
+            unsigned index = contactArray[i].particleIndex[b];
+            if (index != NO_PARTICLE)
+            {
+                adjacency[adjacencyStarts[index]++] = i*2 + b;
+            }
+        }
+    }
+
+    // Filling in moved each start to the next particle's start.
+    for (unsigned p = numParticles; p > 0; p--)
+    {
+        adjacencyStarts[p] = adjacencyStarts[p - 1];
+    }
+    adjacencyStarts[0] = 0;
+}
+
+void ParticleContactResolver::applyChanges(bool velocity)
+{
+    int p;
+#ifdef _OPENMP
+    int workers = (int)threads;
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+    for (p = 0; p < (int)particles.size(); p++)
+    {
+        Vector3 total;
+        unsigned count = 0;
+        for (unsigned e = adjacencyStarts[p]; e < adjacencyStarts[p + 1]; e++)
+        {
+            unsigned entry = adjacency[e];
+            if (!contactActive[entry / 2]) continue;
+            total += contactChanges[entry];
+            count++;
+        }
+        if (count == 0) continue;
+
+        total *= ((real)1.0) / (real)count;
+        if (velocity)
+        {
+            particles[p]->setVelocity(particles[p]->getVelocity() + total);
+        }
+        else
+        {
+            particleMovements[p] += total;
+        }
+    }
+}
+
+void ParticleContactResolver::resolveContactsJacobi(
+    ParticleContact *contactArray, unsigned numContacts, real duration)
+{
+    int i;
+#ifdef _OPENMP
+    int workers = (int)threads;
+#endif
+
+    iterationsUsed = 0;
+    if (numContacts == 0) return;
+
+    indexParticles(contactArray, numContacts);
+    contactChanges.resize(numContacts * 2);
+    contactActive.resize(numContacts);
+    targetVelocities.resize(numContacts);
+    particleMovements.assign(particles.size(), Vector3());
+
+    // The bounce is worked out from the velocities before resolution,
+    // contacts that are separating just have to stay that way.
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        real separatingVelocity =
+            contactArray[i].calculateSeparatingVelocity();
+        targetVelocities[i] = separatingVelocity < 0 ?
+            contactArray[i].calculateTargetVelocity(separatingVelocity,
+                duration) :
+            0;
+    }
+
+    // Resolve velocities.
+    for (unsigned sweep = 0; sweep < sweeps; sweep++)
+    {
+        int changed = 0;
+
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:changed) schedule(static)
+#endif
+        for (i = 0; i < (int)numContacts; i++)
+        {
+            ParticleContact &contact = contactArray[i];
+            contactActive[i] = 0;
+
+            real deltaVelocity = targetVelocities[i] -
+                contact.calculateSeparatingVelocity();
+            if (deltaVelocity <= 0) continue;
+
+            real totalInverseMass = contact.particle[0]->getInverseMass();
+            if (contact.particle[1])
+            {
+                totalInverseMass += contact.particle[1]->getInverseMass();
+            }
+            if (totalInverseMass <= 0) continue;
+
+            Vector3 impulsePerIMass = contact.contactNormal *
+                (deltaVelocity / totalInverseMass);
+            contactChanges[i*2] =
+                impulsePerIMass * contact.particle[0]->getInverseMass();
+            if (contact.particle[1])
+            {
+                contactChanges[i*2 + 1] =
+                    impulsePerIMass * -contact.particle[1]->getInverseMass();
+            }
+            contactActive[i] = 1;
+            changed++;
+        }
+
+        if (!changed) break;
+        applyChanges(true);
+        iterationsUsed++;
+    }
+
+    // Resolve interpenetration. The movements are gathered and only
+    // applied at the end, the penetration of each contact is worked
+    // out from them as we go.
+    for (unsigned sweep = 0; sweep < sweeps; sweep++)
+    {
+        int changed = 0;
+
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(workers) if(workers > 1) reduction(+:changed) schedule(static)
+#endif
+        for (i = 0; i < (int)numContacts; i++)
+        {
+            ParticleContact &contact = contactArray[i];
+            contactActive[i] = 0;
+
+            Vector3 movement = particleMovements[contact.particleIndex[0]];
+            if (contact.particle[1])
+            {
+                movement -= particleMovements[contact.particleIndex[1]];
+            }
+            real penetration = contact.penetration -
+                movement * contact.contactNormal;
+            if (penetration <= 0) continue;
+
+            real totalInverseMass = contact.particle[0]->getInverseMass();
+            if (contact.particle[1])
+            {
+                totalInverseMass += contact.particle[1]->getInverseMass();
+            }
+            if (totalInverseMass <= 0) continue;
+
+            Vector3 movePerIMass = contact.contactNormal *
+                (penetration / totalInverseMass);
+            contactChanges[i*2] =
+                movePerIMass * contact.particle[0]->getInverseMass();
+            if (contact.particle[1])
+            {
+                contactChanges[i*2 + 1] =
+                    movePerIMass * -contact.particle[1]->getInverseMass();
+            }
+            contactActive[i] = 1;
+            changed++;
+        }
+
+        if (!changed) break;
+        applyChanges(false);
+        iterationsUsed++;
+    }
+
+    // Move the particles, and update the contacts to match.
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)particles.size(); i++)
+    {
+        particles[i]->setPosition(particles[i]->getPosition() +
+            particleMovements[i]);
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(workers) if(workers > 1) schedule(static)
+#endif
+    for (i = 0; i < (int)numContacts; i++)
+    {
+        ParticleContact &contact = contactArray[i];
+        contact.particleMovement[0] =
+            particleMovements[contact.particleIndex[0]];
+        if (contact.particle[1])
+        {
+            contact.particleMovement[1] =
+                particleMovements[contact.particleIndex[1]];
+        }
+        else
+        {
+            contact.particleMovement[1].clear();
+        }
+        contact.penetration -= (contact.particleMovement[0] -
+            contact.particleMovement[1]) * contact.contactNormal;
+    }
+}
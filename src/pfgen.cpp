@@ -15,21 +15,128 @@
 using namespace cyclone;
 
 
+Handle ParticleForceRegistry::add(Particle *particle, ParticleForceGenerator *fg)
+{
+    // Find the generator's batch, starting one if it is new.
+    std::map<ParticleForceGenerator*, unsigned>::iterator found =
+        batchIndices.find(fg);
+    if (found == batchIndices.end())
+    {
+        found = batchIndices.insert(
+            std::make_pair(fg, (unsigned)batches.size())).first;
+        batches.push_back(ParticleForceBatch());
+        batches.back().fg = fg;
+    }
+    ParticleForceBatch &batch = batches[found->second];
+
+    ParticleForceRegistry::ParticleForceRegistration registration;
+    registration.batch = found->second;
+    registration.position = (unsigned)batch.particles.size();
+    Handle handle = registrations.add(registration);
+
+    batch.particles.push_back(particle);
+    batch.handles.push_back(handle);
+    return handle;
+}
+
+void ParticleForceRegistry::add(Particle **particles, unsigned count,
+                                ParticleForceGenerator *fg, Handle *handles)
+{
+    registrations.reserve(registrations.size() + count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        Handle handle = add(particles[i], fg);
+        if (handles) handles[i] = handle;
+    }
+}
+
+bool ParticleForceRegistry::remove(const Handle &handle)
+{
+    ParticleForceRegistration *registration = registrations.get(handle);
+    if (!registration) return false;
+
+    // Move the last particle of the batch into the gap.
+    ParticleForceBatch &batch = batches[registration->batch];
+    unsigned position = registration->position;
+    unsigned last = (unsigned)batch.particles.size() - 1;
+    if (position != last)
+    {
+        batch.particles[position] = batch.particles[last];
+        batch.handles[position] = batch.handles[last];
+        registrations.get(batch.handles[position])->position = position;
+    }
+    batch.particles.pop_back();
+    batch.handles.pop_back();
+
+    registrations.remove(handle);
+    return true;
+}
+
+void ParticleForceRegistry::remove(Particle *particle, ParticleForceGenerator *fg)
+{
+    std::map<ParticleForceGenerator*, unsigned>::iterator found =
+        batchIndices.find(fg);
+    if (found == batchIndices.end()) return;
+
+    ParticleForceBatch &batch = batches[found->second];
+    for (unsigned i = 0; i < batch.particles.size(); i++)
+    {
+        if (batch.particles[i] == particle)
+        {
+            remove(batch.handles[i]);
+            return;
+        }
+    }
+}
+
 void ParticleForceRegistry::updateForces(real duration)
 {
-    Registry::iterator i = registrations.begin();
-    for (; i != registrations.end(); i++)
+    for (unsigned b = 0; b < batches.size(); b++)
+    {
+        ParticleForceBatch &batch = batches[b];
+        if (batch.particles.empty()) continue;
+        batch.fg->updateForces(&batch.particles[0],
+                               (unsigned)batch.particles.size(), duration);
+    }
+
+    for (unsigned i = 0; i < springSets.size(); i++)
     {
-        i->fg->updateForce(i->particle, duration);
+        springSets[i]->updateForces(duration);
     }
 }
 
-void ParticleForceRegistry::add(Particle* particle, ParticleForceGenerator *fg)
+void ParticleForceRegistry::add(ParticleSpringSet *springs)
 {
-    ParticleForceRegistry::ParticleForceRegistration registration;
-    registration.particle = particle;
-    registration.fg = fg;
-    registrations.push_back(registration);
+    springSets.push_back(springs);
+}
+
+void ParticleForceRegistry::remove(ParticleSpringSet *springs)
+{
+    for (unsigned i = 0; i < springSets.size(); i++)
+    {
+        if (springSets[i] == springs)
+        {
+            springSets.erase(springSets.begin() + i);
+            return;
+        }
+    }
+}
+
+void ParticleForceRegistry::clear()
+{
+    batches.clear();
+    batchIndices.clear();
+    registrations.clear();
+    springSets.clear();
+}
+
+void ParticleForceGenerator::updateForces(Particle **particles, unsigned count,
+                                          real duration)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        updateForce(particles[i], duration);
+    }
 }
 
 ParticleGravity::ParticleGravity(const Vector3& gravity)
@@ -46,6 +153,19 @@ void ParticleGravity::updateForce(Particle* particle, real duration)
     particle->addForce(gravity * particle->getMass());
 }
 
+void ParticleGravity::updateForces(Particle **particles, unsigned count,
+                                   real duration)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        // Particles with infinite mass don't move, so are skipped.
+        Particle *particle = particles[i];
+        if (particle->inverseMass <= 0) continue;
+        particle->forceAccum.addScaledVector(gravity,
+                                             1 / particle->inverseMass);
+    }
+}
+
 ParticleDrag::ParticleDrag(real k1, real k2)
 : k1(k1), k2(k2)
 {
@@ -66,6 +186,20 @@ void ParticleDrag::updateForce(Particle* particle, real duration)
     particle->addForce(force);
 }
 
+void ParticleDrag::updateForces(Particle **particles, unsigned count,
+                                real duration)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        // The drag is k1 v + k2 v^2 along -v, so scale the velocity
+        // by -(k1 + k2 v) rather than normalising it.
+        Particle *particle = particles[i];
+        real speed = particle->velocity.magnitude();
+        particle->forceAccum.addScaledVector(particle->velocity,
+                                             -(k1 + k2 * speed));
+    }
+}
+
 ParticleSpring::ParticleSpring(Particle *other, real sc, real rl)
 : other(other), springConstant(sc), restLength(rl)
 {
@@ -122,6 +256,25 @@ void ParticleBuoyancy::updateForce(Particle* particle, real duration)
     particle->addForce(force);
 }
 
+void ParticleBuoyancy::updateForces(Particle **particles, unsigned count,
+                                    real duration)
+{
+    real maxForce = liquidDensity * volume;
+    real top = waterHeight + maxDepth;
+    real bottom = waterHeight - maxDepth;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *particle = particles[i];
+        real depth = particle->position.y;
+        if (depth >= top) continue;
+
+        if (depth <= bottom) particle->forceAccum.y += maxForce;
+        else particle->forceAccum.y += maxForce *
+            (depth - maxDepth - waterHeight) / 2 * maxDepth;
+    }
+}
+
 ParticleBungee::ParticleBungee(Particle *other, real sc, real rl)
 : other(other), springConstant(sc), restLength(rl)
 {
@@ -233,3 +386,75 @@ void ParticleAnchoredSpring::updateForce(Particle* particle, real duration)
     force *= magnitude;
     particle->addForce(force);
 }
+
+unsigned ParticleSpringSet::add(Particle *first, Particle *second,
+                                real springConstant, real restLength,
+                                real damping, bool bungee)
+{
+    ends.push_back(first);
+    ends.push_back(second);
+    restLengths.push_back(restLength);
+    springConstants.push_back(springConstant);
+    dampings.push_back(damping);
+    bungees.push_back(bungee ? 1 : 0);
+    return (unsigned)restLengths.size() - 1;
+}
+
+unsigned ParticleSpringSet::addSpring(Particle *first, Particle *second,
+                                      real springConstant, real restLength,
+                                      real damping)
+{
+    return add(first, second, springConstant, restLength, damping, false);
+}
+
+unsigned ParticleSpringSet::addBungee(Particle *first, Particle *second,
+                                      real springConstant, real restLength,
+                                      real damping)
+{
+    return add(first, second, springConstant, restLength, damping, true);
+}
+
+unsigned ParticleSpringSet::getSpringCount() const
+{
+    return (unsigned)restLengths.size();
+}
+
+Particle* ParticleSpringSet::getSpringEnd(unsigned spring,
+                                          unsigned end) const
+{
+    return ends[spring*2 + end];
+}
+
+void ParticleSpringSet::clear()
+{
+    ends.clear();
+    restLengths.clear();
+    springConstants.clear();
+    dampings.clear();
+    bungees.clear();
+}
+
+void ParticleSpringSet::updateForces(real duration)
+{
+    unsigned count = (unsigned)restLengths.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *first = ends[i*2];
+        Particle *second = ends[i*2 + 1];
+
+        Vector3 direction = first->position - second->position;
+        real length = direction.magnitude();
+        if (length <= 0) continue;
+        direction *= ((real)1.0) / length;
+
+        // Work out the pull between the ends once.
+        real extension = length - restLengths[i];
+        if (bungees[i] && extension <= 0) continue;
+        real magnitude = springConstants[i] * extension +
+            dampings[i] * ((first->velocity - second->velocity) * direction);
+
+        // And apply it to both, in opposite directions.
+        first->forceAccum.addScaledVector(direction, -magnitude);
+        second->forceAccum.addScaledVector(direction, magnitude);
+    }
+}
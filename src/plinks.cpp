@@ -11,9 +11,62 @@
  */
 
 #include <cyclone/plinks.h>
+#include <algorithm>
+#include <assert.h>
 
 using namespace cyclone;
 
+/*
+ * Moves a particle and a second particle (or, if there is none, a
+ * fixed anchor) towards the given separation, with the given
+ * compliance. This is a single step of extended position based
+ * dynamics: lambda accumulates the correction over the substep, so
+ * that a compliant link converges on the spring force rather than on
+ * the rest length. Slack links (cables) only pull.
+ */
+static void projectDistance(Particle *first, Particle *second,
+                            const Vector3 &anchor, real length, bool slack,
+                            real compliance, real *lambda, real duration)
+{
+    Vector3 delta = first->getPosition() -
+        (second ? second->getPosition() : anchor);
+    real distance = delta.magnitude();
+    if (distance <= 0) return;
+
+    real error = distance - length;
+    if (slack && error <= 0) return;
+
+    real totalInverseMass = first->getInverseMass();
+    if (second) totalInverseMass += second->getInverseMass();
+
+    real alpha = compliance / (duration * duration);
+    if (totalInverseMass + alpha <= 0) return;
+
+    real deltaLambda = (-error - alpha * *lambda) /
+        (totalInverseMass + alpha);
+    *lambda += deltaLambda;
+
+    Vector3 move = delta * (deltaLambda / distance);
+    first->setPosition(first->getPosition() +
+        move * first->getInverseMass());
+    if (second)
+    {
+        second->setPosition(second->getPosition() -
+            move * second->getInverseMass());
+    }
+}
+
+ParticleLink::ParticleLink()
+:
+compliance(0), lambda(0)
+{
+}
+
+void ParticleLink::resetProjection()
+{
+    lambda = 0;
+}
+
 real ParticleLink::currentLength() const
 {
     Vector3 relativePos = particle[0]->getPosition() -
@@ -48,6 +101,13 @@ unsigned ParticleCable::addContact(ParticleContact *contact,
     return 1;
 }
 
+bool ParticleCable::projectPositions(real duration)
+{
+    projectDistance(particle[0], particle[1], Vector3(), maxLength, true,
+        compliance, &lambda, duration);
+    return true;
+}
+
 unsigned ParticleRod::addContact(ParticleContact *contact,
                                   unsigned limit) const
 {
@@ -83,6 +143,24 @@ unsigned ParticleRod::addContact(ParticleContact *contact,
     return 1;
 }
 
+bool ParticleRod::projectPositions(real duration)
+{
+    projectDistance(particle[0], particle[1], Vector3(), length, false,
+        compliance, &lambda, duration);
+    return true;
+}
+
+ParticleConstraint::ParticleConstraint()
+:
+compliance(0), lambda(0)
+{
+}
+
+void ParticleConstraint::resetProjection()
+{
+    lambda = 0;
+}
+
 real ParticleConstraint::currentLength() const
 {
     Vector3 relativePos = particle->getPosition() - anchor;
@@ -116,6 +194,13 @@ unsigned ParticleCableConstraint::addContact(ParticleContact *contact,
     return 1;
 }
 
+bool ParticleCableConstraint::projectPositions(real duration)
+{
+    projectDistance(particle, NULL, anchor, maxLength, true,
+        compliance, &lambda, duration);
+    return true;
+}
+
 unsigned ParticleRodConstraint::addContact(ParticleContact *contact,
                                  unsigned limit) const
 {
@@ -149,4 +234,491 @@ unsigned ParticleRodConstraint::addContact(ParticleContact *contact,
     contact->restitution = 0;
 
     return 1;
-}
\ No newline at end of file
+}
+
+bool ParticleRodConstraint::projectPositions(real duration)
+{
+    projectDistance(particle, NULL, anchor, length, false,
+        compliance, &lambda, duration);
+    return true;
+}
+
+ParticleLinkSet::ParticleLinkSet()
+:
+compiled(true),
+direct(false)
+{
+}
+
+void ParticleLinkSet::addLink(Particle *first, Particle *second,
+                              const Vector3 &anchor, LinkType type,
+                              real length, real restitution,
+                              real compliance)
+{
+    linkParticles.push_back(first);
+    linkParticles.push_back(second);
+    anchors.push_back(anchor);
+    lengths.push_back(length);
+    types.push_back((unsigned char)type);
+    restitutions.push_back(restitution);
+    compliances.push_back(compliance);
+    lambdas.push_back(0);
+    compiled = false;
+}
+
+void ParticleLinkSet::addRod(Particle *first, Particle *second, real length,
+                             real compliance)
+{
+    addLink(first, second, Vector3(), ROD, length, 0, compliance);
+}
+
+void ParticleLinkSet::addCable(Particle *first, Particle *second,
+                               real maxLength, real restitution,
+                               real compliance)
+{
+    addLink(first, second, Vector3(), CABLE, maxLength, restitution,
+        compliance);
+}
+
+void ParticleLinkSet::addAnchoredRod(Particle *particle,
+                                     const Vector3 &anchor, real length,
+                                     real compliance)
+{
+    addLink(particle, NULL, anchor, ROD, length, 0, compliance);
+}
+
+void ParticleLinkSet::addAnchoredCable(Particle *particle,
+                                       const Vector3 &anchor,
+                                       real maxLength, real restitution,
+                                       real compliance)
+{
+    addLink(particle, NULL, anchor, CABLE, maxLength, restitution,
+        compliance);
+}
+
+/*
+ * Orders particle indices by the number of links they have.
+ */
+struct DegreeLess
+{
+    const std::vector<unsigned> *starts;
+
+    bool operator()(unsigned a, unsigned b) const
+    {
+        return (*starts)[a+1] - (*starts)[a] < (*starts)[b+1] - (*starts)[b];
+    }
+};
+
+/*
+ * Orders link indices by their particles.
+ */
+struct EndpointLess
+{
+    const std::vector<unsigned> *endpoints;
+
+    bool operator()(unsigned a, unsigned b) const
+    {
+        unsigned a0 = (*endpoints)[a*2], a1 = (*endpoints)[a*2+1];
+        unsigned b0 = (*endpoints)[b*2], b1 = (*endpoints)[b*2+1];
+        if (a1 < a0) std::swap(a0, a1);
+        if (b1 < b0) std::swap(b0, b1);
+        return a0 < b0 || (a0 == b0 && a1 < b1);
+    }
+};
+
+/*
+ * Rearranges the given per-link array into the given order.
+ */
+template<class T>
+static void reorder(std::vector<T> &values, const std::vector<unsigned> &order,
+                    unsigned stride)
+{
+    std::vector<T> sorted(values.size());
+    for (unsigned i = 0; i < order.size(); i++)
+    {
+        for (unsigned j = 0; j < stride; j++)
+        {
+            sorted[i*stride + j] = values[order[i]*stride + j];
+        }
+    }
+    values.swap(sorted);
+}
+
+void ParticleLinkSet::compile()
+{
+    unsigned numLinks = (unsigned)lengths.size();
+    unsigned i;
+
+    // Find each particle once.
+    std::vector<Particle*> sorted;
+    for (i = 0; i < numLinks*2; i++)
+    {
+        if (linkParticles[i]) sorted.push_back(linkParticles[i]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    unsigned numParticles = (unsigned)sorted.size();
+
+    endpoints.resize(numLinks*2);
+    for (i = 0; i < numLinks*2; i++)
+    {
+        endpoints[i] = linkParticles[i] ?
+            (unsigned)(std::lower_bound(sorted.begin(), sorted.end(),
+                linkParticles[i]) - sorted.begin()) :
+            NO_PARTICLE;
+    }
+
+    // List the particles linked to each particle.
+    std::vector<unsigned> starts(numParticles + 1, 0);
+    for (i = 0; i < numLinks; i++)
+    {
+        if (endpoints[i*2+1] == NO_PARTICLE) continue;
+        starts[endpoints[i*2] + 1]++;
+        starts[endpoints[i*2+1] + 1]++;
+    }
+    for (i = 0; i < numParticles; i++) starts[i+1] += starts[i];
+    std::vector<unsigned> fill(starts.begin(), starts.end() - 1);
+    std::vector<unsigned> neighbours(starts[numParticles]);
+    for (i = 0; i < numLinks; i++)
+    {
+        unsigned a = endpoints[i*2], b = endpoints[i*2+1];
+        if (b == NO_PARTICLE) continue;
+        neighbours[fill[a]++] = b;
+        neighbours[fill[b]++] = a;
+    }
+
+    // Number the particles breadth first through the links, starting
+    // each connected piece from its least connected particle
+    // (Cuthill-McKee ordering), so linked particles end up close.
+    std::vector<unsigned> seeds(numParticles);
+    for (i = 0; i < numParticles; i++) seeds[i] = i;
+    DegreeLess degreeLess;
+    degreeLess.starts = &starts;
+    std::stable_sort(seeds.begin(), seeds.end(), degreeLess);
+
+    std::vector<unsigned> newIndex(numParticles, NO_PARTICLE);
+    std::vector<unsigned> order;
+    order.reserve(numParticles);
+    for (i = 0; i < numParticles; i++)
+    {
+        if (newIndex[seeds[i]] != NO_PARTICLE) continue;
+        newIndex[seeds[i]] = (unsigned)order.size();
+        order.push_back(seeds[i]);
+
+        for (unsigned next = (unsigned)order.size() - 1;
+            next < order.size(); next++)
+        {
+            unsigned p = order[next];
+            for (unsigned n = starts[p]; n < starts[p+1]; n++)
+            {
+                if (newIndex[neighbours[n]] != NO_PARTICLE) continue;
+                newIndex[neighbours[n]] = (unsigned)order.size();
+                order.push_back(neighbours[n]);
+            }
+        }
+    }
+
+    particles.resize(numParticles);
+    for (i = 0; i < numParticles; i++) particles[newIndex[i]] = sorted[i];
+    for (i = 0; i < numLinks*2; i++)
+    {
+        if (endpoints[i] != NO_PARTICLE) endpoints[i] = newIndex[endpoints[i]];
+    }
+
+    // Then order the links by the particles they join.
+    std::vector<unsigned> linkOrder(numLinks);
+    for (i = 0; i < numLinks; i++) linkOrder[i] = i;
+    EndpointLess endpointLess;
+    endpointLess.endpoints = &endpoints;
+    std::stable_sort(linkOrder.begin(), linkOrder.end(), endpointLess);
+
+    reorder(endpoints, linkOrder, 2);
+    reorder(linkParticles, linkOrder, 2);
+    reorder(anchors, linkOrder, 1);
+    reorder(lengths, linkOrder, 1);
+    reorder(types, linkOrder, 1);
+    reorder(restitutions, linkOrder, 1);
+    reorder(compliances, linkOrder, 1);
+    lambdas.assign(numLinks, 0);
+
+    compileRodSystem();
+    compiled = true;
+}
+
+void ParticleLinkSet::compileRodSystem()
+{
+    unsigned numLinks = (unsigned)lengths.size();
+    unsigned numParticles = (unsigned)particles.size();
+    unsigned i;
+
+    rods.clear();
+    for (i = 0; i < numLinks; i++)
+    {
+        if (types[i] == ROD) rods.push_back(i);
+    }
+    unsigned numRods = (unsigned)rods.size();
+
+    // List the rods on each particle. Rods are added in order, so
+    // each list is sorted.
+    std::vector<unsigned> starts(numParticles + 1, 0);
+    for (i = 0; i < numRods; i++)
+    {
+        for (unsigned end = 0; end < 2; end++)
+        {
+            unsigned p = endpoints[rods[i]*2 + end];
+            if (p != NO_PARTICLE) starts[p + 1]++;
+        }
+    }
+    for (i = 0; i < numParticles; i++) starts[i+1] += starts[i];
+    std::vector<unsigned> fill(starts.begin(), starts.end() - 1);
+    std::vector<unsigned> particleRods(starts[numParticles]);
+    for (i = 0; i < numRods; i++)
+    {
+        for (unsigned end = 0; end < 2; end++)
+        {
+            unsigned p = endpoints[rods[i]*2 + end];
+            if (p != NO_PARTICLE) particleRods[fill[p]++] = i;
+        }
+    }
+
+    // Every pair of rods sharing a particle couples their rows.
+    couplings.clear();
+    rowFirst.resize(numRods);
+    for (i = 0; i < numRods; i++) rowFirst[i] = i;
+    for (unsigned p = 0; p < numParticles; p++)
+    {
+        for (unsigned a = starts[p]; a < starts[p+1]; a++)
+        {
+            for (unsigned b = starts[p]; b < a; b++)
+            {
+                unsigned row = particleRods[a], col = particleRods[b];
+                couplings.push_back(row);
+                couplings.push_back(col);
+                couplings.push_back(p);
+                if (col < rowFirst[row]) rowFirst[row] = col;
+            }
+        }
+    }
+
+    rowStart.resize(numRods + 1);
+    rowStart[0] = 0;
+    for (i = 0; i < numRods; i++)
+    {
+        rowStart[i+1] = rowStart[i] + (i - rowFirst[i]) + 1;
+    }
+    envelope.resize(rowStart[numRods]);
+    rodSolution.resize(numRods);
+    rodDirections.resize(numRods);
+}
+
+void ParticleLinkSet::setDirect(bool direct)
+{
+    ParticleLinkSet::direct = direct;
+}
+
+void ParticleLinkSet::projectRodsDirect(real duration)
+{
+    unsigned numRods = (unsigned)rods.size();
+    if (numRods == 0) return;
+
+    real inverseSquareDuration = ((real)1.0) / (duration * duration);
+    std::fill(envelope.begin(), envelope.end(), (real)0);
+
+    // Build the system: each row says how far a rod is from its
+    // length, and how moving along every rod sharing its particles
+    // changes that.
+    for (unsigned r = 0; r < numRods; r++)
+    {
+        unsigned link = rods[r];
+        Particle *first = particles[endpoints[link*2]];
+        Particle *second = endpoints[link*2+1] == NO_PARTICLE ?
+            NULL : particles[endpoints[link*2+1]];
+
+        Vector3 delta = first->getPosition() -
+            (second ? second->getPosition() : anchors[link]);
+        real distance = delta.magnitude();
+        rodDirections[r] = distance > 0 ?
+            delta * (((real)1.0) / distance) : Vector3();
+
+        real alpha = compliances[link] * inverseSquareDuration;
+        real diagonal = alpha;
+        if (distance > 0)
+        {
+            diagonal += first->getInverseMass();
+            if (second) diagonal += second->getInverseMass();
+        }
+        envelope[rowStart[r+1] - 1] = diagonal;
+        rodSolution[r] = lengths[link] - distance - alpha * lambdas[link];
+    }
+
+    for (unsigned c = 0; c < couplings.size(); c += 3)
+    {
+        unsigned row = couplings[c], col = couplings[c+1];
+        unsigned p = couplings[c+2];
+
+        // Each rod pulls its first end along its direction and its
+        // second end against it.
+        real sign = 1;
+        if (endpoints[rods[row]*2] != p) sign = -sign;
+        if (endpoints[rods[col]*2] != p) sign = -sign;
+
+        envelope[rowStart[row] + col - rowFirst[row]] += sign *
+            particles[p]->getInverseMass() *
+            (rodDirections[row] * rodDirections[col]);
+    }
+
+    // Factorise it (into L D L transpose), within each row's envelope.
+    for (unsigned i = 0; i < numRods; i++)
+    {
+        real *row = &envelope[rowStart[i]] - rowFirst[i];
+        for (unsigned j = rowFirst[i]; j < i; j++)
+        {
+            const real *other = &envelope[rowStart[j]] - rowFirst[j];
+            unsigned k = rowFirst[i] > rowFirst[j] ? rowFirst[i] : rowFirst[j];
+            for (; k < j; k++) row[j] -= row[k] * other[k];
+        }
+
+        real pivot = row[i];
+        for (unsigned j = rowFirst[i]; j < i; j++)
+        {
+            real factor = row[j] / envelope[rowStart[j+1] - 1];
+            pivot -= row[j] * factor;
+            row[j] = factor;
+        }
+
+        // A rod that repeats what the others already do adds nothing:
+        // give it infinite inertia so it doesn't take part.
+        if (pivot <= row[i] * (real)1e-6) pivot = REAL_MAX;
+        row[i] = pivot;
+    }
+
+    // Then solve it.
+    for (unsigned i = 0; i < numRods; i++)
+    {
+        const real *row = &envelope[rowStart[i]] - rowFirst[i];
+        for (unsigned j = rowFirst[i]; j < i; j++)
+        {
+            rodSolution[i] -= row[j] * rodSolution[j];
+        }
+    }
+    for (unsigned i = 0; i < numRods; i++)
+    {
+        rodSolution[i] /= envelope[rowStart[i+1] - 1];
+    }
+    for (unsigned i = numRods; i > 0; i--)
+    {
+        const real *row = &envelope[rowStart[i-1]] - rowFirst[i-1];
+        for (unsigned j = rowFirst[i-1]; j < i-1; j++)
+        {
+            rodSolution[j] -= row[j] * rodSolution[i-1];
+        }
+    }
+
+    // And move the particles.
+    for (unsigned r = 0; r < numRods; r++)
+    {
+        unsigned link = rods[r];
+        lambdas[link] += rodSolution[r];
+
+        Vector3 move = rodDirections[r] * rodSolution[r];
+        Particle *first = particles[endpoints[link*2]];
+        first->setPosition(first->getPosition() +
+            move * first->getInverseMass());
+        if (endpoints[link*2+1] != NO_PARTICLE)
+        {
+            Particle *second = particles[endpoints[link*2+1]];
+            second->setPosition(second->getPosition() -
+                move * second->getInverseMass());
+        }
+    }
+}
+
+unsigned ParticleLinkSet::getLinkCount() const
+{
+    return (unsigned)lengths.size();
+}
+
+Particle* ParticleLinkSet::getLinkParticle(unsigned link, unsigned end) const
+{
+    return linkParticles[link*2 + end];
+}
+
+const Vector3& ParticleLinkSet::getLinkAnchor(unsigned link) const
+{
+    return anchors[link];
+}
+
+unsigned ParticleLinkSet::addContact(ParticleContact *contact,
+                                     unsigned limit) const
+{
+    assert(compiled);
+
+    unsigned used = 0;
+    unsigned numLinks = (unsigned)lengths.size();
+    for (unsigned i = 0; i < numLinks && used < limit; i++)
+    {
+        Particle *first = particles[endpoints[i*2]];
+        Particle *second = endpoints[i*2+1] == NO_PARTICLE ?
+            NULL : particles[endpoints[i*2+1]];
+
+        // Find the length of the link
+        Vector3 normal = (second ? second->getPosition() : anchors[i]) -
+            first->getPosition();
+        real currentLen = normal.magnitude();
+        real length = lengths[i];
+
+        // Check if the link needs a contact: cables only when they
+        // are over-extended, rods whenever they are the wrong length.
+        if (types[i] == CABLE ? currentLen < length : currentLen == length)
+        {
+            continue;
+        }
+
+        contact->particle[0] = first;
+        contact->particle[1] = second;
+
+        normal.normalise();
+        if (types[i] == CABLE || currentLen > length)
+        {
+            contact->contactNormal = normal;
+            contact->penetration = currentLen - length;
+        }
+        else
+        {
+            contact->contactNormal = normal * -1;
+            contact->penetration = length - currentLen;
+        }
+
+        // Rods always use zero restitution
+        contact->restitution = types[i] == CABLE ? restitutions[i] : 0;
+
+        contact++;
+        used++;
+    }
+    return used;
+}
+
+bool ParticleLinkSet::projectPositions(real duration)
+{
+    assert(compiled);
+
+    if (direct) projectRodsDirect(duration);
+
+    unsigned numLinks = (unsigned)lengths.size();
+    for (unsigned i = 0; i < numLinks; i++)
+    {
+        if (direct && types[i] == ROD) continue;
+
+        Particle *second = endpoints[i*2+1] == NO_PARTICLE ?
+            NULL : particles[endpoints[i*2+1]];
+        projectDistance(particles[endpoints[i*2]], second, anchors[i],
+            lengths[i], types[i] == CABLE, compliances[i], &lambdas[i],
+            duration);
+    }
+    return true;
+}
+
+void ParticleLinkSet::resetProjection()
+{
+    std::fill(lambdas.begin(), lambdas.end(), (real)0);
+}
@@ -18,7 +18,10 @@ using namespace cyclone;
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
 :
 resolver(iterations),
-maxContacts(maxContacts)
+maxContacts(maxContacts),
+positionBased(false),
+substeps(8),
+positionIterations(1)
 {
     contacts = new ParticleContact[maxContacts];
     calculateIterations = (iterations == 0);
@@ -65,23 +68,43 @@ unsigned ParticleWorld::generateContacts()
 
 void ParticleWorld::integrate(real duration)
 {
+    registry.updateForces(duration);
+
     for (Particles::iterator p = particles.begin();
         p != particles.end();
         p++)
     {
-        // Remove all forces from the accumulator
+        fields.applyTo(*p);
         (*p)->integrate(duration);
     }
 }
 
+void ParticleWorld::applyForceFields()
+{
+    for (Particles::iterator p = particles.begin();
+        p != particles.end();
+        p++)
+    {
+        fields.applyTo(*p);
+    }
+}
+
 void ParticleWorld::runPhysics(real duration)
 {
-    // First apply the force generators
-    registry.updateForces(duration);
+    if (positionBased)
+    {
+        runPositionBased(duration);
+        return;
+    }
 
-    // Then integrate the objects
+    // Apply the force generators and integrate the objects
     integrate(duration);
 
+    resolveContacts(duration);
+}
+
+void ParticleWorld::resolveContacts(real duration)
+{
     // Generate contacts
     unsigned usedContacts = generateContacts();
 
@@ -93,6 +116,78 @@ void ParticleWorld::runPhysics(real duration)
     }
 }
 
+void ParticleWorld::setPositionBased(bool positionBased, unsigned substeps,
+                                     unsigned iterations)
+{
+    ParticleWorld::positionBased = positionBased;
+    ParticleWorld::substeps = substeps > 0 ? substeps : 1;
+    ParticleWorld::positionIterations = iterations > 0 ? iterations : 1;
+}
+
+void ParticleWorld::runPositionBased(real duration)
+{
+    // The forces are found once, and used for every substep.
+    registry.updateForces(duration);
+    applyForceFields();
+
+    real substepDuration = duration / (real)substeps;
+    previousPositions.resize(particles.size());
+
+    for (unsigned substep = 0; substep < substeps; substep++)
+    {
+        // Move the particles with their current velocity.
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            previousPositions[i] = particles[i]->getPosition();
+            particles[i]->predictPosition(substepDuration);
+        }
+
+        for (ContactGenerators::iterator g = contactGenerators.begin();
+            g != contactGenerators.end();
+            g++)
+        {
+            (*g)->resetProjection();
+        }
+
+        // Then move them back to satisfy the constraints.
+        for (unsigned iteration = 0; iteration < positionIterations;
+            iteration++)
+        {
+            for (ContactGenerators::iterator g = contactGenerators.begin();
+                g != contactGenerators.end();
+                g++)
+            {
+                if ((*g)->projectPositions(substepDuration)) continue;
+
+                // This generator can only give us contacts, so move
+                // the particles out of each one in turn.
+                unsigned used = (*g)->addContact(contacts, maxContacts);
+                for (unsigned i = 0; i < used; i++)
+                {
+                    contacts[i].resolveInterpenetration(substepDuration);
+                }
+            }
+        }
+
+        // The velocity is whatever carried the particles to where
+        // they ended up.
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            if (particles[i]->getInverseMass() <= 0) continue;
+            particles[i]->setVelocity(
+                (particles[i]->getPosition() - previousPositions[i]) *
+                (((real)1.0) / substepDuration));
+        }
+    }
+
+    for (Particles::iterator p = particles.begin();
+        p != particles.end();
+        p++)
+    {
+        (*p)->clearAccumulator();
+    }
+}
+
 ParticleWorld::Particles& ParticleWorld::getParticles()
 {
     return particles;
@@ -108,6 +203,16 @@ ParticleForceRegistry& ParticleWorld::getForceRegistry()
     return registry;
 }
 
+ForceFields& ParticleWorld::getForceFields()
+{
+    return fields;
+}
+
+ParticleContactResolver& ParticleWorld::getContactResolver()
+{
+    return resolver;
+}
+
 void GroundContacts::init(cyclone::ParticleWorld::Particles *particles)
 {
     GroundContacts::particles = particles;
@@ -0,0 +1,198 @@
+/*
+ * Implementation file for wave surfaces and buoyancy on them.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include <assert.h>
+#include <cyclone/waves.h>
+
+using namespace cyclone;
+
+/**
+ * The number of times the point on the undisturbed surface that the
+ * waves carry over a given position is refined. Each pass reduces the
+ * error by around the wave steepness.
+ */
+static const unsigned HEIGHT_ITERATIONS = 6;
+
+WaveField::WaveField(real baseHeight, real gravity)
+:
+baseHeight(baseHeight),
+time(0),
+gravity(gravity)
+{
+}
+
+unsigned WaveField::addWave(const Vector3 &direction, real amplitude,
+                            real wavelength, real steepness, real phase)
+{
+    assert(wavelength > 0);
+
+    Vector3 flat(direction.x, 0, direction.z);
+    flat.normalise();
+    real waveNumber = 2 * R_PI / wavelength;
+
+    directions.push_back(flat);
+    amplitudes.push_back(amplitude);
+    waveNumbers.push_back(waveNumber);
+    frequencies.push_back(real_sqrt(gravity * waveNumber));
+    sidewaysAmplitudes.push_back(steepness / waveNumber);
+    phases.push_back(phase);
+    return (unsigned)amplitudes.size() - 1;
+}
+
+unsigned WaveField::getWaveCount() const
+{
+    return (unsigned)amplitudes.size();
+}
+
+void WaveField::clear()
+{
+    directions.clear();
+    amplitudes.clear();
+    waveNumbers.clear();
+    frequencies.clear();
+    sidewaysAmplitudes.clear();
+    phases.clear();
+}
+
+void WaveField::setBaseHeight(real baseHeight)
+{
+    WaveField::baseHeight = baseHeight;
+}
+
+void WaveField::advance(real duration)
+{
+    time += duration;
+}
+
+void WaveField::setTime(real time)
+{
+    WaveField::time = time;
+}
+
+real WaveField::getTime() const
+{
+    return time;
+}
+
+real WaveField::getHeight(real x, real z) const
+{
+    unsigned count = (unsigned)amplitudes.size();
+    if (count == 0) return baseHeight;
+
+    // The waves move the water sideways, so first find the point of
+    // the undisturbed surface that ends up at (x, z).
+    real sourceX = x;
+    real sourceZ = z;
+    for (unsigned iteration = 0; iteration < HEIGHT_ITERATIONS; iteration++)
+    {
+        real shiftX = 0;
+        real shiftZ = 0;
+        for (unsigned i = 0; i < count; i++)
+        {
+            real angle = waveNumbers[i] *
+                (directions[i].x * sourceX + directions[i].z * sourceZ) -
+                frequencies[i] * time + phases[i];
+            real shift = sidewaysAmplitudes[i] * real_cos(angle);
+            shiftX += directions[i].x * shift;
+            shiftZ += directions[i].z * shift;
+        }
+        sourceX = x - shiftX;
+        sourceZ = z - shiftZ;
+    }
+
+    // Then find how far the waves lift it.
+    real height = baseHeight;
+    for (unsigned i = 0; i < count; i++)
+    {
+        real angle = waveNumbers[i] *
+            (directions[i].x * sourceX + directions[i].z * sourceZ) -
+            frequencies[i] * time + phases[i];
+        height += amplitudes[i] * real_sin(angle);
+    }
+    return height;
+}
+
+void WaveField::getHeights(const Vector3 *points, unsigned count,
+                           real *heights) const
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        heights[i] = getHeight(points[i].x, points[i].z);
+    }
+}
+
+HullBuoyancy::HullBuoyancy(const WaveField *surface, real maxDepth,
+                           real liquidDensity)
+:
+surface(surface),
+maxDepth(maxDepth),
+liquidDensity(liquidDensity)
+{
+}
+
+unsigned HullBuoyancy::addSample(const Vector3 &point, real volume)
+{
+    samples.push_back(point);
+    volumes.push_back(volume);
+    return (unsigned)samples.size() - 1;
+}
+
+unsigned HullBuoyancy::getSampleCount() const
+{
+    return (unsigned)samples.size();
+}
+
+void HullBuoyancy::getForceAndTorque(const RigidBody *body, Vector3 *force,
+                                     Vector3 *torque)
+{
+    force->clear();
+    torque->clear();
+
+    unsigned count = (unsigned)samples.size();
+    if (count == 0) return;
+
+    // Move every sample into the world with one transform, then find
+    // the surface over them all together.
+    Matrix4 transform = body->getTransform();
+    worldSamples.resize(count);
+    heights.resize(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        worldSamples[i] = transform.transform(samples[i]);
+    }
+    surface->getHeights(&worldSamples[0], count, &heights[0]);
+
+    // Sum the buoyancy of the submerged samples, and its torque about
+    // the centre of mass.
+    Vector3 centre = body->getPosition();
+    for (unsigned i = 0; i < count; i++)
+    {
+        real depth = heights[i] - worldSamples[i].y;
+        if (depth <= -maxDepth) continue;
+
+        real lift = liquidDensity * volumes[i];
+        if (depth < maxDepth) lift *= (depth + maxDepth) / (2 * maxDepth);
+
+        force->y += lift;
+        *torque += (worldSamples[i] - centre) % Vector3(0, lift, 0);
+    }
+}
+
+void HullBuoyancy::updateForce(RigidBody *body, real /*duration*/)
+{
+    Vector3 force, torque;
+    getForceAndTorque(body, &force, &torque);
+    if (force.y <= 0) return;
+
+    body->addForce(force);
+    body->addTorque(torque);
+}
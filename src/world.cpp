@@ -12,18 +12,18 @@
 
 #include <cstdlib>
 #include <cyclone/world.h>
+#include <math.h>
 
 using namespace cyclone;
 
 World::World(unsigned maxContacts, unsigned iterations)
 :
-firstBody(NULL),
-firstContactGen(NULL),
 resolver(iterations),
 maxContacts(maxContacts)
 {
     contacts = new Contact[maxContacts];
     calculateIterations = (iterations == 0);
+    origin.x = origin.y = origin.z = 0;
 }
 
 World::~World()
@@ -31,17 +31,74 @@ World::~World()
     delete[] contacts;
 }
 
+Handle World::addBody(RigidBody *body)
+{
+    // Start from a version the body doesn't have, so it is listed as
+    // changed after the next frame.
+    reportedVersions.push_back(body->getTransformVersion() - 1);
+    return bodies.add(body);
+}
+
+void World::addBodies(RigidBody **bodies, unsigned count, Handle *handles)
+{
+    World::bodies.reserve(World::bodies.size() + count);
+    reportedVersions.reserve(World::bodies.size() + count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        Handle handle = addBody(bodies[i]);
+        if (handles) handles[i] = handle;
+    }
+}
+
+bool World::removeBody(const Handle &handle)
+{
+    if (!bodies.isValid(handle)) return false;
+
+    // The slot map moves the last body into the gap, so do the same
+    // with its version.
+    reportedVersions[bodies.getPosition(handle)] = reportedVersions.back();
+    reportedVersions.pop_back();
+    return bodies.remove(handle);
+}
+
+RigidBody* World::getBody(const Handle &handle)
+{
+    RigidBody **body = bodies.get(handle);
+    return body ? *body : NULL;
+}
+
+unsigned World::getBodyCount() const
+{
+    return bodies.size();
+}
+
+RigidBody* World::getBodyAt(unsigned position)
+{
+    return bodies[position];
+}
+
+Handle World::addContactGenerator(ContactGenerator *generator)
+{
+    return contactGenerators.add(generator);
+}
+
+bool World::removeContactGenerator(const Handle &handle)
+{
+    return contactGenerators.remove(handle);
+}
+
+ContactResolver& World::getContactResolver()
+{
+    return resolver;
+}
+
 void World::startFrame()
 {
-    BodyRegistration *reg = firstBody;
-    while (reg)
+    for (unsigned i = 0; i < bodies.size(); i++)
     {
         // Remove all forces from the accumulator
-        reg->body->clearAccumulators();
-        reg->body->calculateDerivedData();
-
-        // Get the next registration
-        reg = reg->next;
+        bodies[i]->clearAccumulators();
+        bodies[i]->updateDerivedData();
     }
 }
 
@@ -50,18 +107,15 @@ unsigned World::generateContacts()
     unsigned limit = maxContacts;
     Contact *nextContact = contacts;
 
-    ContactGenRegistration * reg = firstContactGen;
-    while (reg)
+    for (unsigned i = 0; i < contactGenerators.size(); i++)
     {
-        unsigned used = reg->gen->addContact(nextContact, limit);
+        unsigned used = contactGenerators[i]->addContact(nextContact, limit);
         limit -= used;
         nextContact += used;
 
         // We've run out of contacts to fill. This means we're missing
         // contacts.
         if (limit <= 0) break;
-
-        reg = reg->next;
     }
 
     // Return the number of contacts used.
@@ -73,21 +127,126 @@ void World::runPhysics(real duration)
     // First apply the force generators
     //registry.updateForces(duration);
 
-    // Then integrate the objects
-    BodyRegistration *reg = firstBody;
-    while (reg)
+    // Then the explosions, dropping any that have finished.
+    unsigned remaining = 0;
+    for (unsigned i = 0; i < explosions.size(); i++)
     {
-        // Remove all forces from the accumulator
-        reg->body->integrate(duration);
+        explosions[i]->apply(duration);
+        if (!explosions[i]->isFinished())
+        {
+            explosions[remaining++] = explosions[i];
+        }
+    }
+    explosions.resize(remaining);
 
-        // Get the next registration
-        reg = reg->next;
+    // Then integrate the objects, with the force fields (which only
+    // move dynamic bodies).
+    for (unsigned i = 0; i < bodies.size(); i++)
+    {
+        RigidBody *body = bodies[i];
+        if (body->getAwake() &&
+            body->getBodyType() == RigidBody::DYNAMIC_BODY)
+        {
+            fields.applyTo(body);
+        }
+        body->integrate(duration);
     }
 
     // Generate contacts
     unsigned usedContacts = generateContacts();
 
-    // And process them
-    if (calculateIterations) resolver.setIterations(usedContacts * 4);
+    // And process them. The constraint rows are resolved along with
+    // the contacts, and the resolver needs at least one iteration to
+    // resolve anything at all.
+    if (calculateIterations)
+    {
+        unsigned rows = usedContacts + resolver.getConstraintRowCount();
+        resolver.setIterations(rows > 0 ? rows * 4 : 1);
+    }
     resolver.resolveContacts(contacts, usedContacts, duration);
-}
\ No newline at end of file
+
+    // List the bodies that have moved since they were last listed.
+    changedBodies.clear();
+    for (unsigned i = 0; i < bodies.size(); i++)
+    {
+        unsigned version = bodies[i]->getTransformVersion();
+        if (version != reportedVersions[i])
+        {
+            reportedVersions[i] = version;
+            changedBodies.push_back(bodies.getHandle(i));
+        }
+    }
+}
+
+const std::vector<Handle>& World::getChangedBodies() const
+{
+    return changedBodies;
+}
+
+ForceFields& World::getForceFields()
+{
+    return fields;
+}
+
+void World::addExplosion(Explosion *explosion)
+{
+    explosions.push_back(explosion);
+}
+
+unsigned World::getExplosionCount() const
+{
+    return (unsigned)explosions.size();
+}
+
+WorldPosition World::getWorldPosition(const Vector3 &position) const
+{
+    WorldPosition result;
+    result.x = origin.x + position.x;
+    result.y = origin.y + position.y;
+    result.z = origin.z + position.z;
+    return result;
+}
+
+Vector3 World::getLocalPosition(const WorldPosition &position) const
+{
+    return Vector3(
+        (real)(position.x - origin.x),
+        (real)(position.y - origin.y),
+        (real)(position.z - origin.z)
+        );
+}
+
+void World::shiftOrigin(const Vector3 &offset)
+{
+    origin.x += offset.x;
+    origin.y += offset.y;
+    origin.z += offset.z;
+    fields.shiftOrigin(offset);
+    for (unsigned i = 0; i < explosions.size(); i++)
+    {
+        explosions[i]->detonation -= offset;
+    }
+
+    for (unsigned i = 0; i < bodies.size(); i++)
+    {
+        // Keep the body where it is in the world.
+        Vector3 position;
+        bodies[i]->getPosition(&position);
+        position -= offset;
+        bodies[i]->setPosition(position);
+        bodies[i]->calculateDerivedData();
+    }
+}
+
+void World::recentre(const Vector3 &focus, real sectorSize)
+{
+    // Work out the sector in world coordinates, so the origin always
+    // lands exactly on a sector corner.
+    WorldPosition centre = getWorldPosition(focus);
+    Vector3 offset(
+        (real)(floor(centre.x / sectorSize) * sectorSize - origin.x),
+        (real)(floor(centre.y / sectorSize) * sectorSize - origin.y),
+        (real)(floor(centre.z / sectorSize) * sectorSize - origin.z)
+        );
+    if (offset.squareMagnitude() > 0) shiftOrigin(offset);
+}